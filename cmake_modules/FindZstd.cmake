@@ -0,0 +1,28 @@
+#[[
+# Try to find zstd library Once done this will define
+#
+# Zstd_FOUND - system has zstd
+# ZSTD_INCLUDE_DIRS - The zstd include directory
+# ZSTD_LIBRARIES - Link these to use zstd
+# Zstd_lib - Imported Targets
+#]]
+
+find_path(ZSTD_INCLUDE_DIRS zstd.h)
+find_library(ZSTD_LIBRARIES NAMES zstd)
+if(ZSTD_INCLUDE_DIRS AND ZSTD_LIBRARIES AND NOT TARGET Zstd_lib)
+  add_library(Zstd_lib INTERFACE IMPORTED)
+  set_target_properties(
+    Zstd_lib
+    PROPERTIES
+    INTERFACE_INCLUDE_DIRECTORIES "${ZSTD_INCLUDE_DIRS}" INTERFACE_LINK_LIBRARIES "${ZSTD_LIBRARIES}"
+  )
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(
+  Zstd
+  DEFAULT_MSG
+  ZSTD_INCLUDE_DIRS
+  ZSTD_LIBRARIES
+)
+mark_as_advanced(ZSTD_INCLUDE_DIRS ZSTD_LIBRARIES)
@@ -0,0 +1,237 @@
+/**
+ *
+ *  @file FrameCodec.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/net/FrameCodec.h>
+#include <trantor/net/TcpConnection.h>
+#include <trantor/utils/BinaryCodec.h>
+#include <trantor/utils/ByteSearch.h>
+#include <trantor/utils/Logger.h>
+#include <stdexcept>
+
+using namespace trantor;
+
+constexpr size_t FrameCodec::kDefaultMaxFrameSize;
+
+FrameCodec FrameCodec::lengthPrefixed(size_t headerSize, bool bigEndian)
+{
+    if (headerSize != 1 && headerSize != 2 && headerSize != 4 &&
+        headerSize != 8)
+        throw std::invalid_argument("The length of a frame header must be 1, "
+                                    "2, 4 or 8 bytes");
+    FrameCodec codec(Type::Length);
+    codec.headerSize_ = headerSize;
+    codec.bigEndian_ = bigEndian;
+    return codec;
+}
+
+FrameCodec FrameCodec::varintPrefixed()
+{
+    return FrameCodec(Type::Varint);
+}
+
+FrameCodec FrameCodec::delimited(const std::string &delimiter)
+{
+    if (delimiter.empty())
+        throw std::invalid_argument("The frame delimiter is empty");
+    FrameCodec codec(Type::Delimiter);
+    codec.delimiter_ = delimiter;
+    return codec;
+}
+
+template <typename T>
+static uint64_t readLength(const char *data, bool bigEndian)
+{
+    T v;
+    if (bigEndian)
+        codec::detail::getFixed<T, true>(data, v);
+    else
+        codec::detail::getFixed<T, false>(data, v);
+    return v;
+}
+
+template <typename T>
+static void writeLength(char *data, uint64_t len, bool bigEndian)
+{
+    if (len > static_cast<T>(-1))
+        throw std::length_error("The frame is too large for its header");
+    if (bigEndian)
+        codec::detail::putFixed<T, true>(data, static_cast<T>(len));
+    else
+        codec::detail::putFixed<T, false>(data, static_cast<T>(len));
+}
+
+int FrameCodec::parseHeader(const char *data, size_t size, uint64_t &len) const
+{
+    if (type_ == Type::Varint)
+    {
+        const char *p = data;
+        switch (codec::getVarint(p, data + size, len))
+        {
+            case codec::DecodeStatus::Ok:
+                return static_cast<int>(p - data);
+            case codec::DecodeStatus::NeedMoreData:
+                return 0;
+            default:
+                return -1;
+        }
+    }
+    if (size < headerSize_)
+        return 0;
+    switch (headerSize_)
+    {
+        case 1:
+            len = readLength<uint8_t>(data, bigEndian_);
+            break;
+        case 2:
+            len = readLength<uint16_t>(data, bigEndian_);
+            break;
+        case 4:
+            len = readLength<uint32_t>(data, bigEndian_);
+            break;
+        default:
+            len = readLength<uint64_t>(data, bigEndian_);
+            break;
+    }
+    return static_cast<int>(headerSize_);
+}
+
+void FrameCodec::onMessage(const TcpConnectionPtr &conn,
+                           MsgBuffer *buf,
+                           size_t &scanned) const
+{
+    while (buf->readableBytes() > 0)
+    {
+        if (type_ == Type::Delimiter)
+        {
+            // The end of the scanned data may hold the start of the delimiter
+            size_t from = 0;
+            if (scanned >= delimiter_.length() &&
+                scanned <= buf->readableBytes())
+                from = scanned - (delimiter_.length() - 1);
+            auto end = detail::findSequence(buf->peek() + from,
+                                            buf->beginWrite(),
+                                            delimiter_.data(),
+                                            delimiter_.length());
+            if (!end)
+            {
+                scanned = buf->readableBytes();
+                // The delimiter may have been partially received
+                if (buf->readableBytes() >=
+                    maxFrameSize_ + delimiter_.length())
+                {
+                    scanned = 0;
+                    onError(conn, buf, "Frame too large");
+                }
+                return;
+            }
+            scanned = 0;
+            size_t len = end - buf->peek();
+            if (len > maxFrameSize_)
+            {
+                onError(conn, buf, "Frame too large");
+                return;
+            }
+            if (frameCallback_)
+                frameCallback_(conn, buf->peek(), len);
+            buf->retrieve(len + delimiter_.length());
+            continue;
+        }
+
+        uint64_t len;
+        int headerSize = parseHeader(buf->peek(), buf->readableBytes(), len);
+        if (headerSize == 0)
+            return;
+        if (headerSize < 0)
+        {
+            onError(conn, buf, "Malformed frame header");
+            return;
+        }
+        if (len > maxFrameSize_)
+        {
+            onError(conn, buf, "Frame too large");
+            return;
+        }
+        size_t frameSize = headerSize + static_cast<size_t>(len);
+        if (buf->readableBytes() < frameSize)
+        {
+            // Make room for the rest of the frame at once
+            buf->ensureWritableBytes(frameSize - buf->readableBytes());
+            return;
+        }
+        if (frameCallback_)
+            frameCallback_(conn,
+                           buf->peek() + headerSize,
+                           static_cast<size_t>(len));
+        buf->retrieve(frameSize);
+    }
+}
+
+void FrameCodec::onError(const TcpConnectionPtr &conn,
+                         MsgBuffer *buf,
+                         const std::string &reason) const
+{
+    buf->retrieveAll();
+    if (errorCallback_)
+    {
+        errorCallback_(conn, reason);
+        return;
+    }
+    LOG_ERROR << reason << " from " << conn->peerAddr().toIpPort()
+              << ", closing the connection";
+    conn->forceClose();
+}
+
+RecvMessageCallback FrameCodec::recvMessageCallback() const
+{
+    FrameCodec codec(*this);
+    size_t scanned{0};
+    return [codec, scanned](const TcpConnectionPtr &conn,
+                            MsgBuffer *buf) mutable {
+        codec.onMessage(conn, buf, scanned);
+    };
+}
+
+void FrameCodec::encode(MsgBuffer &buf, const char *data, size_t len) const
+{
+    if (type_ == Type::Delimiter)
+    {
+        buf.ensureWritableBytes(len + delimiter_.length());
+        buf.append(data, len);
+        buf.append(delimiter_);
+        return;
+    }
+    buf.ensureWritableBytes(10 + len);
+    if (type_ == Type::Varint)
+    {
+        codec::appendVarint(buf, len);
+    }
+    else
+    {
+        char *p = buf.beginWrite();
+        switch (headerSize_)
+        {
+            case 1:
+                writeLength<uint8_t>(p, len, bigEndian_);
+                break;
+            case 2:
+                writeLength<uint16_t>(p, len, bigEndian_);
+                break;
+            case 4:
+                writeLength<uint32_t>(p, len, bigEndian_);
+                break;
+            default:
+                writeLength<uint64_t>(p, len, bigEndian_);
+                break;
+        }
+        buf.hasWritten(headerSize_);
+    }
+    buf.append(data, len);
+}
@@ -0,0 +1,161 @@
+/**
+ *
+ *  @file FrameCodec.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+#include <trantor/net/callbacks.h>
+#include <trantor/utils/MsgBuffer.h>
+#include <trantor/exports.h>
+#include <functional>
+#include <string>
+
+namespace trantor
+{
+/**
+ * @brief This class splits the received byte stream of connections into
+ * frames. Its recvMessageCallback() is installed as the message callback of
+ * a TcpServer or a TcpClient, and each complete frame is passed to the frame
+ * callback as a pointer into the receive buffer, without copying.
+ *
+ * Frames larger than the maximum frame size are rejected as soon as their
+ * header is received (or, for delimited frames, as soon as more data than
+ * the maximum is buffered without a delimiter), so the buffer is not grown
+ * to hold them. The codec only runs after each read event though, which
+ * reads up to 1MB, so the buffer may hold up to the maximum frame size plus
+ * one such read before a frame is rejected.
+ */
+class TRANTOR_EXPORT FrameCodec
+{
+  public:
+    /**
+     * @brief The callback receiving the frames. The data is only valid
+     * during the call.
+     */
+    using FrameCallback = std::function<
+        void(const TcpConnectionPtr &, const char *data, size_t len)>;
+    /**
+     * @brief The callback called when the stream can not be split into
+     * frames, the data of the connection is discarded after it.
+     */
+    using FrameErrorCallback =
+        std::function<void(const TcpConnectionPtr &, const std::string &)>;
+
+    static constexpr size_t kDefaultMaxFrameSize{16 * 1024 * 1024};
+
+    /**
+     * @brief Frames made of their length in headerSize bytes (1, 2, 4 or 8)
+     * followed by the data.
+     *
+     * @param headerSize The size of the length field.
+     * @param bigEndian The byte order of the length field.
+     */
+    static FrameCodec lengthPrefixed(size_t headerSize, bool bigEndian = true);
+
+    /**
+     * @brief Frames made of their length in a LEB128 varint followed by the
+     * data.
+     */
+    static FrameCodec varintPrefixed();
+
+    /**
+     * @brief Frames ended by the delimiter, which is not part of the frame.
+     */
+    static FrameCodec delimited(const std::string &delimiter);
+
+    /**
+     * @brief Set the maximum size of the data of a frame.
+     */
+    void setMaxFrameSize(size_t size)
+    {
+        maxFrameSize_ = size;
+    }
+    size_t maxFrameSize() const
+    {
+        return maxFrameSize_;
+    }
+
+    void setFrameCallback(FrameCallback cb)
+    {
+        frameCallback_ = std::move(cb);
+    }
+
+    /**
+     * @brief Set the callback for framing errors. By default the error is
+     * logged and the connection is closed.
+     */
+    void setErrorCallback(FrameErrorCallback cb)
+    {
+        errorCallback_ = std::move(cb);
+    }
+
+    /**
+     * @brief Deliver all the complete frames in the buffer and remove them
+     * from it.
+     */
+    void onMessage(const TcpConnectionPtr &conn, MsgBuffer *buf) const
+    {
+        size_t scanned{0};
+        onMessage(conn, buf, scanned);
+    }
+
+    /**
+     * @brief The same, resuming the search for the delimiter where the
+     * previous call on the buffer left it, so a large delimited frame is not
+     * scanned again on every read. scanned is kept by the caller for each
+     * buffer, starting at 0.
+     */
+    void onMessage(const TcpConnectionPtr &conn,
+                   MsgBuffer *buf,
+                   size_t &scanned) const;
+
+    /**
+     * @brief Get a message callback using a copy of this codec. The callback
+     * is copied for each connection, along with the position of the search
+     * for the delimiter.
+     */
+    RecvMessageCallback recvMessageCallback() const;
+
+    /**
+     * @brief Append a frame holding the data to the buffer.
+     */
+    void encode(MsgBuffer &buf, const char *data, size_t len) const;
+    void encode(MsgBuffer &buf, const std::string &data) const
+    {
+        encode(buf, data.data(), data.length());
+    }
+
+  private:
+    enum class Type
+    {
+        Length,
+        Varint,
+        Delimiter
+    };
+    explicit FrameCodec(Type type) : type_(type)
+    {
+    }
+    // Returns the size of the header and sets len if the header of the frame
+    // is complete, 0 if more data is needed and -1 if it is malformed.
+    int parseHeader(const char *data, size_t size, uint64_t &len) const;
+    void onError(const TcpConnectionPtr &conn,
+                 MsgBuffer *buf,
+                 const std::string &reason) const;
+
+    Type type_;
+    size_t headerSize_{0};
+    bool bigEndian_{true};
+    std::string delimiter_;
+    size_t maxFrameSize_{kDefaultMaxFrameSize};
+    FrameCallback frameCallback_;
+    FrameErrorCallback errorCallback_;
+};
+}  // namespace trantor
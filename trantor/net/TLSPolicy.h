@@ -134,6 +134,35 @@ struct TRANTOR_EXPORT TLSPolicy final
         return *this;
     }
 
+    /**
+     * @brief Enable dynamic TLS record sizing. New connections and connections
+     * resuming after being idle send small records that fit in a single TCP
+     * segment, so the peer can decrypt the first bytes early. After a few
+     * records the provider ramps up to full sized (16KB) records for bulk
+     * transfer.
+     *
+     * @note Only the OpenSSL provider supports this feature. Enabled by
+     * default.
+     */
+    TLSPolicy &setDynamicRecordSizing(bool enable)
+    {
+        dynamicRecordSizing_ = enable;
+        return *this;
+    }
+
+    /**
+     * @brief Coalesce the data of multiple send() calls made in the same
+     * event loop iteration and encrypt it at once at the end of the
+     * iteration. This produces fewer, fuller TLS records and fewer writes to
+     * the socket, at the cost of delaying the data until the end of the
+     * iteration. Disabled by default.
+     */
+    TLSPolicy &setCoalesceSends(bool enable)
+    {
+        coalesceSends_ = enable;
+        return *this;
+    }
+
     // The getters
     const std::vector<std::pair<std::string, std::string>> &getConfCmds() const
     {
@@ -181,6 +210,16 @@ struct TRANTOR_EXPORT TLSPolicy final
         return useSystemCertStore_;
     }
 
+    bool getDynamicRecordSizing() const
+    {
+        return dynamicRecordSizing_;
+    }
+
+    bool getCoalesceSends() const
+    {
+        return coalesceSends_;
+    }
+
     static std::shared_ptr<TLSPolicy> defaultServerPolicy(
         const std::string &certPath,
         const std::string &keyPath)
@@ -216,6 +255,8 @@ struct TRANTOR_EXPORT TLSPolicy final
     bool validate_ = true;
     bool allowBrokenChain_ = false;
     bool useSystemCertStore_ = true;
+    bool dynamicRecordSizing_ = true;
+    bool coalesceSends_ = false;
 };
 using TLSPolicyPtr = std::shared_ptr<TLSPolicy>;
 }  // namespace trantor
\ No newline at end of file
@@ -245,5 +245,5 @@ void TcpClient::enableSSL(
         .setKeyPath(keyPath)
         .setHostname(hostname)
         .setCaPath(caPath);
-    sslContextPtr_ = newSSLContext(*tlsPolicyPtr_, false);
+    sslContextPtr_ = getSharedSSLContext(*tlsPolicyPtr_, false);
 }
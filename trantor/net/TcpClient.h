@@ -228,7 +228,7 @@ class TRANTOR_EXPORT TcpClient : NonCopyable,
     void enableSSL(TLSPolicyPtr policy)
     {
         tlsPolicyPtr_ = std::move(policy);
-        sslContextPtr_ = newSSLContext(*tlsPolicyPtr_, false);
+        sslContextPtr_ = getSharedSSLContext(*tlsPolicyPtr_, false);
     }
 
   private:
@@ -18,6 +18,7 @@
 #include <trantor/net/InetAddress.h>
 #include <trantor/utils/NonCopyable.h>
 #include <trantor/utils/MsgBuffer.h>
+#include <trantor/utils/SegmentedBuffer.h>
 #include <trantor/net/callbacks.h>
 #include <trantor/net/Certificate.h>
 #include <trantor/net/TLSPolicy.h>
@@ -62,6 +63,24 @@ class TRANTOR_EXPORT TcpConnection
     virtual void send(const std::shared_ptr<std::string> &msgPtr) = 0;
     virtual void send(const std::shared_ptr<MsgBuffer> &msgPtr) = 0;
 
+    /**
+     * @brief Send the data in a segmented buffer to the peer. The blocks of
+     * the buffer are written with a gather write when possible and are queued
+     * without copying otherwise.
+     *
+     * @param buffer
+     */
+    virtual void send(SegmentedBuffer &&buffer) = 0;
+
+    /**
+     * @brief Send a slice of received data to the peer. The data is not
+     * copied unless the connection is encrypted, the slice keeps it alive
+     * until it is sent.
+     *
+     * @param slice
+     */
+    virtual void send(const BufferSlice &slice) = 0;
+
     /**
      * @brief Send a file to the peer.
      *
@@ -267,6 +286,18 @@ class TRANTOR_EXPORT TcpConnection
      */
     virtual MsgBuffer *getRecvBuffer() = 0;
 
+    /**
+     * @brief Receive data into a ring buffer of a fixed size, see
+     * MsgBuffer::enableRingBuffer(). Suited to long-lived streaming
+     * connections. It must be called in the loop thread of the connection,
+     * e.g. in the connection callback.
+     *
+     * @param capacity
+     * @return false if ring buffers are not supported, the connection keeps
+     * using a normal buffer then.
+     */
+    virtual bool enableRecvRingBuffer(size_t capacity) = 0;
+
     /**
      * @brief Get peer certificate (if any).
      *
@@ -327,6 +358,22 @@ class TRANTOR_EXPORT TcpConnection
     {
         recvMsgCallback_ = std::move(cb);
     }
+    /**
+     * @brief Receive data in a SegmentedBuffer instead of a MsgBuffer. The
+     * data is read into pooled blocks, so large messages are never moved when
+     * the buffer grows. When set, this callback is used instead of the
+     * RecvMessageCallback.
+     *
+     * @param cb
+     */
+    void setRecvSegmentedMsgCallback(const RecvSegmentedMessageCallback &cb)
+    {
+        recvSegmentedMsgCallback_ = cb;
+    }
+    void setRecvSegmentedMsgCallback(RecvSegmentedMessageCallback &&cb)
+    {
+        recvSegmentedMsgCallback_ = std::move(cb);
+    }
     void setConnectionCallback(const ConnectionCallback &cb)
     {
         connectionCallback_ = cb;
@@ -376,6 +423,7 @@ class TRANTOR_EXPORT TcpConnection
   protected:
     // callbacks
     RecvMessageCallback recvMsgCallback_;
+    RecvSegmentedMessageCallback recvSegmentedMsgCallback_;
     ConnectionCallback connectionCallback_;
     CloseCallback closeCallback_;
     WriteCompleteCallback writeCompleteCallback_;
@@ -389,4 +437,29 @@ class TRANTOR_EXPORT TcpConnection
 TRANTOR_EXPORT SSLContextPtr newSSLContext(const TLSPolicy &policy,
                                            bool server);
 
+/**
+ * @brief Get the SSL context for the policy from the process-wide cache. The
+ * context is created by newSSLContext() on first use and shared by all
+ * connections using an equivalent policy afterwards, so certificates, keys
+ * and CA bundles are only loaded once.
+ *
+ * @note The hostname is not part of the cache key since it is set per
+ * connection. Call invalidateSharedSSLContext() when the files referenced by
+ * the policy change on disk.
+ */
+TRANTOR_EXPORT SSLContextPtr getSharedSSLContext(const TLSPolicy &policy,
+                                                 bool server);
+
+/**
+ * @brief Remove the context of the policy from the cache. Connections that
+ * already hold the context are not affected.
+ */
+TRANTOR_EXPORT void invalidateSharedSSLContext(const TLSPolicy &policy,
+                                               bool server);
+
+/**
+ * @brief Remove all contexts from the cache.
+ */
+TRANTOR_EXPORT void clearSharedSSLContexts();
+
 }  // namespace trantor
@@ -232,7 +232,7 @@ void TcpServer::enableSSL(
         .setConfCmds(sslConfCmds)
         .setCaPath(caPath)
         .setValidate(caPath.empty() ? false : true);
-    sslContextPtr_ = newSSLContext(*policyPtr_, true);
+    sslContextPtr_ = getSharedSSLContext(*policyPtr_, true);
 }
 
 void TcpServer::reloadSSL()
@@ -241,7 +241,8 @@ void TcpServer::reloadSSL()
     {
         if (policyPtr_)
         {
-            sslContextPtr_ = newSSLContext(*policyPtr_, true);
+            invalidateSharedSSLContext(*policyPtr_, true);
+            sslContextPtr_ = getSharedSSLContext(*policyPtr_, true);
         }
     }
     else
@@ -249,7 +250,8 @@ void TcpServer::reloadSSL()
         loop_->queueInLoop([this]() {
             if (policyPtr_)
             {
-                sslContextPtr_ = newSSLContext(*policyPtr_, true);
+                invalidateSharedSSLContext(*policyPtr_, true);
+                sslContextPtr_ = getSharedSSLContext(*policyPtr_, true);
             }
         });
     }
@@ -257,14 +257,15 @@ class TRANTOR_EXPORT TcpServer : NonCopyable
     void enableSSL(TLSPolicyPtr policy)
     {
         policyPtr_ = std::move(policy);
-        sslContextPtr_ = newSSLContext(*policyPtr_, true);
+        sslContextPtr_ = getSharedSSLContext(*policyPtr_, true);
     }
 
     /**
      * @brief Reload the SSL context.
      * @note Call this function when the certificate or private key is updated.
      * The server will reload the SSL context and use the new certificate and
-     * private key. new connections will use the new SSL context.
+     * private key. new connections will use the new SSL context. The shared
+     * context of the policy is replaced as well.
      */
     void reloadSSL();
 
@@ -29,10 +29,13 @@ using TimerCallback = std::function<void()>;
 // the data has been read to (buf, len)
 class TcpConnection;
 class MsgBuffer;
+class SegmentedBuffer;
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 // tcp server and connection callback
 using RecvMessageCallback =
     std::function<void(const TcpConnectionPtr &, MsgBuffer *)>;
+using RecvSegmentedMessageCallback =
+    std::function<void(const TcpConnectionPtr &, SegmentedBuffer *)>;
 using ConnectionErrorCallback = std::function<void()>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
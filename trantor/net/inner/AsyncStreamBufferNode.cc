@@ -60,6 +60,7 @@ class AsyncBufferNode : public BufferNode
 };
 BufferNodePtr BufferNode::newAsyncStreamBufferNode()
 {
-    return std::make_shared<AsyncBufferNode>();
+    return std::allocate_shared<AsyncBufferNode>(
+        PoolAllocator<AsyncBufferNode>());
 }
 }  // namespace trantor
@@ -17,9 +17,11 @@
 #include <stdio.h>
 #endif
 #include <trantor/utils/MsgBuffer.h>
+#include <trantor/utils/SegmentedBuffer.h>
 #include <trantor/utils/NonCopyable.h>
 #include <trantor/utils/Logger.h>
 #include <functional>
+#include <assert.h>
 #include <memory>
 #include <string>
 
@@ -66,6 +68,8 @@ class BufferNode : public NonCopyable
         isDone_ = true;
     }
     static BufferNodePtr newMemBufferNode();
+    static BufferNodePtr newSegmentedBufferNode(SegmentedBuffer &&buffer);
+    static BufferNodePtr newSliceBufferNode(BufferSlice &&slice);
 
     static BufferNodePtr newStreamBufferNode(StreamCallback &&cb);
 #ifdef _WIN32
@@ -81,6 +85,75 @@ class BufferNode : public NonCopyable
 
   protected:
     bool isDone_{false};
+
+  private:
+    friend class BufferNodeQueue;
+    // Link of the write queue holding the node
+    BufferNodePtr next_;
+};
+
+/**
+ * @brief The write queue of a connection. The nodes are linked through their
+ * next_ member, so queuing one does not allocate.
+ */
+class BufferNodeQueue : public NonCopyable
+{
+  public:
+    BufferNodeQueue() = default;
+    ~BufferNodeQueue()
+    {
+        clear();
+    }
+    bool empty() const
+    {
+        return !head_;
+    }
+    size_t size() const
+    {
+        return size_;
+    }
+    const BufferNodePtr &front() const
+    {
+        assert(head_);
+        return head_;
+    }
+    BufferNode *back() const
+    {
+        assert(tail_);
+        return tail_;
+    }
+    void push_back(BufferNodePtr node)
+    {
+        assert(node && !node->next_);
+        auto last = node.get();
+        if (tail_)
+            tail_->next_ = std::move(node);
+        else
+            head_ = std::move(node);
+        tail_ = last;
+        ++size_;
+    }
+    void pop_front()
+    {
+        assert(head_);
+        auto node = std::move(head_);
+        head_ = std::move(node->next_);
+        if (!head_)
+            tail_ = nullptr;
+        --size_;
+    }
+    void clear()
+    {
+        // Unlink the nodes one by one instead of recursing through the
+        // destructors of a long chain
+        while (head_)
+            pop_front();
+    }
+
+  private:
+    BufferNodePtr head_;
+    BufferNode *tail_{nullptr};
+    size_t size_{0};
 };
 
 }  // namespace trantor
\ No newline at end of file
@@ -112,8 +112,8 @@ void Connector::connect()
         case EBADF:
         case EFAULT:
         case ENOTSOCK:
-            LOG_SYSERR << "connect error in Connector::startInLoop "
-                       << savedErrno;
+            LOG_SYSERR_EVERY_MS(1000)
+                << "connect error in Connector::startInLoop " << savedErrno;
             socketHanded_ = true;
 #ifndef _WIN32
             ::close(fd_);
@@ -125,8 +125,8 @@ void Connector::connect()
             break;
 
         default:
-            LOG_SYSERR << "Unexpected error in Connector::startInLoop "
-                       << savedErrno;
+            LOG_SYSERR_EVERY_MS(1000)
+                << "Unexpected error in Connector::startInLoop " << savedErrno;
             socketHanded_ = true;
 #ifndef _WIN32
             ::close(fd_);
@@ -178,8 +178,8 @@ void Connector::handleWrite()
         int err = Socket::getSocketError(sockfd);
         if (err)
         {
-            LOG_WARN << "Connector::handleWrite - SO_ERROR = " << err << " "
-                     << strerror_tl(err);
+            LOG_WARN_EVERY_MS(1000) << "Connector::handleWrite - SO_ERROR = "
+                                    << err << " " << strerror_tl(err);
             if (retry_)
             {
                 retry(sockfd);
@@ -166,6 +166,7 @@ BufferNodePtr BufferNode::newFileBufferNode(const wchar_t *fileName,
                                             long long offset,
                                             long long length)
 {
-    return std::make_shared<FileBufferNode>(fileName, offset, length);
+    return std::allocate_shared<FileBufferNode>(
+        PoolAllocator<FileBufferNode>(), fileName, offset, length);
 }
 }  // namespace trantor
\ No newline at end of file
@@ -31,6 +31,7 @@ class MemBufferNode : public BufferNode
 };
 BufferNodePtr BufferNode::newMemBufferNode()
 {
-    return std::make_shared<MemBufferNode>();
+    return std::allocate_shared<MemBufferNode>(
+        PoolAllocator<MemBufferNode>());
 }
 }  // namespace trantor
@@ -0,0 +1,106 @@
+/**
+ *
+ *  @file SSLContextCache.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  https://github.com/an-tao/trantor
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *  Trantor
+ *
+ */
+
+#include <trantor/net/TcpConnection.h>
+#include <trantor/utils/Logger.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace trantor;
+
+namespace
+{
+void appendField(std::string &key, const std::string &field)
+{
+    key.append(std::to_string(field.size()));
+    key.push_back(':');
+    key.append(field);
+}
+
+// Everything that goes into the SSL context, but not the hostname (which is
+// set on each connection), so clients connecting to different hosts with the
+// same settings still share one context.
+std::string toCacheKey(const TLSPolicy &policy, bool server)
+{
+    std::string key;
+    key.reserve(128);
+    key.push_back(server ? 'S' : 'C');
+    key.push_back(policy.getUseOldTLS() ? '1' : '0');
+    key.push_back(policy.getValidate() ? '1' : '0');
+    key.push_back(policy.getAllowBrokenChain() ? '1' : '0');
+    key.push_back(policy.getUseSystemCertStore() ? '1' : '0');
+    appendField(key, policy.getCertPath());
+    appendField(key, policy.getKeyPath());
+    appendField(key, policy.getCaPath());
+    key.append(std::to_string(policy.getConfCmds().size()));
+    for (const auto &cmd : policy.getConfCmds())
+    {
+        appendField(key, cmd.first);
+        appendField(key, cmd.second);
+    }
+    key.append(std::to_string(policy.getAlpnProtocols().size()));
+    for (const auto &proto : policy.getAlpnProtocols())
+        appendField(key, proto);
+    return key;
+}
+
+struct SSLContextCache
+{
+    std::mutex mutex_;
+    std::unordered_map<std::string, SSLContextPtr> contexts_;
+};
+
+SSLContextCache &contextCache()
+{
+    static SSLContextCache cache;
+    return cache;
+}
+}  // namespace
+
+SSLContextPtr trantor::getSharedSSLContext(const TLSPolicy &policy,
+                                           bool server)
+{
+    auto key = toCacheKey(policy, server);
+    auto &cache = contextCache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex_);
+        auto it = cache.contexts_.find(key);
+        if (it != cache.contexts_.end())
+            return it->second;
+    }
+    // Loading certificates may take a while, don't block other lookups. If
+    // another thread wins the race, its context is used and ours is dropped.
+    auto ctx = newSSLContext(policy, server);
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    auto result = cache.contexts_.emplace(std::move(key), std::move(ctx));
+    if (result.second)
+        LOG_TRACE << "Cached new SSL context, cache size: "
+                  << cache.contexts_.size();
+    return result.first->second;
+}
+
+void trantor::invalidateSharedSSLContext(const TLSPolicy &policy, bool server)
+{
+    auto key = toCacheKey(policy, server);
+    auto &cache = contextCache();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.contexts_.erase(key);
+}
+
+void trantor::clearSharedSSLContexts()
+{
+    auto &cache = contextCache();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.contexts_.clear();
+}
@@ -0,0 +1,39 @@
+#include <trantor/net/inner/BufferNode.h>
+namespace trantor
+{
+class SegmentedBufferNode : public BufferNode
+{
+  public:
+    explicit SegmentedBufferNode(SegmentedBuffer &&buffer)
+        : buffer_(std::move(buffer))
+    {
+    }
+
+    void getData(const char *&data, size_t &len) override
+    {
+        data = buffer_.peek(len);
+    }
+    void retrieve(size_t len) override
+    {
+        buffer_.retrieve(len);
+    }
+    long long remainingBytes() const override
+    {
+        if (isDone_)
+            return 0;
+        return static_cast<long long>(buffer_.readableBytes());
+    }
+    void append(const char *data, size_t len) override
+    {
+        buffer_.append(data, len);
+    }
+
+  private:
+    trantor::SegmentedBuffer buffer_;
+};
+BufferNodePtr BufferNode::newSegmentedBufferNode(SegmentedBuffer &&buffer)
+{
+    return std::allocate_shared<SegmentedBufferNode>(
+        PoolAllocator<SegmentedBufferNode>(), std::move(buffer));
+}
+}  // namespace trantor
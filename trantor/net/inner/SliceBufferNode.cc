@@ -0,0 +1,62 @@
+#include <trantor/net/inner/BufferNode.h>
+namespace trantor
+{
+// Sends the slice first, then the data appended by later send() calls
+class SliceBufferNode : public BufferNode
+{
+  public:
+    explicit SliceBufferNode(BufferSlice &&slice) : slice_(std::move(slice))
+    {
+    }
+
+    void getData(const char *&data, size_t &len) override
+    {
+        if (offset_ < slice_.size())
+        {
+            data = slice_.data() + offset_;
+            len = slice_.size() - offset_;
+            return;
+        }
+        data = buffer_.peek();
+        len = buffer_.readableBytes();
+    }
+    void retrieve(size_t len) override
+    {
+        size_t sliceLeft = slice_.size() - offset_;
+        if (len < sliceLeft)
+        {
+            offset_ += len;
+            return;
+        }
+        if (sliceLeft > 0)
+        {
+            // release the storage as soon as possible
+            slice_ = BufferSlice();
+            offset_ = 0;
+            len -= sliceLeft;
+        }
+        buffer_.retrieve(len);
+    }
+    long long remainingBytes() const override
+    {
+        if (isDone_)
+            return 0;
+        return static_cast<long long>(slice_.size() - offset_ +
+                                      buffer_.readableBytes());
+    }
+    void append(const char *data, size_t len) override
+    {
+        buffer_.append(data, len);
+    }
+
+  private:
+    BufferSlice slice_;
+    size_t offset_{0};
+    trantor::MsgBuffer buffer_{0};
+};
+BufferNodePtr BufferNode::newSliceBufferNode(BufferSlice &&slice)
+{
+    return std::allocate_shared<SliceBufferNode>(
+        PoolAllocator<SliceBufferNode>(), std::move(slice));
+}
+}  // namespace trantor
@@ -62,6 +62,7 @@ class StreamBufferNode : public BufferNode
 };
 BufferNodePtr BufferNode::newStreamBufferNode(StreamCallback &&callback)
 {
-    return std::make_shared<StreamBufferNode>(std::move(callback));
+    return std::allocate_shared<StreamBufferNode>(
+        PoolAllocator<StreamBufferNode>(), std::move(callback));
 }
 }  // namespace trantor
\ No newline at end of file
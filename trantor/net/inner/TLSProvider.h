@@ -135,6 +135,11 @@ struct TLSProvider
         return sniName_;
     }
 
+    const TLSPolicyPtr& policy() const
+    {
+        return policyPtr_;
+    }
+
   protected:
     void setPeerCertificate(CertificatePtr cert)
     {
@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 using namespace trantor;
@@ -36,6 +37,8 @@ using namespace trantor;
 #define EPIPE WSAENOTCONN
 #undef ECONNRESET
 #define ECONNRESET WSAECONNRESET
+#undef EINTR
+#define EINTR WSAEINTR
 #endif
 static inline bool isEAGAIN()
 {
@@ -57,8 +60,9 @@ static inline bool isEAGAIN()
     else
     {
         // TODO: any others?
-        LOG_SYSERR << "send node in loop: return on unexpected error(" << errno
-                   << ")";
+        LOG_SYSERR_EVERY_MS(1000)
+            << "send node in loop: return on unexpected error(" << errno
+            << ")";
         return false;
     }
 }
@@ -94,6 +98,7 @@ TcpConnectionImpl::TcpConnectionImpl(EventLoop *loop,
         tlsProviderPtr_->setMessageCallback(onSslMessage);
         // This is triggered when peer sends a close alert
         tlsProviderPtr_->setCloseCallback(onSslCloseAlert);
+        coalesceTLSSends_ = tlsProviderPtr_->policy()->getCoalesceSends();
     }
 }
 TcpConnectionImpl::~TcpConnectionImpl()
@@ -125,14 +130,88 @@ TcpConnectionImpl::~TcpConnectionImpl()
         tlsProviderPtr_->close();
 }
 
+// Adaptive read sizing: readSize_ doubles whenever a read fills the space
+// offered, and halves after a number of read events that used much less than
+// it.
+static constexpr size_t kMinReadSize = 8 * 1024;
+static constexpr size_t kMaxReadSize = 256 * 1024;
+static constexpr size_t kMaxReadBytesPerEvent = 1024 * 1024;
+static constexpr unsigned int kShrinkAfterSmallReads = 8;
+
 void TcpConnectionImpl::readCallback()
 {
     // LOG_TRACE<<"read Callback";
     loop_->assertInLoopThread();
     int ret = 0;
 
-    ssize_t n = readBuffer_.readFd(socketPtr_->fd(), &ret);
-    // LOG_TRACE<<"read "<<n<<" bytes from socket";
+    // TLS connections decrypt from readBuffer_ and copy the plaintext into
+    // readChain_ in onSslMessage()
+    const bool readIntoChain = recvSegmentedMsgCallback_ && !tlsProviderPtr_;
+    size_t received = 0;
+    ssize_t n;
+    for (;;)
+    {
+        if (readIntoChain)
+        {
+            n = readChain_.readFd(socketPtr_->fd(), &ret);
+            if (n > 0)
+                received += n;
+            break;
+        }
+        size_t len = readSize_;
+        n = readBuffer_.readFd(socketPtr_->fd(), &ret, len);
+        if (n <= 0)
+            break;
+        received += n;
+        // A short read means the socket has been drained, no need to wait for
+        // EAGAIN
+        if (static_cast<size_t>(n) < len || received >= kMaxReadBytesPerEvent)
+            break;
+        if (readSize_ < kMaxReadSize)
+            readSize_ *= 2;
+    }
+    // LOG_TRACE<<"read "<<received<<" bytes from socket";
+    if (received > 0)
+    {
+        bool shrinkReadBuffer = false;
+        if (received < readSize_ / 4)
+        {
+            if (++smallReads_ >= kShrinkAfterSmallReads)
+            {
+                smallReads_ = 0;
+                if (readSize_ > kMinReadSize)
+                {
+                    readSize_ /= 2;
+                    shrinkReadBuffer = true;
+                }
+            }
+        }
+        else
+        {
+            smallReads_ = 0;
+        }
+        extendLife();
+        bytesReceived_ += received;
+        if (tlsProviderPtr_)
+        {
+            tlsProviderPtr_->recvData(&readBuffer_);
+        }
+        else if (readIntoChain)
+        {
+            recvSegmentedMsgCallback_(shared_from_this(), &readChain_);
+        }
+        else if (recvMsgCallback_)
+        {
+            recvMsgCallback_(shared_from_this(), &readBuffer_);
+        }
+        if (shrinkReadBuffer && readBuffer_.readableBytes() == 0)
+            readBuffer_.shrinkToFit(readSize_ > kMinReadSize
+                                        ? readSize_
+                                        : TRANTOR_BUFFER_DEFAULT_LENGTH);
+        // The callbacks may have closed the connection
+        if (n > 0 || status_ == ConnStatus::Disconnected)
+            return;
+    }
     if (n == 0)
     {
         // socket closed by peer
@@ -140,50 +219,46 @@ void TcpConnectionImpl::readCallback()
     }
     else if (n < 0)
     {
-        if (errno == EPIPE || errno == ECONNRESET)
+        if (ret == EPIPE || ret == ECONNRESET)
         {
 #ifdef _WIN32
-            LOG_TRACE << "WSAENOTCONN or WSAECONNRESET, errno=" << errno
+            LOG_TRACE << "WSAENOTCONN or WSAECONNRESET, errno=" << ret
                       << " fd=" << socketPtr_->fd();
 #else
-            LOG_TRACE << "EPIPE or ECONNRESET, errno=" << errno
+            LOG_TRACE << "EPIPE or ECONNRESET, errno=" << ret
                       << " fd=" << socketPtr_->fd();
 #endif
             return;
         }
-#ifdef _WIN32
-        if (errno == WSAECONNABORTED)
+        // The read after one that filled the buffer finds the socket drained
+        if (ret == EWOULDBLOCK || ret == EAGAIN || ret == EINTR)
         {
-            LOG_TRACE << "WSAECONNABORTED, errno=" << errno;
-            handleClose();
+            LOG_TRACE << "EAGAIN, errno=" << ret << " fd=" << socketPtr_->fd();
             return;
         }
-#else
-        if (errno == EAGAIN)  // TODO: any others?
+#ifdef _WIN32
+        if (ret == WSAECONNABORTED)
         {
-            LOG_TRACE << "EAGAIN, errno=" << errno
-                      << " fd=" << socketPtr_->fd();
+            LOG_TRACE << "WSAECONNABORTED, errno=" << ret;
+            handleClose();
             return;
         }
 #endif
-        LOG_SYSERR << "read socket error";
+        errno = ret;
+        LOG_SYSERR_EVERY_MS(1000) << "read socket error";
         handleClose();
-        return;
-    }
-    extendLife();
-    if (n > 0)
-    {
-        bytesReceived_ += n;
-        if (tlsProviderPtr_)
-        {
-            tlsProviderPtr_->recvData(&readBuffer_);
-        }
-        else if (recvMsgCallback_)
-        {
-            recvMsgCallback_(shared_from_this(), &readBuffer_);
-        }
     }
 }
+bool TcpConnectionImpl::enableRecvRingBuffer(size_t capacity)
+{
+    loop_->assertInLoopThread();
+    if (!readBuffer_.enableRingBuffer(capacity))
+        return false;
+    // The decrypted data is delivered from the buffer of the TLS provider
+    if (tlsProviderPtr_)
+        tlsProviderPtr_->getRecvBuffer().enableRingBuffer(capacity);
+    return true;
+}
 void TcpConnectionImpl::extendLife()
 {
     if (idleTimeout_ > 0)
@@ -252,7 +327,7 @@ void TcpConnectionImpl::writeCallback()
     }
     else
     {
-        LOG_SYSERR << "no writing but write callback called";
+        LOG_SYSERR_EVERY_MS(1000) << "no writing but write callback called";
     }
 }
 void TcpConnectionImpl::connectEstablished()
@@ -309,8 +384,8 @@ void TcpConnectionImpl::handleError()
     }
     else
     {
-        LOG_ERROR << "[" << name_ << "] - SO_ERROR = " << err << " "
-                  << strerror_tl(err);
+        LOG_ERROR_EVERY_MS(1000) << "[" << name_ << "] - SO_ERROR = " << err
+                                 << " " << strerror_tl(err);
     }
 }
 void TcpConnectionImpl::setTcpNoDelay(bool on)
@@ -337,6 +412,7 @@ void TcpConnectionImpl::shutdown()
         {
             if (thisPtr->tlsProviderPtr_)
             {
+                thisPtr->flushTLSSendBuffer();
                 // there's still data to be sent, so we can't close the
                 // connection just yet
                 if (thisPtr->tlsProviderPtr_->getBufferedData()
@@ -378,6 +454,9 @@ void TcpConnectionImpl::forceClose()
         }
     });
 }
+// Data coalesced for TLS connections is flushed right away once it reaches
+// this size
+static constexpr size_t kMaxCoalescedTLSBytes = 64 * 1024;
 #ifndef _WIN32
 void TcpConnectionImpl::sendInLoop(const void *buffer, size_t length)
 #else
@@ -385,6 +464,50 @@ void TcpConnectionImpl::sendInLoop(const char *buffer, size_t length)
 #endif
 {
     loop_->assertInLoopThread();
+    if (status_ != ConnStatus::Connected)
+    {
+        LOG_DEBUG << "Connection is not connected,give up sending";
+        return;
+    }
+    if (!coalesceTLSSends_)
+    {
+        writeOrBufferInLoop(static_cast<const char *>(buffer), length);
+        return;
+    }
+    tlsSendBuffer_.append(static_cast<const char *>(buffer), length);
+    if (tlsSendBuffer_.readableBytes() >= kMaxCoalescedTLSBytes)
+    {
+        flushTLSSendBuffer();
+    }
+    else if (!tlsFlushQueued_)
+    {
+        tlsFlushQueued_ = true;
+        loop_->queueInLoop([thisPtr = shared_from_this()]() {
+            thisPtr->tlsFlushQueued_ = false;
+            thisPtr->flushTLSSendBuffer();
+        });
+    }
+}
+
+void TcpConnectionImpl::flushTLSSendBuffer()
+{
+    if (tlsSendBuffer_.readableBytes() == 0)
+        return;
+    // Callbacks invoked while sending may call send() again, which appends to
+    // tlsSendBuffer_
+    MsgBuffer buffer(0);
+    buffer.swap(tlsSendBuffer_);
+    writeOrBufferInLoop(buffer.peek(), buffer.readableBytes());
+    if (tlsSendBuffer_.readableBytes() == 0)
+    {
+        // keep the storage for the next iteration
+        buffer.retrieveAll();
+        buffer.swap(tlsSendBuffer_);
+    }
+}
+
+void TcpConnectionImpl::writeOrBufferInLoop(const char *buffer, size_t length)
+{
     if (status_ != ConnStatus::Connected)
     {
         LOG_DEBUG << "Connection is not connected,give up sending";
@@ -409,9 +532,7 @@ void TcpConnectionImpl::sendInLoop(const char *buffer, size_t length)
         {
             writeBufferList_.push_back(BufferNode::newMemBufferNode());
         }
-        writeBufferList_.back()->append(static_cast<const char *>(buffer) +
-                                            sendLen,
-                                        length);
+        writeBufferList_.back()->append(buffer + sendLen, length);
         if (highWaterMarkCallback_ &&
             writeBufferList_.back()->remainingBytes() >
                 static_cast<long long>(highWaterMarkLen_))
@@ -548,6 +669,149 @@ void TcpConnectionImpl::send(MsgBuffer &&buffer)
             });
     }
 }
+void TcpConnectionImpl::send(SegmentedBuffer &&buffer)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendSegmentsInLoop(buffer);
+    }
+    else
+    {
+        auto bufferPtr = std::make_shared<SegmentedBuffer>(std::move(buffer));
+        loop_->queueInLoop(
+            [thisPtr = shared_from_this(), bufferPtr = std::move(bufferPtr)]() {
+                thisPtr->sendSegmentsInLoop(*bufferPtr);
+            });
+    }
+}
+
+void TcpConnectionImpl::sendSegmentsInLoop(SegmentedBuffer &buffer)
+{
+    loop_->assertInLoopThread();
+    if (status_ != ConnStatus::Connected)
+    {
+        LOG_DEBUG << "Connection is not connected,give up sending";
+        return;
+    }
+    if (tlsProviderPtr_)
+    {
+        // Every block has to be encrypted anyway, send them one by one so
+        // they go through the coalescing of sendInLoop()
+        const char *data;
+        size_t len;
+        while ((data = buffer.peek(len)) != nullptr)
+        {
+            sendInLoop(data, len);
+            buffer.retrieve(len);
+        }
+        return;
+    }
+    if (!ioChannelPtr_->isWriting() && writeBufferList_.empty())
+    {
+        // send directly
+#ifndef _WIN32
+        constexpr size_t kMaxIovecs = 64;
+        struct iovec vec[kMaxIovecs];
+        while (!buffer.empty())
+        {
+            auto count = buffer.peekSegments(vec, kMaxIovecs);
+            size_t toSend = 0;
+            for (size_t i = 0; i < count; ++i)
+                toSend += vec[i].iov_len;
+            auto sendLen = writevRaw(vec, static_cast<int>(count));
+            if (sendLen < 0)
+            {
+                LOG_TRACE << "write error";
+                return;
+            }
+            buffer.retrieve(sendLen);
+            if (static_cast<size_t>(sendLen) < toSend)
+                break;
+        }
+#else
+        const char *data;
+        size_t len;
+        while ((data = buffer.peek(len)) != nullptr)
+        {
+            auto sendLen = writeRaw(data, len);
+            if (sendLen < 0)
+            {
+                LOG_TRACE << "write error";
+                return;
+            }
+            buffer.retrieve(sendLen);
+            if (static_cast<size_t>(sendLen) < len)
+                break;
+        }
+#endif
+    }
+    if (!buffer.empty() && status_ == ConnStatus::Connected)
+    {
+        writeBufferList_.push_back(
+            BufferNode::newSegmentedBufferNode(std::move(buffer)));
+        if (highWaterMarkCallback_ &&
+            writeBufferList_.back()->remainingBytes() >
+                static_cast<long long>(highWaterMarkLen_))
+        {
+            highWaterMarkCallback_(shared_from_this(),
+                                   writeBufferList_.back()->remainingBytes());
+        }
+    }
+}
+
+void TcpConnectionImpl::send(const BufferSlice &slice)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendSliceInLoop(slice);
+    }
+    else
+    {
+        loop_->queueInLoop([thisPtr = shared_from_this(), slice]() {
+            thisPtr->sendSliceInLoop(slice);
+        });
+    }
+}
+
+void TcpConnectionImpl::sendSliceInLoop(const BufferSlice &slice)
+{
+    loop_->assertInLoopThread();
+    if (status_ != ConnStatus::Connected)
+    {
+        LOG_DEBUG << "Connection is not connected,give up sending";
+        return;
+    }
+    if (tlsProviderPtr_)
+    {
+        sendInLoop(slice.data(), slice.size());
+        return;
+    }
+    size_t sendLen = 0;
+    if (!ioChannelPtr_->isWriting() && writeBufferList_.empty())
+    {
+        // send directly
+        auto n = writeRaw(slice.data(), slice.size());
+        if (n < 0)
+        {
+            LOG_TRACE << "write error";
+            return;
+        }
+        sendLen = static_cast<size_t>(n);
+    }
+    if (sendLen < slice.size() && status_ == ConnStatus::Connected)
+    {
+        writeBufferList_.push_back(
+            BufferNode::newSliceBufferNode(slice.subSlice(sendLen)));
+        if (highWaterMarkCallback_ &&
+            writeBufferList_.back()->remainingBytes() >
+                static_cast<long long>(highWaterMarkLen_))
+        {
+            highWaterMarkCallback_(shared_from_this(),
+                                   writeBufferList_.back()->remainingBytes());
+        }
+    }
+}
+
 void TcpConnectionImpl::sendFile(const char *fileName,
                                  long long offset,
                                  long long length)
@@ -591,6 +855,7 @@ void TcpConnectionImpl::sendFile(BufferNodePtr &&fileNode)
     assert(fileNode->isFile() && fileNode->remainingBytes() > 0);
     if (loop_->isInLoopThread())
     {
+        flushTLSSendBuffer();
         if (writeBufferList_.empty())
         {
             auto n = sendNodeInLoop(fileNode);
@@ -607,6 +872,7 @@ void TcpConnectionImpl::sendFile(BufferNodePtr &&fileNode)
     {
         loop_->queueInLoop([thisPtr = shared_from_this(),
                             node = std::move(fileNode)]() mutable {
+            thisPtr->flushTLSSendBuffer();
             if (thisPtr->writeBufferList_.empty())
             {
                 auto n = thisPtr->sendNodeInLoop(node);
@@ -627,6 +893,7 @@ void TcpConnectionImpl::sendStream(
     auto node = BufferNode::newStreamBufferNode(std::move(callback));
     if (loop_->isInLoopThread())
     {
+        flushTLSSendBuffer();
         if (writeBufferList_.empty())
         {
             auto n = sendNodeInLoop(node);
@@ -644,6 +911,7 @@ void TcpConnectionImpl::sendStream(
         loop_->queueInLoop(
             [thisPtr = shared_from_this(), node = std::move(node)]() mutable {
                 LOG_TRACE << "Push send stream to list";
+                thisPtr->flushTLSSendBuffer();
                 if (thisPtr->writeBufferList_.empty())
                 {
                     auto n = thisPtr->sendNodeInLoop(node);
@@ -762,6 +1030,30 @@ ssize_t TcpConnectionImpl::writeRaw(const char *buffer, size_t length)
 }
 
 #ifndef _WIN32
+ssize_t TcpConnectionImpl::writevRaw(const struct iovec *vec, int count)
+{
+    size_t length = 0;
+    for (int i = 0; i < count; ++i)
+        length += vec[i].iov_len;
+    ssize_t nWritten = ::writev(socketPtr_->fd(), vec, count);
+    if (nWritten > 0)
+        bytesSent_ += nWritten;
+    else if (!isEAGAIN())
+        return nWritten;
+    if (nWritten < 0)
+    {
+        nWritten = 0;
+    }
+    if (static_cast<size_t>(nWritten) < length)
+    {
+        LOG_TRACE << "nWritten = " << nWritten << " length = " << length;
+        if (!ioChannelPtr_->isWriting())
+            ioChannelPtr_->enableWriting();
+    }
+    extendLife();
+    return nWritten;
+}
+
 ssize_t TcpConnectionImpl::writeInLoop(const void *buffer, size_t length)
 #else
 ssize_t TcpConnectionImpl::writeInLoop(const char *buffer, size_t length)
@@ -802,7 +1094,7 @@ void TcpConnectionImpl::startEncryption(
         LOG_ERROR << "TLS is already started";
         return;
     }
-    auto sslContextPtr = newSSLContext(*policy, isServer);
+    auto sslContextPtr = getSharedSSLContext(*policy, isServer);
     tlsProviderPtr_ =
         newTLSProvider(this, std::move(policy), std::move(sslContextPtr));
     tlsProviderPtr_->setWriteCallback(onSslWrite);
@@ -811,6 +1103,7 @@ void TcpConnectionImpl::startEncryption(
     tlsProviderPtr_->setMessageCallback(onSslMessage);
     // This is triggered when peer sends a close alert
     tlsProviderPtr_->setCloseCallback(onSslCloseAlert);
+    coalesceTLSSends_ = tlsProviderPtr_->policy()->getCoalesceSends();
     tlsProviderPtr_->startEncryption();
     upgradeCallback_ = std::move(upgradeCallback);
 }
@@ -834,7 +1127,15 @@ void TcpConnectionImpl::onHandshakeFinished(TcpConnection *self)
 }
 void TcpConnectionImpl::onSslMessage(TcpConnection *self, MsgBuffer *buffer)
 {
-    if (self->recvMsgCallback_)
+    if (self->recvSegmentedMsgCallback_)
+    {
+        auto connPtr = (TcpConnectionImpl *)self;
+        connPtr->readChain_.append(*buffer);
+        buffer->retrieveAll();
+        self->recvSegmentedMsgCallback_(connPtr->shared_from_this(),
+                                        &connPtr->readChain_);
+    }
+    else if (self->recvMsgCallback_)
         self->recvMsgCallback_(((TcpConnectionImpl *)self)->shared_from_this(),
                                buffer);
 }
@@ -935,6 +1236,7 @@ AsyncStreamPtr TcpConnectionImpl::sendAsyncStream(bool disableKickoff)
             idleTimeout_ = 0;
         }
 
+        flushTLSSendBuffer();
         writeBufferList_.push_back(asyncStreamNode);
     }
     else
@@ -955,6 +1257,7 @@ AsyncStreamPtr TcpConnectionImpl::sendAsyncStream(bool disableKickoff)
                 idleTimeout_ = 0;
             }
 
+            thisPtr->flushTLSSendBuffer();
             if (thisPtr->writeBufferList_.empty() && node->remainingBytes() > 0)
             {
                 auto n = thisPtr->sendNodeInLoop(node);
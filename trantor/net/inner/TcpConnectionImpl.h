@@ -76,6 +76,8 @@ class TcpConnectionImpl : public TcpConnection,
     void send(std::string &&msg) override;
     void send(const MsgBuffer &buffer) override;
     void send(MsgBuffer &&buffer) override;
+    void send(SegmentedBuffer &&buffer) override;
+    void send(const BufferSlice &slice) override;
     void send(const std::shared_ptr<std::string> &msgPtr) override;
     void send(const std::shared_ptr<MsgBuffer> &msgPtr) override;
     void sendFile(const char *fileName,
@@ -152,6 +154,7 @@ class TcpConnectionImpl : public TcpConnection,
     {
         return tlsProviderPtr_ != nullptr;
     }
+    bool enableRecvRingBuffer(size_t capacity) override;
     void connectEstablished() override;
     void connectDestroyed() override;
 
@@ -232,7 +235,12 @@ class TcpConnectionImpl : public TcpConnection,
     std::unique_ptr<Channel> ioChannelPtr_;
     std::unique_ptr<Socket> socketPtr_;
     MsgBuffer readBuffer_;
-    std::list<BufferNodePtr> writeBufferList_;
+    // Used instead of readBuffer_ when recvSegmentedMsgCallback_ is set
+    SegmentedBuffer readChain_;
+    // Number of bytes expected by the next read, see readCallback()
+    size_t readSize_{8 * 1024};
+    unsigned int smallReads_{0};
+    BufferNodeQueue writeBufferList_;
     void readCallback();
     void writeCallback();
     InetAddress localAddr_, peerAddr_;
@@ -245,6 +253,15 @@ class TcpConnectionImpl : public TcpConnection,
                              size_t len);
     // -1: error, 0: EAGAIN, >0: bytes sent
     ssize_t sendNodeInLoop(const BufferNodePtr &node);
+    void writeOrBufferInLoop(const char *buffer, size_t length);
+    // Encrypts and sends the data coalesced from send() calls (TLS only)
+    void flushTLSSendBuffer();
+    void sendSegmentsInLoop(SegmentedBuffer &buffer);
+    void sendSliceInLoop(const BufferSlice &slice);
+#ifndef _WIN32
+    // -1: error, 0: EAGAIN, >0: bytes sent
+    ssize_t writevRaw(const struct iovec *vec, int count);
+#endif
 #ifndef _WIN32
     void sendInLoop(const void *buffer, size_t length);
     ssize_t writeRaw(const void *buffer, size_t length);
@@ -268,6 +285,12 @@ class TcpConnectionImpl : public TcpConnection,
 
     bool closeOnEmpty_{false};
 
+    // Plaintext of send() calls to be encrypted at the end of the current
+    // loop iteration, see TLSPolicy::setCoalesceSends()
+    MsgBuffer tlsSendBuffer_{0};
+    bool coalesceTLSSends_{false};
+    bool tlsFlushQueued_{false};
+
     static void onSslError(TcpConnection *self, SSLError err);
     static void onHandshakeFinished(TcpConnection *self);
     static void onSslMessage(TcpConnection *self, MsgBuffer *buffer);
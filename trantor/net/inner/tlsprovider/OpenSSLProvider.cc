@@ -8,6 +8,7 @@
 #include <openssl/bio.h>
 #include <openssl/x509v3.h>
 
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <list>
@@ -222,6 +223,8 @@ struct SSLContext
     }
 
     bool isServer{false};
+    // Owned by the context, since the ALPN callback may outlive the policy
+    std::vector<std::string> alpnProtocols;
 };
 
 struct OpenSSLCertificate : public Certificate
@@ -421,6 +424,19 @@ class SessionManager
 
 static SessionManager sessionManager;
 
+// Limit the size of the data we encrypt in one go to avoid holding massive
+// buffers in memory. OpenSSL splits it into full sized (16KB) records.
+static constexpr size_t kMaxSendSize = 64 * 1024;
+// 1369 bytes of payload plus the TLS record overhead fits into a single TCP
+// segment on common (IPv4 and IPv6) paths with TCP timestamps enabled.
+static constexpr size_t kSmallRecordSize = 1369;
+static constexpr size_t kSmallRecordThreshold = 40;
+static constexpr std::chrono::seconds kRecordSizeIdleTimeout{1};
+// The plaintext buffer is shrunk when it is this many times larger than the
+// data decrypted in one go (and than the threshold).
+static constexpr size_t kRecvBufferShrinkFactor = 8;
+static constexpr size_t kRecvBufferShrinkThreshold = 64 * 1024;
+
 struct OpenSSLProvider : public TLSProvider, public NonCopyable
 {
     OpenSSLProvider(TcpConnection *conn, TLSPolicyPtr policy, SSLContextPtr ctx)
@@ -536,20 +552,29 @@ struct OpenSSLProvider : public TLSProvider, public NonCopyable
             errno = EAGAIN;
             return 0;
         }
-        // Limit the size of the data we send in one go to avoid holding massive
-        // buffers in memory.
-        constexpr size_t maxSend = 64 * 1024;
+        updateRecordSize();
         size_t hasSent = 0;
         while (hasSent < len && getBufferedData().readableBytes() == 0)
         {
             auto trunkLen = len - hasSent;
-            if (trunkLen > maxSend)
-                trunkLen = maxSend;
-            int n = SSL_write(ssl_, data + hasSent, (int)trunkLen);
-            if (n <= 0 && len != 0)
+            if (trunkLen > kMaxSendSize)
+                trunkLen = kMaxSendSize;
+            // Every SSL_write() call ends up in at least one record. The
+            // records pile up in wbio_ and are flushed by a single write.
+            size_t encrypted = 0;
+            while (encrypted < trunkLen)
             {
-                handleSSLError(SSLError::kSSLProtocolError);
-                return -1;
+                auto recordLen = (std::min)(trunkLen - encrypted, recordSize_);
+                int n = SSL_write(ssl_,
+                                  data + hasSent + encrypted,
+                                  (int)recordLen);
+                if (n <= 0)
+                {
+                    handleSSLError(SSLError::kSSLProtocolError);
+                    return -1;
+                }
+                encrypted += recordLen;
+                onRecordWritten();
             }
             auto num = sendTLSData();
             if (num == -1)
@@ -559,6 +584,37 @@ struct OpenSSLProvider : public TLSProvider, public NonCopyable
         return static_cast<ssize_t>(hasSent);
     }
 
+    /**
+     * Dynamic record sizing: start with records that fit in one TCP segment
+     * so the peer can decrypt data as soon as the first packet arrives, then
+     * switch to full sized records once the connection is warmed up. Go back
+     * to small records after the connection has been idle for a while, since
+     * the congestion window is likely reset by then.
+     */
+    void updateRecordSize()
+    {
+        if (!policyPtr_->getDynamicRecordSizing())
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastSendTime_ > kRecordSizeIdleTimeout)
+        {
+            recordSize_ = kSmallRecordSize;
+            smallRecordsSent_ = 0;
+        }
+        lastSendTime_ = now;
+    }
+
+    void onRecordWritten()
+    {
+        if (recordSize_ != kSmallRecordSize)
+            return;
+        if (++smallRecordsSent_ >= kSmallRecordThreshold)
+        {
+            LOG_TRACE << "Switching to full sized TLS records";
+            recordSize_ = kMaxSendSize;
+        }
+    }
+
     bool processHandshake()
     {
         int ret = SSL_do_handshake(ssl_);
@@ -680,10 +736,18 @@ struct OpenSSLProvider : public TLSProvider, public NonCopyable
         return false;
     }
 
+    /**
+     * Decrypt every complete record received so far into recvBuffer_ and
+     * hand the plaintext to the message callback at once, rather than once
+     * per record.
+     */
     void processApplicationData()
     {
         constexpr size_t maxSingleRead = 128 * 1024;
         constexpr size_t maxWritibleBytes = (std::numeric_limits<int>::max)();
+        size_t decrypted = 0;
+        bool closed = false;
+        bool failed = false;
         while (true)
         {
             auto pending = BIO_pending(rbio_);
@@ -699,33 +763,48 @@ struct OpenSSLProvider : public TLSProvider, public NonCopyable
             if (n == 0 && (shutdownState & SSL_RECEIVED_SHUTDOWN))
             {
                 LOG_TRACE << "SSL connection closed by peer";
-                conn_->shutdown();
-                return;
+                closed = true;
+                break;
             }
             else if (n > 0)
             {
                 recvBuffer_.hasWritten(n);
-                LOG_TRACE << "Received " << n << " bytes from SSL";
-                if (messageCallback_)
-                    messageCallback_(conn_, &recvBuffer_);
+                decrypted += n;
             }
-            else if (n <= 0)
+            else
             {
                 int err = SSL_get_error(ssl_, n);
                 if (err == SSL_ERROR_ZERO_RETURN)
                 {
                     // Clean shutdown
                     LOG_TRACE << "SSL connection closed cleanly";
-                    conn_->shutdown();
-                    return;
+                    closed = true;
                 }
-                if (err == SSL_ERROR_SSL || err == SSL_ERROR_SYSCALL)
+                else if (err == SSL_ERROR_SSL || err == SSL_ERROR_SYSCALL)
                 {
-                    handleSSLError(SSLError::kSSLProtocolError);
+                    failed = true;
                 }
-                return;
+                break;
             }
         }
+
+        if (decrypted > 0)
+        {
+            LOG_TRACE << "Received " << decrypted << " bytes from SSL";
+            if (messageCallback_)
+                messageCallback_(conn_, &recvBuffer_);
+            // Give the memory back once a burst is over. Steady bulk transfers
+            // decrypt about as much as the buffer holds and keep it.
+            if (recvBuffer_.capacity() >
+                kRecvBufferShrinkFactor *
+                    (std::max)(decrypted, kRecvBufferShrinkThreshold))
+                recvBuffer_.shrinkToFit();
+        }
+
+        if (closed)
+            conn_->shutdown();
+        else if (failed)
+            handleSSLError(SSLError::kSSLProtocolError);
     }
 
     ssize_t sendTLSData()
@@ -765,6 +844,9 @@ struct OpenSSLProvider : public TLSProvider, public NonCopyable
     BIO *wbio_;
     bool processedHandshakeError_{false};
     bool processedSslError_{false};
+    size_t recordSize_{kMaxSendSize};
+    size_t smallRecordsSent_{0};
+    std::chrono::steady_clock::time_point lastSendTime_;
 };
 
 std::shared_ptr<TLSProvider> trantor::newTLSProvider(TcpConnection *conn,
@@ -851,9 +933,10 @@ SSLContextPtr trantor::newSSLContext(const TLSPolicy &policy, bool isServer)
 
     if (!policy.getAlpnProtocols().empty() && isServer)
     {
+        ctx->alpnProtocols = policy.getAlpnProtocols();
         SSL_CTX_set_alpn_select_cb(ctx->ctx(),
                                    internal::serverSelectProtocol,
-                                   (void *)&policy.getAlpnProtocols());
+                                   (void *)&ctx->alpnProtocols);
     }
 
     if (!isServer)
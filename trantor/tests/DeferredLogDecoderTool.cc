@@ -0,0 +1,77 @@
+/**
+ * Decodes the binary output of DeferredLogger::startBinary() into text.
+ *
+ * The files are decoded in the given order as one log, the first one must
+ * start at the beginning of the output. Without a file, the log is read from
+ * the standard input.
+ *
+ * usage: deferred_log_decoder [--local-time] [FILE...]
+ */
+#include <trantor/utils/DeferredLogger.h>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace trantor;
+
+static void decodeFile(DeferredLogDecoder &decoder,
+                       FILE *file,
+                       std::string &pending)
+{
+    auto output = [](const char *msg, const uint64_t len) {
+        fwrite(msg, 1, static_cast<size_t>(len), stdout);
+    };
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        pending.append(buf, n);
+        auto decoded =
+            decoder.decode(pending.data(), pending.length(), output);
+        pending.erase(0, decoded);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--local-time") == 0)
+            Logger::setDisplayLocalTime(true);
+        else
+            files.push_back(argv[i]);
+    }
+
+    DeferredLogDecoder decoder;
+    std::string pending;
+    try
+    {
+        if (files.empty())
+            decodeFile(decoder, stdin, pending);
+        for (auto name : files)
+        {
+            FILE *file = fopen(name, "rb");
+            if (!file)
+            {
+                fprintf(stderr, "Can not open %s\n", name);
+                return 1;
+            }
+            decodeFile(decoder, file, pending);
+            fclose(file);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (!pending.empty())
+    {
+        fprintf(stderr, "The log ends with an incomplete entry\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * Number formatting benchmark of LogStream.
+ *
+ * Compares the integer and floating point formatting of LogStream with the
+ * previous implementation, a digit-by-digit conversion and snprintf("%.12g"),
+ * which is kept here as the baseline.
+ *
+ * usage: log_stream_benchmark [--iterations N]
+ */
+#include <trantor/utils/LogStream.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace trantor;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+const char digits[] = "9876543210123456789";
+const char *zero = digits + 9;
+
+template <typename T>
+size_t legacyConvert(char buf[], T value)
+{
+    T i = value;
+    char *p = buf;
+
+    do
+    {
+        int lsd = static_cast<int>(i % 10);
+        i /= 10;
+        *p++ = zero[lsd];
+    } while (i != 0);
+
+    if (value < 0)
+    {
+        *p++ = '-';
+    }
+    *p = '\0';
+    std::reverse(buf, p);
+
+    return p - buf;
+}
+
+size_t legacyConvertDouble(char buf[], double value)
+{
+    return snprintf(buf, 32, "%.12g", value);
+}
+
+// Appends the values to a buffer the way LogStream does, resetting it when
+// it is full
+class LegacyStream
+{
+  public:
+    LegacyStream &operator<<(int64_t v)
+    {
+        reserve();
+        length_ += legacyConvert(buffer_ + length_, v);
+        return *this;
+    }
+    LegacyStream &operator<<(double v)
+    {
+        reserve();
+        length_ += legacyConvertDouble(buffer_ + length_, v);
+        return *this;
+    }
+    LegacyStream &operator<<(char c)
+    {
+        reserve();
+        buffer_[length_++] = c;
+        return *this;
+    }
+    size_t length() const
+    {
+        return length_;
+    }
+
+  private:
+    void reserve()
+    {
+        if (sizeof(buffer_) - length_ < 32)
+            length_ = 0;
+    }
+    char buffer_[4000];
+    size_t length_{0};
+};
+
+class NewStream
+{
+  public:
+    template <typename T>
+    NewStream &operator<<(const T &v)
+    {
+        if (stream_.bufferLength() > 4000 - 32)
+            stream_.resetBuffer();
+        stream_ << v;
+        return *this;
+    }
+    size_t length() const
+    {
+        return stream_.bufferLength();
+    }
+
+  private:
+    LogStream stream_;
+};
+
+template <typename Stream, typename T>
+double run(const std::vector<T> &values, size_t iterations, size_t &sink)
+{
+    Stream stream;
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        stream << values[i % values.size()] << ' ';
+        sink += stream.length();
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+template <typename T>
+void compare(const char *name,
+             const std::vector<T> &values,
+             size_t iterations)
+{
+    size_t sink = 0;
+    double legacy = run<LegacyStream>(values, iterations, sink);
+    double current = run<NewStream>(values, iterations, sink);
+    printf("%-16s legacy %7.1f ns  new %7.1f ns  speedup %5.2fx  (%zu)\n",
+           name,
+           legacy,
+           current,
+           legacy / current,
+           sink % 10);
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = 5000000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = strtoull(argv[++i], nullptr, 10);
+    }
+
+    std::mt19937_64 rng(42);
+    const size_t kValues = 4096;
+    std::vector<int64_t> small, large;
+    std::vector<double> latencies, ratios, wide;
+    for (size_t i = 0; i < kValues; ++i)
+    {
+        small.push_back(static_cast<int64_t>(rng() % 10000));
+        large.push_back(static_cast<int64_t>(rng()));
+        // Values as typically found in metrics, with a few decimals
+        latencies.push_back(static_cast<double>(rng() % 1000000) / 1000);
+        ratios.push_back(std::uniform_real_distribution<double>(0, 1)(rng));
+        wide.push_back(std::exp(
+            std::uniform_real_distribution<double>(-300, 300)(rng)));
+    }
+
+    compare("int 0-9999", small, iterations);
+    compare("int64 random", large, iterations);
+    compare("double 3 dec.", latencies, iterations);
+    compare("double [0, 1)", ratios, iterations);
+    compare("double wide", wide, iterations);
+    return 0;
+}
@@ -0,0 +1,436 @@
+/**
+ * TLS benchmark over loopback.
+ *
+ * Measures full and resumed handshakes, bulk throughput of send() and
+ * sendFile() and small message round-trip latency with the TLS provider
+ * trantor was built with (build trantor once per provider to compare them).
+ * Results are written as JSON to stdout or to the file given by --output.
+ *
+ * usage: tls_benchmark [--cert server.crt] [--key server.key]
+ *                      [--handshakes N] [--bytes N] [--rounds N]
+ *                      [--port N] [--output FILE]
+ */
+#include <trantor/net/TcpServer.h>
+#include <trantor/net/TcpClient.h>
+#include <trantor/net/EventLoopThread.h>
+#include <trantor/utils/Logger.h>
+#include <trantor/utils/Utilities.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace trantor;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+struct Options
+{
+    std::string certPath{"server.crt"};
+    std::string keyPath{"server.key"};
+    std::string output;
+    size_t handshakes{500};
+    size_t bytes{256 * 1024 * 1024};
+    size_t rounds{10000};
+    uint16_t port{8899};
+};
+
+// Wall clock and process CPU time of a benchmark phase. The CPU time covers
+// both the client and the server, which run in the same process.
+class Stopwatch
+{
+  public:
+    Stopwatch() : wall_(Clock::now()), cpu_(std::clock())
+    {
+    }
+    double wallSeconds() const
+    {
+        return std::chrono::duration<double>(Clock::now() - wall_).count();
+    }
+    double cpuSeconds() const
+    {
+        return double(std::clock() - cpu_) / CLOCKS_PER_SEC;
+    }
+
+  private:
+    Clock::time_point wall_;
+    std::clock_t cpu_;
+};
+
+// The first byte sent by the client selects what the server does with the
+// connection.
+enum Command : char
+{
+    kSendData = 'S',
+    kSendFile = 'F',
+    kEcho = 'E'
+};
+
+struct ServerState
+{
+    char command{0};
+};
+
+class BenchmarkServer
+{
+  public:
+    BenchmarkServer(EventLoop *loop,
+                    const Options &options,
+                    const std::string &filePath)
+        : server_(loop, InetAddress("127.0.0.1", options.port), "benchmark"),
+          bytes_(options.bytes),
+          filePath_(filePath),
+          chunk_(64 * 1024, 'x')
+    {
+        server_.enableSSL(
+            TLSPolicy::defaultServerPolicy(options.certPath, options.keyPath));
+        server_.setConnectionCallback([](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->setTcpNoDelay(true);
+                conn->setContext(std::make_shared<ServerState>());
+            }
+        });
+        server_.setRecvMessageCallback(
+            [this](const TcpConnectionPtr &conn, MsgBuffer *buffer) {
+                onMessage(conn, buffer);
+            });
+        server_.start();
+    }
+    ~BenchmarkServer()
+    {
+        server_.stop();
+    }
+
+  private:
+    void onMessage(const TcpConnectionPtr &conn, MsgBuffer *buffer)
+    {
+        auto state = conn->getContext<ServerState>();
+        if (state->command == 0)
+        {
+            state->command = buffer->peek()[0];
+            buffer->retrieve(1);
+            if (state->command == kSendData)
+            {
+                for (size_t sent = 0; sent < bytes_; sent += chunk_.size())
+                    conn->send(chunk_.data(),
+                               (std::min)(chunk_.size(), bytes_ - sent));
+            }
+            else if (state->command == kSendFile)
+            {
+                conn->sendFile(filePath_.c_str());
+            }
+        }
+        if (state->command == kEcho && buffer->readableBytes() > 0)
+            conn->send(buffer->peek(), buffer->readableBytes());
+        buffer->retrieveAll();
+    }
+
+    TcpServer server_;
+    size_t bytes_;
+    std::string filePath_;
+    std::string chunk_;
+};
+
+class BenchmarkClient
+{
+  public:
+    BenchmarkClient(EventLoop *loop, const Options &options)
+        : loop_(loop), serverAddr_("127.0.0.1", options.port)
+    {
+    }
+
+    // Connects `count` times one after another. Every connection uses a new
+    // hostname unless resumption is wanted, so no session can be reused.
+    void handshakes(size_t count, bool resume, std::function<void()> done)
+    {
+        if (count == 0)
+        {
+            loop_->queueInLoop([this, done = std::move(done)]() {
+                retiredClients_.clear();
+                done();
+            });
+            return;
+        }
+        auto hostname = resume ? std::string("resumed.bench")
+                               : "full" + std::to_string(count) + ".bench";
+        connect(hostname,
+                [this, count, resume, done = std::move(done)](
+                    const TcpConnectionPtr &conn) mutable {
+                    conn->shutdown();
+                    loop_->queueInLoop(
+                        [this, count, resume, done = std::move(done)]() {
+                            handshakes(count - 1, resume, std::move(done));
+                        });
+                });
+    }
+
+    // Asks the server to send data and counts the bytes until `bytes` arrived
+    void download(char command,
+                  size_t bytes,
+                  std::function<void()> connected,
+                  std::function<void()> done)
+    {
+        received_ = 0;
+        messageHandler_ = [this, bytes, done = std::move(done)](
+                              const TcpConnectionPtr &conn,
+                              MsgBuffer *buffer) {
+            received_ += buffer->readableBytes();
+            buffer->retrieveAll();
+            if (received_ >= bytes)
+            {
+                conn->shutdown();
+                done();
+            }
+        };
+        connect("bulk.bench",
+                [command, connected = std::move(connected)](
+                    const TcpConnectionPtr &conn) {
+                    connected();
+                    conn->send(&command, 1);
+                });
+    }
+
+    // Sends `rounds` small messages one at a time and waits for each echo
+    void pingPong(size_t rounds,
+                  size_t messageSize,
+                  std::vector<double> &latencies,
+                  std::function<void()> done)
+    {
+        auto message = std::make_shared<std::string>(messageSize, 'p');
+        messageHandler_ = [this, rounds, message, &latencies, done](
+                              const TcpConnectionPtr &conn,
+                              MsgBuffer *buffer) {
+            if (buffer->readableBytes() < message->size())
+                return;
+            buffer->retrieve(message->size());
+            latencies.push_back(std::chrono::duration<double, std::micro>(
+                                    Clock::now() - pingTime_)
+                                    .count());
+            if (latencies.size() == rounds)
+            {
+                conn->shutdown();
+                done();
+                return;
+            }
+            pingTime_ = Clock::now();
+            conn->send(*message);
+        };
+        connect("echo.bench", [this, message](const TcpConnectionPtr &conn) {
+            char command = kEcho;
+            conn->send(&command, 1);
+            pingTime_ = Clock::now();
+            conn->send(*message);
+        });
+    }
+
+  private:
+    void connect(const std::string &hostname,
+                 std::function<void(const TcpConnectionPtr &)> onConnected)
+    {
+        // Clients must not be destroyed in their own callbacks
+        if (client_)
+            retiredClients_.push_back(std::move(client_));
+        client_ =
+            std::make_shared<TcpClient>(loop_, serverAddr_, "benchmark");
+        auto policy = TLSPolicy::defaultClientPolicy(hostname);
+        policy->setValidate(false);
+        client_->enableSSL(std::move(policy));
+        client_->setConnectionCallback(
+            [onConnected = std::move(onConnected)](
+                const TcpConnectionPtr &conn) {
+                if (conn->connected())
+                {
+                    conn->setTcpNoDelay(true);
+                    onConnected(conn);
+                }
+            });
+        client_->setMessageCallback(
+            [this](const TcpConnectionPtr &conn, MsgBuffer *buffer) {
+                if (messageHandler_)
+                    messageHandler_(conn, buffer);
+                else
+                    buffer->retrieveAll();
+            });
+        client_->setSSLErrorCallback([](SSLError err) {
+            LOG_ERROR << "TLS error " << static_cast<int>(err);
+            exit(1);
+        });
+        client_->connect();
+    }
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::shared_ptr<TcpClient> client_;
+    std::vector<std::shared_ptr<TcpClient>> retiredClients_;
+    std::function<void(const TcpConnectionPtr &, MsgBuffer *)> messageHandler_;
+    size_t received_{0};
+    Clock::time_point pingTime_;
+};
+
+// Runs `func` in the loop and blocks until it calls the done callback
+void runInLoopAndWait(EventLoop *loop,
+                      const std::function<void(std::function<void()>)> &func)
+{
+    std::promise<void> promise;
+    auto future = promise.get_future();
+    loop->runInLoop(
+        [&func, &promise]() { func([&promise]() { promise.set_value(); }); });
+    future.wait();
+}
+
+double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    auto index = static_cast<size_t>(p * double(values.size() - 1) + 0.5);
+    return values[index];
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        std::string value = argv[++i];
+        if (arg == "--cert")
+            options.certPath = value;
+        else if (arg == "--key")
+            options.keyPath = value;
+        else if (arg == "--output")
+            options.output = value;
+        else if (arg == "--handshakes")
+            options.handshakes = std::stoul(value);
+        else if (arg == "--bytes")
+            options.bytes = std::stoul(value);
+        else if (arg == "--rounds")
+            options.rounds = std::stoul(value);
+        else if (arg == "--port")
+            options.port = static_cast<uint16_t>(std::stoul(value));
+        else
+            return false;
+    }
+    return options.bytes > 0 && options.rounds > 0;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [--cert server.crt] [--key server.key] [--handshakes N]"
+                     " [--bytes N] [--rounds N] [--port N] [--output FILE]"
+                  << std::endl;
+        return 1;
+    }
+    if (utils::tlsBackend() == "None")
+    {
+        std::cerr << "trantor is built without TLS support" << std::endl;
+        return 1;
+    }
+    Logger::setLogLevel(Logger::kWarn);
+
+    // The file served by the sendFile() benchmark
+    std::string filePath = "tls_benchmark.dat";
+    {
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        std::string block(1024 * 1024, 'f');
+        for (size_t written = 0; written < options.bytes;
+             written += block.size())
+            file.write(block.data(),
+                       (std::min)(block.size(), options.bytes - written));
+    }
+
+    EventLoopThread serverThread("ServerLoop");
+    EventLoopThread clientThread("ClientLoop");
+    serverThread.run();
+    clientThread.run();
+    auto server = std::make_unique<BenchmarkServer>(serverThread.getLoop(),
+                                                    options,
+                                                    filePath);
+    BenchmarkClient client(clientThread.getLoop(), options);
+    auto clientLoop = clientThread.getLoop();
+
+    std::ostringstream json;
+    json << "{\n  \"provider\": \"" << utils::tlsBackend() << "\",\n";
+
+    for (bool resume : {false, true})
+    {
+        Stopwatch watch;
+        runInLoopAndWait(clientLoop, [&](std::function<void()> done) {
+            client.handshakes(options.handshakes, resume, std::move(done));
+        });
+        auto wall = watch.wallSeconds();
+        auto cpu = watch.cpuSeconds();
+        json << "  \"" << (resume ? "resumed" : "full") << "_handshakes\": {"
+             << "\"count\": " << options.handshakes
+             << ", \"seconds\": " << wall
+             << ", \"per_second\": " << options.handshakes / wall
+             << ", \"per_cpu_second\": "
+             << (cpu > 0 ? options.handshakes / cpu : 0) << "},\n";
+    }
+
+    for (auto command : {kSendData, kSendFile})
+    {
+        std::unique_ptr<Stopwatch> watch;
+        runInLoopAndWait(clientLoop, [&](std::function<void()> done) {
+            client.download(
+                command,
+                options.bytes,
+                [&watch]() { watch = std::make_unique<Stopwatch>(); },
+                std::move(done));
+        });
+        auto wall = watch->wallSeconds();
+        auto cpu = watch->cpuSeconds();
+        json << "  \"" << (command == kSendData ? "send" : "send_file")
+             << "_throughput\": {\"bytes\": " << options.bytes
+             << ", \"seconds\": " << wall
+             << ", \"mb_per_second\": " << options.bytes / wall / 1e6
+             << ", \"cpu_seconds\": " << cpu << "},\n";
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(options.rounds);
+    constexpr size_t messageSize = 64;
+    runInLoopAndWait(clientLoop, [&](std::function<void()> done) {
+        client.pingPong(options.rounds,
+                        messageSize,
+                        latencies,
+                        std::move(done));
+    });
+    double sum = 0;
+    for (auto latency : latencies)
+        sum += latency;
+    json << "  \"round_trip_latency_us\": {\"rounds\": " << options.rounds
+         << ", \"message_size\": " << messageSize
+         << ", \"mean\": " << sum / double(latencies.size())
+         << ", \"p50\": " << percentile(latencies, 0.5)
+         << ", \"p99\": " << percentile(latencies, 0.99)
+         << ", \"max\": " << percentile(latencies, 1.0) << "}\n}\n";
+
+    server.reset();
+    std::remove(filePath.c_str());
+
+    if (options.output.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream out(options.output);
+        out << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,582 @@
+#include <trantor/utils/AsyncFileLogger.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+using namespace trantor;
+
+static std::string readFile(const std::string &name)
+{
+    std::ifstream file(name);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+TEST(AsyncFileLogger, PerThreadBuffers)
+{
+    const std::string baseName = "per_thread_buffers_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    const int kThreads = 8;
+    const int kMessages = 10000;
+    const std::string large(300 * 1024, 'L');
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.setFileSizeLimit(1024 * 1024 * 1024);
+        logger.enablePerThreadBuffers();
+        logger.startLogging();
+
+        // Messages of different threads are written in the order of output
+        std::thread([&logger]() { logger.output("first\n", 6); }).join();
+        std::thread([&logger]() { logger.output("second\n", 7); }).join();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < kMessages; ++i)
+                {
+                    auto msg = "t" + std::to_string(t) + " " +
+                               std::to_string(i) + "\n";
+                    logger.output(msg.data(), msg.length());
+                }
+            });
+        }
+        // Too large for the buffer of the thread
+        logger.output(large.data(), large.length());
+        logger.output("\n", 1);
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    auto content = readFile(fileName);
+    remove(fileName.c_str());
+    auto first = content.find("first\n");
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_LT(first, content.find("second\n"));
+    EXPECT_NE(content.find(large), std::string::npos);
+    EXPECT_EQ(content.find("lost"), std::string::npos);
+
+    std::vector<int> next(kThreads, 0);
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.empty() || line[0] != 't')
+            continue;
+        int t, i;
+        ASSERT_EQ(sscanf(line.c_str(), "t%d %d", &t, &i), 2);
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, kThreads);
+        EXPECT_EQ(i, next[t]);
+        next[t] = i + 1;
+    }
+    for (int t = 0; t < kThreads; ++t)
+        EXPECT_EQ(next[t], kMessages);
+}
+
+// The numbers of the lines "<prefix><number> ...", in the order of the file
+static std::vector<int> lineNumbers(const std::string &content,
+                                    const std::string &prefix)
+{
+    std::vector<int> numbers;
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        auto pos = line.find(prefix);
+        if (pos != std::string::npos)
+            numbers.push_back(std::stoi(line.substr(pos + prefix.size())));
+    }
+    return numbers;
+}
+
+// Without a logger thread, the buffers pile up as with a stalled disk
+static void fillBuffers(AsyncFileLogger &logger, int count)
+{
+    const std::string padding(1000, 'p');
+    for (int i = 0; i < count; ++i)
+    {
+        auto msg = "seq " + std::to_string(i) + " " + padding + "\n";
+        logger.output(msg.data(), msg.length());
+    }
+}
+
+TEST(AsyncFileLogger, DropNewest)
+{
+    const std::string baseName = "drop_newest_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    const int kMessages = 20000;
+    uint64_t dropped;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.setMaxPendingBuffers(1);
+        fillBuffers(logger, kMessages);
+        auto stats = logger.stats();
+        dropped = stats.linesDropped[Logger::kInfo];
+        EXPECT_GT(dropped, 0UL);
+        EXPECT_EQ(stats.buffersPending, 2UL);
+        EXPECT_GT(stats.bytesQueued, 8UL * 1000 * 1000);
+
+        // The buffers are written once the logger thread runs
+        logger.startLogging();
+        logger.flush();
+        for (int i = 0; i < 500; ++i)
+        {
+            stats = logger.stats();
+            if (stats.bytesQueued == 0 && stats.buffersPending == 0)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(stats.bytesQueued, 0UL);
+        EXPECT_EQ(stats.buffersPending, 0UL);
+        EXPECT_GT(stats.maxFlushLatency, 0UL);
+        EXPECT_GE(stats.maxFlushLatency, stats.lastFlushLatency);
+    }
+
+    // The first messages are kept
+    auto numbers = lineNumbers(readFile(fileName), "seq ");
+    remove(fileName.c_str());
+    ASSERT_FALSE(numbers.empty());
+    for (size_t i = 0; i < numbers.size(); ++i)
+        ASSERT_EQ(numbers[i], static_cast<int>(i));
+    EXPECT_EQ(numbers.size() + dropped, static_cast<size_t>(kMessages));
+}
+
+TEST(AsyncFileLogger, DropOldest)
+{
+    const std::string baseName = "drop_oldest_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    const int kMessages = 20000;
+    uint64_t dropped;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.setMaxPendingBuffers(1);
+        logger.setOverflowPolicy(AsyncFileLogger::OverflowPolicy::DropOldest);
+        fillBuffers(logger, kMessages);
+        dropped = logger.stats().linesDropped[Logger::kInfo];
+        EXPECT_GT(dropped, 0UL);
+    }
+
+    // The last messages are kept
+    auto content = readFile(fileName);
+    remove(fileName.c_str());
+    EXPECT_NE(content.find(" log information is lost"), std::string::npos);
+    auto numbers = lineNumbers(content, "seq ");
+    ASSERT_FALSE(numbers.empty());
+    for (size_t i = 0; i < numbers.size(); ++i)
+    {
+        ASSERT_EQ(numbers[i],
+                  kMessages - static_cast<int>(numbers.size() - i));
+    }
+    EXPECT_EQ(numbers.size() + dropped, static_cast<size_t>(kMessages));
+}
+
+TEST(AsyncFileLogger, DropByLevel)
+{
+    const std::string baseName = "drop_by_level_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    const int kMessages = 16000;
+    const std::string padding(960, 'p');
+    auto level = Logger::logLevel();
+    Logger::setLogLevel(Logger::kInfo);
+    AsyncFileLogger::Stats stats;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.setMaxPendingBuffers(2);
+        logger.setOverflowPolicy(
+            AsyncFileLogger::OverflowPolicy::DropByLevel);
+        Logger::setOutputFunction(
+            [&logger](const char *msg, const uint64_t len) {
+                logger.output(msg, len);
+            },
+            [&logger]() { logger.flush(); });
+        for (int i = 0; i < kMessages; i += 2)
+        {
+            LOG_INFO << "seq " << i << " " << padding;
+            LOG_WARN << "seq " << i + 1 << " " << padding;
+        }
+        Logger::setOutputFunction(
+            [](const char *msg, const uint64_t len) {
+                fwrite(msg, 1, static_cast<size_t>(len), stdout);
+            },
+            []() { fflush(stdout); });
+        stats = logger.stats();
+    }
+    Logger::setLogLevel(level);
+    EXPECT_GT(stats.linesDropped[Logger::kInfo], 0UL);
+    EXPECT_EQ(stats.linesDropped[Logger::kWarn], 0UL);
+
+    // All the WARN messages are kept
+    auto numbers = lineNumbers(readFile(fileName), "seq ");
+    remove(fileName.c_str());
+    int expected = 1;
+    for (auto number : numbers)
+    {
+        if (number % 2 == 1)
+        {
+            EXPECT_EQ(number, expected);
+            expected += 2;
+        }
+    }
+    EXPECT_EQ(expected, kMessages + 1);
+    EXPECT_EQ(numbers.size() + stats.linesDropped[Logger::kInfo],
+              static_cast<size_t>(kMessages));
+}
+
+TEST(AsyncFileLogger, PerThreadBuffersOverflow)
+{
+    const std::string baseName = "per_thread_overflow_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    const int kMessages = 16000;
+    const std::string padding(960, 'p');
+    auto level = Logger::logLevel();
+    Logger::setLogLevel(Logger::kInfo);
+    AsyncFileLogger::Stats stats;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.enablePerThreadBuffers(4096);
+        logger.setMaxPendingBuffers(2);
+        logger.setOverflowPolicy(
+            AsyncFileLogger::OverflowPolicy::DropByLevel);
+        Logger::setOutputFunction(
+            [&logger](const char *msg, const uint64_t len) {
+                logger.output(msg, len);
+            },
+            [&logger]() { logger.flush(); });
+        // The buffer of the thread fills up without a logger thread, the
+        // policy applies to the messages beyond it
+        for (int i = 0; i < kMessages; i += 2)
+        {
+            LOG_INFO << "seq " << i << " " << padding;
+            LOG_WARN << "seq " << i + 1 << " " << padding;
+        }
+        Logger::setOutputFunction(
+            [](const char *msg, const uint64_t len) {
+                fwrite(msg, 1, static_cast<size_t>(len), stdout);
+            },
+            []() { fflush(stdout); });
+        stats = logger.stats();
+    }
+    Logger::setLogLevel(level);
+    EXPECT_GT(stats.linesDropped[Logger::kInfo], 0UL);
+    EXPECT_EQ(stats.linesDropped[Logger::kWarn], 0UL);
+
+    auto numbers = lineNumbers(readFile(fileName), "seq ");
+    remove(fileName.c_str());
+    EXPECT_EQ(std::count_if(numbers.begin(),
+                            numbers.end(),
+                            [](int number) { return number % 2 == 1; }),
+              kMessages / 2);
+    EXPECT_EQ(numbers.size() + stats.linesDropped[Logger::kInfo],
+              static_cast<size_t>(kMessages));
+}
+
+TEST(AsyncFileLogger, Block)
+{
+    const std::string baseName = "block_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.setMaxPendingBuffers(0);
+        logger.setOverflowPolicy(AsyncFileLogger::OverflowPolicy::Block);
+        logger.setBlockTimeout(std::chrono::milliseconds(50));
+        // Blocks once the first buffer is full, then drops the message
+        const std::string msg(1000, 'p');
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10000; ++i)
+        {
+            logger.output(msg.data(), msg.length());
+            if (logger.stats().linesDropped[Logger::kInfo] > 0)
+                break;
+        }
+        EXPECT_GE(std::chrono::steady_clock::now() - start,
+                  std::chrono::milliseconds(50));
+        auto dropped = logger.stats().linesDropped[Logger::kInfo];
+        EXPECT_EQ(dropped, 1UL);
+
+        // Unblocked by the logger thread
+        logger.setBlockTimeout(std::chrono::milliseconds(10000));
+        logger.startLogging();
+        logger.output("last\n", 5);
+        EXPECT_EQ(logger.stats().linesDropped[Logger::kInfo], dropped);
+    }
+    auto content = readFile(fileName);
+    remove(fileName.c_str());
+    EXPECT_NE(content.find("last\n"), std::string::npos);
+}
+
+#ifndef _WIN32
+static std::vector<std::string> listDir(const std::string &path)
+{
+    std::vector<std::string> names;
+    DIR *dp = opendir(path.c_str());
+    if (!dp)
+        return names;
+    while (auto entry = readdir(dp))
+    {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            names.push_back(name);
+    }
+    closedir(dp);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static void removeDir(const std::string &dir)
+{
+    for (auto &name : listDir(dir))
+        remove((dir + name).c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(AsyncFileLogger, MappedFile)
+{
+    const std::string dir = "./mapped_file_test/";
+    removeDir(dir);
+    mkdir(dir.c_str(), 0755);
+    const int kMessages = 20000;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName("trantor", ".log", dir);
+        logger.setFileSizeLimit(64 * 1024);
+        logger.enableMappedFile();
+        logger.startLogging();
+        for (int i = 0; i < kMessages; ++i)
+        {
+            auto msg = "message " + std::to_string(i) + "\n";
+            logger.output(msg.data(), msg.length());
+            if (i % 1000 == 999)
+                logger.flush();
+        }
+    }
+
+    // The files are truncated to their content
+    auto names = listDir(dir);
+    EXPECT_GT(names.size(), 1UL);
+    std::string content;
+    for (auto &name : names)
+    {
+        auto fileContent = readFile(dir + name);
+        EXPECT_EQ(fileContent.find('\0'), std::string::npos) << name;
+        content += fileContent;
+    }
+    std::istringstream lines(content);
+    std::string line;
+    int expected = 0;
+    while (std::getline(lines, line))
+        EXPECT_EQ(line, "message " + std::to_string(expected++));
+    EXPECT_EQ(expected, kMessages);
+    removeDir(dir);
+}
+
+TEST(AsyncFileLogger, MappedFileSurvivesCrash)
+{
+    const std::string baseName = "mapped_file_crash_test";
+    const std::string fileName = "./" + baseName + ".log";
+    remove(fileName.c_str());
+    std::string messages;
+    for (int i = 0; i < 100; ++i)
+        messages += "message " + std::to_string(i) + "\n";
+
+    auto pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0)
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.enableMappedFile();
+        logger.startLogging();
+        logger.output(messages.data(), messages.length());
+        logger.flush();
+        // Exit without closing the file once the messages are in the mapping
+        for (int i = 0; i < 500; ++i)
+        {
+            if (readFile(fileName).find(messages) == 0)
+                _exit(0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        _exit(1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+
+    // The file keeps the zeros after the content
+    auto content = readFile(fileName);
+    ASSERT_GT(content.size(), messages.size());
+    EXPECT_EQ(content.substr(0, messages.size()), messages);
+    EXPECT_EQ(content.find_first_not_of('\0', messages.size()),
+              std::string::npos);
+
+    // They are trimmed when the file is opened again
+    {
+        AsyncFileLogger logger;
+        logger.setFileName(baseName);
+        logger.setSwitchOnLimitOnly();
+        logger.enableMappedFile();
+        logger.startLogging();
+        logger.output("after\n", 6);
+    }
+    EXPECT_EQ(readFile(fileName), messages + "after\n");
+    remove(fileName.c_str());
+}
+#endif
+
+#if !defined(_WIN32) && defined(USE_ZLIB)
+
+static std::string gunzipFile(const std::string &name)
+{
+    std::string content;
+    gzFile file = gzopen(name.c_str(), "rb");
+    if (!file)
+        return content;
+    char buf[4096];
+    int n;
+    while ((n = gzread(file, buf, sizeof(buf))) > 0)
+        content.append(buf, n);
+    gzclose(file);
+    return content;
+}
+
+TEST(AsyncFileLogger, Compression)
+{
+    ASSERT_TRUE(AsyncFileLogger::hasCompressionSupport(
+        AsyncFileLogger::Compression::Gzip));
+    const std::string dir = "./compression_test/";
+    removeDir(dir);
+    mkdir(dir.c_str(), 0755);
+
+    // Left uncompressed by a previous run
+    const std::string leftover = "trantor.230101-000000.000001.log";
+    {
+        std::ofstream file(dir + leftover);
+        file << "leftover\n";
+    }
+
+    const int kMessages = 20000;
+    {
+        AsyncFileLogger logger;
+        logger.setFileName("trantor", ".log", dir);
+        logger.setFileSizeLimit(64 * 1024);
+        logger.setMaxFiles(4);
+        logger.setCompression(AsyncFileLogger::Compression::Gzip);
+        logger.startLogging();
+        for (int i = 0; i < kMessages; ++i)
+        {
+            auto msg = "message " + std::to_string(i) + "\n";
+            logger.output(msg.data(), msg.length());
+            // The size of the file is checked after each write
+            if (i % 1000 == 999)
+                logger.flush();
+        }
+    }
+
+    // The oldest files are deleted, the leftover one first
+    auto names = listDir(dir);
+    ASSERT_EQ(names.size(), 4UL);
+    std::string content;
+    for (auto &name : names)
+    {
+        ASSERT_GT(name.size(), 7UL);
+        EXPECT_EQ(name.substr(name.size() - 7), ".log.gz") << name;
+        EXPECT_NE(name, leftover + ".gz");
+        content += gunzipFile(dir + name);
+    }
+    // The last messages, in order
+    auto last = "message " + std::to_string(kMessages - 1) + "\n";
+    ASSERT_GT(content.size(), last.size());
+    EXPECT_EQ(content.substr(content.size() - last.size()), last);
+    auto first = content.find("message ");
+    ASSERT_EQ(first, 0UL);
+    int expected = std::stoi(content.substr(8));
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+        EXPECT_EQ(line, "message " + std::to_string(expected++));
+    EXPECT_EQ(expected, kMessages);
+    removeDir(dir);
+}
+
+TEST(AsyncFileLogger, InterruptedCompression)
+{
+    const std::string dir = "./interrupted_compression_test/";
+    removeDir(dir);
+    mkdir(dir.c_str(), 0755);
+
+    // The process ended during the compression of a file
+    const std::string oldest = "trantor.230101-000000.000001.log";
+    const std::string leftover = "trantor.230101-000000.000002.log";
+    {
+        std::ofstream file(dir + oldest);
+        file << "oldest\n";
+        std::ofstream tmp(dir + oldest + ".gz.tmp");
+        tmp << "partial";
+        std::ofstream other(dir + "other.log.gz.tmp");
+        other << "other";
+        std::ofstream last(dir + leftover);
+        last << "leftover\n";
+        std::ofstream lastTmp(dir + leftover + ".gz.tmp");
+        lastTmp << "partial";
+    }
+    {
+        AsyncFileLogger logger;
+        logger.setFileName("trantor", ".log", dir);
+        logger.setSwitchOnLimitOnly();
+        logger.setMaxFiles(1);
+        logger.setCompression(AsyncFileLogger::Compression::Gzip);
+        logger.output("message\n", 8);
+    }
+
+    // The partial outputs are removed along with the oldest file, the last
+    // file is compressed again
+    auto names = listDir(dir);
+    std::vector<std::string> expected{"other.log.gz.tmp",
+                                      leftover + ".gz",
+                                      "trantor.log"};
+    EXPECT_EQ(names, expected);
+    EXPECT_EQ(gunzipFile(dir + leftover + ".gz"), "leftover\n");
+    removeDir(dir);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
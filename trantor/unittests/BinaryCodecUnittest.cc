@@ -0,0 +1,179 @@
+#include <trantor/utils/BinaryCodec.h>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+using namespace trantor;
+using namespace trantor::codec;
+
+namespace
+{
+struct Header
+{
+    uint32_t id;
+    uint16_t flags;
+    uint64_t seq;
+};
+using HeaderLayout =
+    Layout<TRANTOR_CODEC_FIELD(Header, id, BigEndian<uint32_t>),
+           TRANTOR_CODEC_FIELD(Header, flags, LittleEndian<uint16_t>),
+           TRANTOR_CODEC_FIELD(Header, seq, BigEndian<uint64_t>)>;
+
+struct Message
+{
+    int32_t delta;
+    uint64_t length;
+    double ratio;
+    std::string name;
+    std::vector<uint32_t> values;
+    std::vector<int16_t> samples;
+};
+using MessageLayout =
+    Layout<TRANTOR_CODEC_FIELD(Message, delta, Varint<int32_t>),
+           TRANTOR_CODEC_FIELD(Message, length, Varint<uint64_t>),
+           TRANTOR_CODEC_FIELD(Message, ratio, BigEndian<double>),
+           TRANTOR_CODEC_FIELD(Message, name, Bytes),
+           TRANTOR_CODEC_FIELD(Message, values, FixedArray<uint32_t>),
+           TRANTOR_CODEC_FIELD(Message, samples, FixedArray<int16_t, false>)>;
+}  // namespace
+
+TEST(BinaryCodec, FixedLayout)
+{
+    EXPECT_TRUE(HeaderLayout::kIsFixedSize);
+    EXPECT_EQ(HeaderLayout::kFixedSize, 14U);
+    MsgBuffer buf;
+    Header header{0x01020304, 0x0506, 0x0708090a0b0c0d0e};
+    HeaderLayout::encode(buf, header);
+    ASSERT_EQ(buf.readableBytes(), 14U);
+    const unsigned char expected[] = {1, 2, 3, 4, 6, 5, 7, 8, 9, 10, 11, 12, 13,
+                                      14};
+    EXPECT_EQ(memcmp(buf.peek(), expected, sizeof(expected)), 0);
+    // Compatible with the scalar helpers of MsgBuffer
+    EXPECT_EQ(buf.peekInt32(), header.id);
+
+    MsgBuffer partial;
+    partial.append(buf.peek(), 13);
+    Header decoded{};
+    EXPECT_EQ(HeaderLayout::decode(partial, decoded),
+              DecodeStatus::NeedMoreData);
+    EXPECT_EQ(partial.readableBytes(), 13U);
+    EXPECT_EQ(HeaderLayout::decode(buf, decoded), DecodeStatus::Ok);
+    EXPECT_EQ(buf.readableBytes(), 0U);
+    EXPECT_EQ(decoded.id, header.id);
+    EXPECT_EQ(decoded.flags, header.flags);
+    EXPECT_EQ(decoded.seq, header.seq);
+}
+
+TEST(BinaryCodec, VariableLayout)
+{
+    EXPECT_FALSE(MessageLayout::kIsFixedSize);
+    Message msg{-3, 300, 0.25, "trantor", {}, {-1, 2, -300}};
+    for (uint32_t i = 0; i < 1000; ++i)
+        msg.values.push_back(i * 2654435761U);
+    MsgBuffer buf;
+    MessageLayout::encode(buf, msg);
+    MessageLayout::encode(buf, msg);
+    size_t size = buf.readableBytes() / 2;
+    // zigzag(-3) = 5 and 300 = 0xac 0x02
+    EXPECT_EQ(static_cast<uint8_t>(buf.peek()[0]), 5);
+    EXPECT_EQ(static_cast<uint8_t>(buf.peek()[1]), 0xac);
+    EXPECT_EQ(static_cast<uint8_t>(buf.peek()[2]), 0x02);
+
+    // Every truncation needs more data and leaves the buffer alone
+    for (size_t len = 0; len < size; ++len)
+    {
+        MsgBuffer partial;
+        partial.append(buf.peek(), len);
+        Message decoded;
+        EXPECT_EQ(MessageLayout::decode(partial, decoded),
+                  DecodeStatus::NeedMoreData);
+        EXPECT_EQ(partial.readableBytes(), len);
+    }
+    for (int n = 0; n < 2; ++n)
+    {
+        Message decoded;
+        ASSERT_EQ(MessageLayout::decode(buf, decoded), DecodeStatus::Ok);
+        EXPECT_EQ(decoded.delta, msg.delta);
+        EXPECT_EQ(decoded.length, msg.length);
+        EXPECT_EQ(decoded.ratio, msg.ratio);
+        EXPECT_EQ(decoded.name, msg.name);
+        EXPECT_EQ(decoded.values, msg.values);
+        EXPECT_EQ(decoded.samples, msg.samples);
+        EXPECT_EQ(buf.readableBytes(), size * (1 - n));
+    }
+}
+
+TEST(BinaryCodec, Varint)
+{
+    const uint64_t values[] = {0,
+                               1,
+                               127,
+                               128,
+                               16383,
+                               16384,
+                               (std::numeric_limits<uint32_t>::max)(),
+                               (std::numeric_limits<uint64_t>::max)()};
+    MsgBuffer buf;
+    for (auto v : values)
+        appendVarint(buf, v);
+    for (auto v : values)
+    {
+        uint64_t decoded;
+        ASSERT_EQ(readVarint(buf, decoded), DecodeStatus::Ok);
+        EXPECT_EQ(decoded, v);
+    }
+    EXPECT_EQ(varintSize(127), 1U);
+    EXPECT_EQ(varintSize(128), 2U);
+    EXPECT_EQ(varintSize((std::numeric_limits<uint64_t>::max)()), 10U);
+
+    for (int64_t v : {int64_t{0}, int64_t{-1}, int64_t{1}, int64_t{-64}})
+        EXPECT_EQ(zigzagDecode(zigzagEncode(v)), v);
+    EXPECT_EQ(zigzagEncode(-1), 1U);
+    EXPECT_EQ(zigzagEncode(1), 2U);
+
+    // Too long for 64 bits
+    MsgBuffer bad;
+    bad.append(std::string(10, '\xff'));
+    bad.appendInt8(1);
+    uint64_t v;
+    EXPECT_EQ(readVarint(bad, v), DecodeStatus::Malformed);
+    // Too large for the field
+    const char big[] = "\xff\xff\xff\xff\x0f\xff\xff\x07";
+    const char *p = big;
+    uint32_t u32;
+    EXPECT_EQ(Varint<uint32_t>::decode(p, big + 5, u32), DecodeStatus::Ok);
+    EXPECT_EQ(u32, 0xffffffffU);
+    EXPECT_EQ(p, big + 5);
+    uint16_t u16;
+    EXPECT_EQ(Varint<uint16_t>::decode(p, big + 8, u16),
+              DecodeStatus::Malformed);
+    EXPECT_EQ(p, big + 5);
+}
+
+TEST(BinaryCodec, ByteSwapCopy)
+{
+    std::mt19937_64 rng(42);
+    for (size_t width : {2, 4, 8})
+    {
+        for (size_t count = 0; count < 100; ++count)
+        {
+            std::vector<char> src(count * width + 1), dst(count * width + 1);
+            for (auto &c : src)
+                c = static_cast<char>(rng());
+            // Unaligned source and destination
+            codec::detail::byteSwapCopy(dst.data() + 1,
+                                        src.data() + 1,
+                                        count,
+                                        width);
+            for (size_t i = 0; i < count; ++i)
+                for (size_t j = 0; j < width; ++j)
+                    ASSERT_EQ(dst[1 + i * width + j],
+                              src[1 + i * width + width - 1 - j]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
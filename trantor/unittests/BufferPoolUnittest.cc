@@ -0,0 +1,130 @@
+#include <trantor/utils/BufferPool.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+using namespace trantor;
+
+TEST(BufferPool, ReuseSameSizeClass)
+{
+    void *p1 = detail::poolAllocate(100);
+    memset(p1, 'a', 100);
+    detail::poolDeallocate(p1, 100);
+    // 100 and 128 bytes are in the same size class
+    void *p2 = detail::poolAllocate(128);
+    EXPECT_EQ(p1, p2);
+    memset(p2, 'b', 128);
+    detail::poolDeallocate(p2, 128);
+}
+
+TEST(BufferPool, LargeAllocation)
+{
+    const size_t len = 1024 * 1024;
+    auto p = static_cast<char *>(detail::poolAllocate(len));
+    memset(p, 'c', len);
+    EXPECT_EQ(p[len - 1], 'c');
+    detail::poolDeallocate(p, len);
+}
+
+TEST(BufferPool, FreeInOtherThread)
+{
+    std::vector<void *> chunks;
+    for (size_t i = 0; i < 100; ++i)
+        chunks.push_back(detail::poolAllocate(i * 37));
+    std::thread thread([&chunks]() {
+        for (size_t i = 0; i < chunks.size(); ++i)
+            detail::poolDeallocate(chunks[i], i * 37);
+        // The chunks are pooled by this thread now
+        auto p = detail::poolAllocate(99 * 37);
+        EXPECT_EQ(p, chunks[99]);
+        detail::poolDeallocate(p, 99 * 37);
+    });
+    thread.join();
+}
+
+TEST(BufferPool, Allocator)
+{
+    std::vector<int, PoolAllocator<int>> vec;
+    for (int i = 0; i < 10000; ++i)
+        vec.push_back(i);
+    for (int i = 0; i < 10000; ++i)
+        EXPECT_EQ(vec[i], i);
+    auto ptr = std::allocate_shared<std::string>(PoolAllocator<std::string>(),
+                                                 "pooled");
+    EXPECT_EQ(*ptr, "pooled");
+    EXPECT_TRUE(PoolAllocator<int>() == PoolAllocator<char>());
+}
+
+// Runs last, the pools keep using huge pages once they are enabled
+TEST(BufferPool, HugePages)
+{
+    if (!BufferPool::enableHugePages(64 * 1024 * 1024))
+        GTEST_SKIP() << "Huge pages are not supported";
+    EXPECT_TRUE(BufferPool::hugePagesEnabled());
+
+    std::vector<void *> chunks;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        auto p = detail::poolAllocate(1000);
+        memset(p, 'h', 1000);
+        chunks.push_back(p);
+    }
+    EXPECT_TRUE(detail::inHugePageArena(chunks.back()));
+    EXPECT_GE(BufferPool::hugePageArenaUsage(), 2U * 1024 * 1024);
+    for (auto p : chunks)
+        detail::poolDeallocate(p, 1000);
+
+    // Chunks left by an exiting thread are reused by the others
+    void *orphan{nullptr};
+    std::thread thread([&orphan]() {
+        orphan = detail::poolAllocate(5000);
+        EXPECT_TRUE(detail::inHugePageArena(orphan));
+        detail::poolDeallocate(orphan, 5000);
+    });
+    thread.join();
+    chunks.clear();
+    bool reused = false;
+    for (size_t i = 0; i < 100 && !reused; ++i)
+    {
+        chunks.push_back(detail::poolAllocate(5000));
+        reused = chunks.back() == orphan;
+    }
+    EXPECT_TRUE(reused);
+    for (auto p : chunks)
+        detail::poolDeallocate(p, 5000);
+
+    // Chunks freed by another thread beyond what it pools are reused by the
+    // allocating thread, instead of new pages of the arena
+    chunks.clear();
+    for (size_t i = 0; i < 4000; ++i)
+        chunks.push_back(detail::poolAllocate(1000));
+    auto usage = BufferPool::hugePageArenaUsage();
+    std::atomic<bool> freed{false};
+    std::atomic<bool> done{false};
+    std::thread worker([&chunks, &freed, &done]() {
+        for (auto p : chunks)
+            detail::poolDeallocate(p, 1000);
+        freed = true;
+        // The chunks pooled by the thread stay there while it runs
+        while (!done)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    while (!freed)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    chunks.clear();
+    for (size_t i = 0; i < 3000; ++i)
+        chunks.push_back(detail::poolAllocate(1000));
+    EXPECT_EQ(BufferPool::hugePageArenaUsage(), usage);
+    done = true;
+    worker.join();
+    for (auto p : chunks)
+        detail::poolDeallocate(p, 1000);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
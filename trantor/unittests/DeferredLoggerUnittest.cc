@@ -0,0 +1,160 @@
+#include <trantor/utils/DeferredLogger.h>
+#include <gtest/gtest.h>
+#include "LogCapture.h"
+#include <string>
+#include <thread>
+#include <vector>
+using namespace trantor;
+using namespace trantor::test;
+
+namespace
+{
+struct Point
+{
+    int x;
+    int y;
+};
+
+LogStream &operator<<(LogStream &stream, const Point &point)
+{
+    stream << "(" << point.x << ", " << point.y << ")";
+    return stream;
+}
+
+// The text between the thread id and the line number, which is the same for
+// the deferred and the eager macros
+std::string message(const std::string &line)
+{
+    auto pos = line.find(" INFO  ");
+    if (pos == std::string::npos)
+        pos = line.find(" WARN  ");
+    if (pos == std::string::npos)
+        return line;
+    return line.substr(pos, line.rfind(':') - pos);
+}
+
+void logAllTypes(int line)
+{
+    const char *nullStr = nullptr;
+    std::string str("string");
+    short s = -3;
+    unsigned short us = 4;
+    long l = -5000000000L;
+    unsigned long long ull = 18000000000000000000ULL;
+    float f = 1.5f;
+    long double ld = 2.25L;
+    Point point{1, 2};
+    unsigned char uc = 7;
+    if (line == 0)
+    {
+        LOG_INFO << true << 'c' << s << us << -1 << 2u << l << ull << f
+                 << 3.14159 << ld << "literal" << nullStr << str << point
+                 << uc << Fmt("%05d", 42);
+    }
+    else
+    {
+        LOG_DEFERRED_INFO << true << 'c' << s << us << -1 << 2u << l << ull
+                          << f << 3.14159 << ld << "literal" << nullStr
+                          << str << point << uc << Fmt("%05d", 42);
+    }
+}
+}  // namespace
+
+TEST(DeferredLogger, FormatsLikeLogger)
+{
+    captureOutput();
+    logAllTypes(0);
+    logAllTypes(1);
+    restoreOutput();
+    ASSERT_EQ(outputLines().size(), 2UL);
+    auto eager = message(outputLines()[0]);
+    EXPECT_EQ(eager, message(outputLines()[1]));
+    EXPECT_NE(eager.find(" INFO  1c-34-12-500000000018000000000000000000"
+                         "1.53.141592.25literal(null)"),
+              std::string::npos);
+    EXPECT_NE(eager.find("(null)string(1, 2)700042 - "), std::string::npos);
+}
+
+TEST(DeferredLogger, BackgroundThread)
+{
+    const int kThreads = 4;
+    const int kMessages = 1000;
+    captureOutput();
+    DeferredLogger::start();
+    EXPECT_TRUE(DeferredLogger::isRunning());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < kMessages; ++i)
+                LOG_DEFERRED_INFO << "t" << t << " " << i;
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    DeferredLogger::stop();
+    EXPECT_FALSE(DeferredLogger::isRunning());
+    restoreOutput();
+
+    ASSERT_EQ(outputLines().size(), static_cast<size_t>(kThreads * kMessages));
+    std::vector<int> next(kThreads, 0);
+    for (auto &line : outputLines())
+    {
+        auto pos = line.find(" INFO  t");
+        ASSERT_NE(pos, std::string::npos) << line;
+        int t = line[pos + 8] - '0';
+        // The messages of each thread keep their order
+        EXPECT_EQ(std::stoi(line.substr(pos + 10)), next[t]++);
+    }
+}
+
+TEST(DeferredLogger, BinaryOutput)
+{
+    std::string binary;
+    DeferredLogger::startBinary(
+        [&binary](const char *msg, const uint64_t len) {
+            binary.append(msg, static_cast<size_t>(len));
+        },
+        nullptr);
+    for (int i = 0; i < 3; ++i)
+        LOG_DEFERRED_WARN << "message " << i << ' ' << 0.5 * i;
+    logAllTypes(1);
+    DeferredLogger::stop();
+
+    // The messages are now formatted right away
+    captureOutput();
+    for (int i = 0; i < 3; ++i)
+        LOG_DEFERRED_WARN << "message " << i << ' ' << 0.5 * i;
+    logAllTypes(1);
+    auto expected = outputLines();
+    outputLines().clear();
+    restoreOutput();
+    ASSERT_EQ(expected.size(), 4UL);
+
+    // Decode the output in pieces
+    DeferredLogDecoder decoder;
+    std::vector<std::string> decoded;
+    auto output = [&decoded](const char *msg, const uint64_t len) {
+        decoded.emplace_back(msg, static_cast<size_t>(len));
+    };
+    std::string pending;
+    for (size_t i = 0; i < binary.length(); i += 7)
+    {
+        pending.append(binary, i, 7);
+        auto n = decoder.decode(pending.data(), pending.length(), output);
+        pending.erase(0, n);
+    }
+    EXPECT_TRUE(pending.empty());
+    ASSERT_EQ(decoded.size(), expected.size());
+    for (size_t i = 0; i < decoded.size(); ++i)
+        EXPECT_EQ(message(decoded[i]), message(expected[i]));
+
+    DeferredLogDecoder other;
+    EXPECT_THROW(other.decode("not a log", 9, output), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,197 @@
+#include <trantor/net/FrameCodec.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace trantor;
+
+namespace
+{
+// Feeds the encoded frames to the codec in pieces of the given size
+std::vector<std::string> feed(FrameCodec &codec,
+                              const MsgBuffer &encoded,
+                              size_t pieceSize)
+{
+    std::vector<std::string> frames;
+    codec.setFrameCallback(
+        [&frames](const TcpConnectionPtr &, const char *data, size_t len) {
+            frames.emplace_back(data, len);
+        });
+    MsgBuffer buf;
+    for (size_t i = 0; i < encoded.readableBytes(); i += pieceSize)
+    {
+        buf.append(encoded.peek() + i,
+                   (std::min)(pieceSize, encoded.readableBytes() - i));
+        codec.onMessage(nullptr, &buf);
+    }
+    EXPECT_EQ(buf.readableBytes(), 0U);
+    return frames;
+}
+
+const std::vector<std::string> kFrames{"hello",
+                                       "",
+                                       std::string(200, 'x'),
+                                       "world\r\n"};
+
+void checkRoundTrip(FrameCodec codec)
+{
+    MsgBuffer encoded;
+    for (auto &frame : kFrames)
+        codec.encode(encoded, frame);
+    for (size_t pieceSize : {1, 3, 1000})
+        EXPECT_EQ(feed(codec, encoded, pieceSize), kFrames);
+}
+}  // namespace
+
+TEST(FrameCodec, LengthPrefixed)
+{
+    for (size_t headerSize : {1, 2, 4, 8})
+    {
+        checkRoundTrip(FrameCodec::lengthPrefixed(headerSize));
+        checkRoundTrip(FrameCodec::lengthPrefixed(headerSize, false));
+    }
+    MsgBuffer buf;
+    FrameCodec::lengthPrefixed(2).encode(buf, "abc");
+    EXPECT_EQ(buf.readInt16(), 3);
+    buf.retrieve(3);
+    FrameCodec::lengthPrefixed(4, false).encode(buf, "abc");
+    EXPECT_EQ(std::string(buf.peek(), 4), std::string("\3\0\0\0", 4));
+
+    EXPECT_THROW(FrameCodec::lengthPrefixed(3), std::invalid_argument);
+    EXPECT_THROW(
+        FrameCodec::lengthPrefixed(1).encode(buf, std::string(256, 'x')),
+        std::length_error);
+}
+
+TEST(FrameCodec, Varint)
+{
+    checkRoundTrip(FrameCodec::varintPrefixed());
+    MsgBuffer buf;
+    FrameCodec::varintPrefixed().encode(buf, kFrames[2]);
+    EXPECT_EQ(buf.readableBytes(), 202U);
+}
+
+TEST(FrameCodec, Delimited)
+{
+    auto codec = FrameCodec::delimited("\r\n\r\n");
+    MsgBuffer encoded;
+    for (auto &frame : kFrames)
+        codec.encode(encoded, frame);
+    // "world\r\n" followed by the delimiter is split at the first match
+    std::vector<std::string> expected(kFrames);
+    expected.back() = "world";
+    encoded.retrieveAll();
+    for (auto &frame : expected)
+        codec.encode(encoded, frame);
+    for (size_t pieceSize : {1, 3, 1000})
+        EXPECT_EQ(feed(codec, encoded, pieceSize), expected);
+    EXPECT_THROW(FrameCodec::delimited(""), std::invalid_argument);
+}
+
+TEST(FrameCodec, DelimitedResume)
+{
+    std::vector<std::string> frames;
+    auto codec = FrameCodec::delimited("\r\n\r\n");
+    codec.setFrameCallback(
+        [&frames](const TcpConnectionPtr &, const char *data, size_t len) {
+            frames.emplace_back(data, len);
+        });
+
+    // The search resumes before the partially received delimiter
+    MsgBuffer buf;
+    size_t scanned = 0;
+    buf.append("abc\r\n\r");
+    codec.onMessage(nullptr, &buf, scanned);
+    EXPECT_TRUE(frames.empty());
+    EXPECT_EQ(scanned, 6U);
+    buf.append("\nd\r");
+    codec.onMessage(nullptr, &buf, scanned);
+    ASSERT_EQ(frames.size(), 1U);
+    EXPECT_EQ(frames[0], "abc");
+    EXPECT_EQ(scanned, 2U);
+    buf.append("\n\r\n");
+    codec.onMessage(nullptr, &buf, scanned);
+    ASSERT_EQ(frames.size(), 2U);
+    EXPECT_EQ(frames[1], "d");
+    EXPECT_EQ(scanned, 0U);
+
+    // A large frame received in pieces through copies of the callback
+    frames.clear();
+    MsgBuffer encoded;
+    std::string large(100000, 'x');
+    codec.encode(encoded, large);
+    codec.encode(encoded, "y");
+    auto callback = codec.recvMessageCallback();
+    auto other = callback;
+    MsgBuffer otherBuf;
+    for (size_t pieceSize : {1, 7, 4096})
+    {
+        for (size_t i = 0; i < encoded.readableBytes(); i += pieceSize)
+        {
+            size_t n = (std::min)(pieceSize, encoded.readableBytes() - i);
+            buf.append(encoded.peek() + i, n);
+            callback(nullptr, &buf);
+            otherBuf.append(encoded.peek() + i, n);
+            other(nullptr, &otherBuf);
+        }
+        EXPECT_EQ(buf.readableBytes(), 0U);
+        EXPECT_EQ(otherBuf.readableBytes(), 0U);
+    }
+    EXPECT_EQ(frames.size(), 12U);
+    EXPECT_EQ(std::count(frames.begin(), frames.end(), large), 6);
+    EXPECT_EQ(std::count(frames.begin(), frames.end(), "y"), 6);
+}
+
+TEST(FrameCodec, MaxFrameSize)
+{
+    std::string error;
+    auto codec = FrameCodec::lengthPrefixed(4);
+    codec.setMaxFrameSize(100);
+    codec.setErrorCallback(
+        [&error](const TcpConnectionPtr &, const std::string &reason) {
+            error = reason;
+        });
+    size_t frames = 0;
+    codec.setFrameCallback(
+        [&frames](const TcpConnectionPtr &, const char *, size_t) {
+            ++frames;
+        });
+
+    // Rejected from the header, before the data is received
+    MsgBuffer buf;
+    buf.appendInt32(101);
+    codec.onMessage(nullptr, &buf);
+    EXPECT_EQ(error, "Frame too large");
+    EXPECT_EQ(buf.readableBytes(), 0U);
+
+    // Room is made for the whole frame once its header is received
+    error.clear();
+    buf.appendInt32(100);
+    buf.append("abc");
+    codec.onMessage(nullptr, &buf);
+    EXPECT_TRUE(error.empty());
+    EXPECT_GE(buf.writableBytes(), 97U);
+    buf.append(std::string(97, 'd'));
+    codec.onMessage(nullptr, &buf);
+    EXPECT_EQ(frames, 1U);
+
+    auto delimited = FrameCodec::delimited("\n");
+    delimited.setMaxFrameSize(10);
+    delimited.setErrorCallback(
+        [&error](const TcpConnectionPtr &, const std::string &reason) {
+            error = reason;
+        });
+    buf.append("0123456789");
+    delimited.onMessage(nullptr, &buf);
+    EXPECT_TRUE(error.empty());
+    buf.append("a");
+    delimited.onMessage(nullptr, &buf);
+    EXPECT_EQ(error, "Frame too large");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
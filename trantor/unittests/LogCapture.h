@@ -0,0 +1,49 @@
+// Captures the lines output by the logger, for the tests of the log macros
+#pragma once
+#include <trantor/utils/Logger.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace trantor
+{
+namespace test
+{
+// The lines output since captureOutput()
+inline std::vector<std::string> &outputLines()
+{
+    static std::vector<std::string> lines;
+    return lines;
+}
+
+inline std::mutex &outputMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Keep the lines output from any thread instead of writing them
+inline void captureOutput()
+{
+    outputLines().clear();
+    Logger::setOutputFunction(
+        [](const char *msg, const uint64_t len) {
+            std::lock_guard<std::mutex> lock(outputMutex());
+            outputLines().emplace_back(msg, static_cast<size_t>(len));
+        },
+        []() {});
+}
+
+// Write the lines to stdout again, in the text format
+inline void restoreOutput()
+{
+    Logger::setLogFormat(LogFormat::Text);
+    Logger::setOutputFunction(
+        [](const char *msg, const uint64_t len) {
+            fwrite(msg, 1, static_cast<size_t>(len), stdout);
+        },
+        []() { fflush(stdout); });
+}
+}  // namespace test
+}  // namespace trantor
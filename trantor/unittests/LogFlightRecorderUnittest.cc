@@ -0,0 +1,237 @@
+#include <trantor/utils/LogFlightRecorder.h>
+#include <gtest/gtest.h>
+#include "LogCapture.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+using namespace trantor;
+using namespace trantor::test;
+
+namespace
+{
+std::vector<std::string> dumpLines()
+{
+    std::vector<std::string> lines;
+    LogFlightRecorder::dump([&lines](const char *msg, const uint64_t len) {
+        lines.emplace_back(msg, static_cast<size_t>(len));
+    });
+    return lines;
+}
+
+std::vector<std::string> linesWith(const std::vector<std::string> &lines,
+                                   const std::string &text)
+{
+    std::vector<std::string> result;
+    for (auto &line : lines)
+    {
+        if (line.find(text) != std::string::npos)
+            result.push_back(line);
+    }
+    return result;
+}
+
+std::string readFile(const std::string &name)
+{
+    std::ifstream file(name);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+}  // namespace
+
+TEST(LogFlightRecorder, RecordsBelowLogLevel)
+{
+    Logger::setLogLevel(Logger::kWarn);
+    captureOutput();
+    LOG_DEBUG << "not recorded yet";
+    LogFlightRecorder::start(Logger::kDebug);
+    EXPECT_TRUE(LogFlightRecorder::isRecording());
+    EXPECT_EQ(Logger::enabledLevel(), Logger::kDebug);
+    LOG_DEBUG << "below debug";
+    LOG_INFO << "below info";
+    LOG_WARN << "below warn";
+    LogFlightRecorder::stop();
+    EXPECT_FALSE(LogFlightRecorder::isRecording());
+    EXPECT_EQ(Logger::enabledLevel(), Logger::kWarn);
+    LOG_DEBUG << "not recorded any more";
+    restoreOutput();
+
+    // Only the messages of the log level are output
+    ASSERT_EQ(outputLines().size(), 1UL);
+    EXPECT_NE(outputLines()[0].find("below warn"), std::string::npos);
+
+    auto lines = linesWith(dumpLines(), "recorded");
+    EXPECT_TRUE(lines.empty());
+    lines = linesWith(dumpLines(), " below ");
+    ASSERT_EQ(lines.size(), 3UL);
+    EXPECT_NE(lines[0].find(" DEBUG [TestBody] below debug - "),
+              std::string::npos);
+    EXPECT_NE(lines[1].find(" INFO  below info - "), std::string::npos);
+    EXPECT_EQ(lines[2], outputLines()[0]);
+}
+
+TEST(LogFlightRecorder, WarningsOutputAtAnyLevel)
+{
+    // As without the recorder, warnings are not gated by the log level
+    Logger::setLogLevel(Logger::kError);
+    captureOutput();
+    LogFlightRecorder::start(Logger::kDebug);
+    LOG_INFO << "level info";
+    LOG_WARN << "level warn";
+    LOG_ERROR << "level error";
+    LogFlightRecorder::stop();
+    restoreOutput();
+
+    ASSERT_EQ(outputLines().size(), 2UL);
+    EXPECT_NE(outputLines()[0].find("level warn"), std::string::npos);
+    EXPECT_NE(outputLines()[1].find("level error"), std::string::npos);
+    EXPECT_EQ(linesWith(dumpLines(), " level ").size(), 3UL);
+}
+
+TEST(LogFlightRecorder, KeepsTheLastMessagesOfEachThread)
+{
+    Logger::setLogLevel(Logger::kWarn);
+    LogFlightRecorder::start(Logger::kDebug);
+    const int kThreads = 4;
+    const int kMessages = 100000;
+    std::atomic<bool> done{false};
+    // Dumped while the threads log
+    std::thread dumper([&done]() {
+        while (!done)
+        {
+            for (auto &line : linesWith(dumpLines(), " wrap "))
+            {
+                ASSERT_EQ(line.back(), '\n') << line;
+                ASSERT_NE(line.find(" - LogFlightRecorderUnittest.cc:"),
+                          std::string::npos)
+                    << line;
+            }
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < kMessages; ++i)
+                LOG_DEBUG << "wrap " << t << " " << i;
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    done = true;
+    dumper.join();
+    LogFlightRecorder::stop();
+
+    auto lines = linesWith(dumpLines(), " wrap ");
+    // The oldest messages are overwritten
+    EXPECT_LT(lines.size(), static_cast<size_t>(kThreads * kMessages));
+    std::vector<int> last(kThreads, -1);
+    for (auto &line : lines)
+    {
+        auto pos = line.find(" wrap ");
+        int t = line[pos + 6] - '0';
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, kThreads);
+        int i = std::stoi(line.substr(pos + 8));
+        // Consecutive messages of each thread
+        if (last[t] >= 0)
+        {
+            EXPECT_EQ(i, last[t] + 1);
+        }
+        last[t] = i;
+    }
+    for (int t = 0; t < kThreads; ++t)
+        EXPECT_EQ(last[t], kMessages - 1);
+}
+
+TEST(LogFlightRecorder, DumpOnFatal)
+{
+    const std::string fileName = "./flight_recorder_fatal.log";
+    remove(fileName.c_str());
+    Logger::setLogLevel(Logger::kWarn);
+    captureOutput();
+    LogFlightRecorder::start(Logger::kDebug);
+    LogFlightRecorder::setDumpOnFatal(fileName);
+    LOG_DEBUG << "before the system error";
+    errno = 0;
+    LOG_SYSERR << "system error";
+    EXPECT_TRUE(readFile(fileName).empty());
+    LOG_DEBUG << "before the fatal error";
+    LOG_FATAL << "fatal error";
+    LogFlightRecorder::setDumpOnFatal("");
+    LogFlightRecorder::stop();
+    restoreOutput();
+
+    auto content = readFile(fileName);
+    remove(fileName.c_str());
+    auto before = content.find("before the fatal error");
+    ASSERT_NE(before, std::string::npos);
+    EXPECT_LT(content.find("before the system error"), before);
+    EXPECT_LT(content.find("system error - "), before);
+    EXPECT_LT(before, content.find(" FATAL fatal error - "));
+}
+
+TEST(LogFlightRecorder, NoDumpOnSysErrReports)
+{
+    const std::string fileName = "./flight_recorder_reports.log";
+    remove(fileName.c_str());
+    Logger::setLogLevel(Logger::kWarn);
+    captureOutput();
+    LogFlightRecorder::start(Logger::kDebug);
+    LogFlightRecorder::setDumpOnFatal(fileName);
+    LogRateLimiter::setReportInterval(0);
+    for (int i = 0; i < 4; ++i)
+    {
+        errno = 0;
+        LOG_SYSERR_FIRST_N(1) << "limited system error";
+    }
+    LogRateLimiter::setReportInterval(10000);
+    LogFlightRecorder::setDumpOnFatal("");
+    LogFlightRecorder::stop();
+    restoreOutput();
+
+    // The suppressed messages are reported as system errors
+    EXPECT_TRUE(readFile(fileName).empty());
+    remove(fileName.c_str());
+    ASSERT_EQ(outputLines().size(), 3UL);
+    EXPECT_NE(outputLines()[2].find("[1 suppressed] only the first 1 messages"),
+              std::string::npos);
+}
+
+#ifndef _WIN32
+TEST(LogFlightRecorder, DumpOnSignal)
+{
+    const std::string fileName = "./flight_recorder_signal.log";
+    remove(fileName.c_str());
+    Logger::setLogLevel(Logger::kWarn);
+    LogFlightRecorder::start(Logger::kDebug);
+    LogFlightRecorder::dumpOnSignal(SIGUSR2, fileName);
+    LOG_DEBUG << "before the signal";
+    raise(SIGUSR2);
+    std::string content;
+    for (int i = 0; i < 500; ++i)
+    {
+        content = readFile(fileName);
+        if (content.find("before the signal") != std::string::npos)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    LogFlightRecorder::stop();
+    remove(fileName.c_str());
+    EXPECT_NE(content.find("before the signal"), std::string::npos);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
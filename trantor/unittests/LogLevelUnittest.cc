@@ -0,0 +1,49 @@
+// Statements below WARN are compiled out in this file
+#define TRANTOR_MIN_LOG_LEVEL 3
+#include <trantor/utils/Logger.h>
+#include <trantor/utils/DeferredLogger.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+using namespace trantor;
+
+static std::vector<std::string> outputLines;
+
+static int evaluated(int &count)
+{
+    return ++count;
+}
+
+TEST(LogLevel, CompiledOut)
+{
+    Logger::setOutputFunction(
+        [](const char *msg, const uint64_t len) {
+            outputLines.emplace_back(msg, static_cast<size_t>(len));
+        },
+        []() {});
+    Logger::setLogLevel(Logger::kTrace);
+    int count = 0;
+    LOG_TRACE << evaluated(count);
+    LOG_DEBUG << evaluated(count);
+    LOG_INFO << evaluated(count);
+    LOG_INFO_IF(true) << evaluated(count);
+    LOG_COMPACT_DEBUG << evaluated(count);
+    LOG_DEFERRED_INFO << evaluated(count);
+    LOG_INFO_EVERY_N(1) << evaluated(count);
+    EXPECT_EQ(count, 0);
+    EXPECT_TRUE(outputLines.empty());
+
+    LOG_WARN << evaluated(count);
+    LOG_WARN_IF(count == 1) << evaluated(count);
+    LOG_ERROR << evaluated(count);
+    LOG_DEFERRED_WARN << evaluated(count);
+    LOG_WARN_EVERY_N(1) << evaluated(count);
+    EXPECT_EQ(count, 5);
+    EXPECT_EQ(outputLines.size(), 5UL);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
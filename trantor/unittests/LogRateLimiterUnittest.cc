@@ -0,0 +1,132 @@
+#include <trantor/utils/Logger.h>
+#include <gtest/gtest.h>
+#include "LogCapture.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace trantor;
+using namespace trantor::test;
+
+namespace
+{
+int evaluated(int &count)
+{
+    return ++count;
+}
+
+// The number of suppressed messages reported by a line
+uint64_t suppressedIn(const std::string &line)
+{
+    auto pos = line.find("[");
+    if (pos == std::string::npos ||
+        line.find(" suppressed]", pos) == std::string::npos)
+        return 0;
+    return std::stoull(line.substr(pos + 1));
+}
+}  // namespace
+
+TEST(LogRateLimiter, EveryN)
+{
+    captureOutput();
+    int count = 0;
+    for (int i = 0; i < 10; ++i)
+        LOG_WARN_EVERY_N(4) << "message " << evaluated(count);
+    restoreOutput();
+    // The arguments of the suppressed messages are not evaluated
+    ASSERT_EQ(count, 3);
+    ASSERT_EQ(outputLines().size(), 3UL);
+    EXPECT_NE(outputLines()[0].find(" WARN  message 1 - "), std::string::npos);
+    EXPECT_NE(outputLines()[1].find(" WARN  [3 suppressed] message 2 - "),
+              std::string::npos);
+    EXPECT_NE(outputLines()[2].find("[3 suppressed] message 3"),
+              std::string::npos);
+}
+
+TEST(LogRateLimiter, FirstN)
+{
+    captureOutput();
+    LogRateLimiter::setReportInterval(50);
+    int count = 0;
+    auto log = [&count]() { LOG_ERROR_FIRST_N(2) << evaluated(count); };
+    for (int i = 0; i < 5; ++i)
+        log();
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(outputLines().size(), 2UL);
+
+    // The suppressed messages are reported by a later one
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    log();
+    EXPECT_EQ(count, 2);
+    ASSERT_EQ(outputLines().size(), 3UL);
+    EXPECT_NE(outputLines()[2].find(
+                  " ERROR [4 suppressed] only the first 2 messages are logged"),
+              std::string::npos);
+    log();
+    restoreOutput();
+    EXPECT_EQ(outputLines().size(), 3UL);
+}
+
+TEST(LogRateLimiter, EveryMs)
+{
+    captureOutput();
+    auto log = []() { LOG_INFO_EVERY_MS(50) << "tick"; };
+    for (int i = 0; i < 100; ++i)
+        log();
+    EXPECT_EQ(outputLines().size(), 1UL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    log();
+    restoreOutput();
+    ASSERT_EQ(outputLines().size(), 2UL);
+    EXPECT_NE(outputLines()[1].find("[99 suppressed] tick"), std::string::npos);
+}
+
+TEST(LogRateLimiter, DisabledLevel)
+{
+    captureOutput();
+    auto level = Logger::logLevel();
+    Logger::setLogLevel(Logger::kInfo);
+    auto log = []() { LOG_DEBUG_EVERY_N(2) << "debug"; };
+    log();
+    log();
+    // The messages of a disabled level are not counted as suppressed
+    Logger::setLogLevel(Logger::kDebug);
+    log();
+    Logger::setLogLevel(level);
+    restoreOutput();
+    ASSERT_EQ(outputLines().size(), 1UL);
+    EXPECT_EQ(outputLines()[0].find("suppressed"), std::string::npos);
+}
+
+TEST(LogRateLimiter, Threads)
+{
+    const int kThreads = 4;
+    const int kMessages = 10000;
+    captureOutput();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([]() {
+            for (int i = 0; i < kMessages; ++i)
+                LOG_SYSERR_EVERY_N(100) << "syserr";
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    restoreOutput();
+    ASSERT_EQ(outputLines().size(),
+              static_cast<size_t>(kThreads * kMessages / 100));
+    uint64_t suppressed = 0;
+    for (auto &line : outputLines())
+        suppressed += suppressedIn(line);
+    // Only the messages suppressed after the last logged one are missing
+    EXPECT_LE(suppressed, static_cast<uint64_t>(kThreads * kMessages));
+    EXPECT_GE(suppressed + 99 + outputLines().size(),
+              static_cast<uint64_t>(kThreads * kMessages));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
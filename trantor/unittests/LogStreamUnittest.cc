@@ -0,0 +1,119 @@
+#include <trantor/utils/LogStream.h>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+using namespace trantor;
+
+namespace
+{
+template <typename T>
+std::string format(const T &v)
+{
+    LogStream stream;
+    stream << v;
+    return std::string(stream.bufferData(), stream.bufferLength());
+}
+}  // namespace
+
+TEST(LogStream, Integers)
+{
+    EXPECT_EQ(format(0), "0");
+    EXPECT_EQ(format(7), "7");
+    EXPECT_EQ(format(-10), "-10");
+    EXPECT_EQ(format(99), "99");
+    EXPECT_EQ(format(100), "100");
+    EXPECT_EQ(format(static_cast<short>(-12345)), "-12345");
+    EXPECT_EQ(format(1234567890123LL), "1234567890123");
+    EXPECT_EQ(format(std::numeric_limits<int>::min()), "-2147483648");
+    EXPECT_EQ(format(std::numeric_limits<unsigned int>::max()), "4294967295");
+    EXPECT_EQ(format(std::numeric_limits<int64_t>::min()),
+              "-9223372036854775808");
+    EXPECT_EQ(format(std::numeric_limits<uint64_t>::max()),
+              "18446744073709551615");
+
+    std::mt19937_64 rng(1);
+    for (int i = 0; i < 10000; ++i)
+    {
+        auto v = static_cast<int64_t>(rng() >> (rng() % 64));
+        if (i % 2)
+            v = -v;
+        EXPECT_EQ(format(v), std::to_string(v));
+    }
+}
+
+TEST(LogStream, Doubles)
+{
+    EXPECT_EQ(format(0.0), "0");
+    EXPECT_EQ(format(-0.0), "-0");
+    EXPECT_EQ(format(1.5), "1.5");
+    EXPECT_EQ(format(-42.0), "-42");
+    EXPECT_EQ(format(0.1), "0.1");
+    EXPECT_EQ(format(0.1 + 0.2), "0.30000000000000004");
+    EXPECT_EQ(format(1e16), "10000000000000000");
+    EXPECT_EQ(format(1e17), "1e+17");
+    EXPECT_EQ(format(0.0001), "0.0001");
+    EXPECT_EQ(format(0.00001), "1e-05");
+    EXPECT_EQ(format(1.25e-300), "1.25e-300");
+    EXPECT_EQ(format(5e-324), "5e-324");
+    EXPECT_EQ(format(std::numeric_limits<double>::max()),
+              "1.7976931348623157e+308");
+    EXPECT_EQ(format(std::numeric_limits<double>::infinity()), "inf");
+    EXPECT_EQ(format(-std::numeric_limits<double>::infinity()), "-inf");
+    EXPECT_EQ(format(std::numeric_limits<double>::quiet_NaN()), "nan");
+
+    std::mt19937_64 rng(2);
+    for (int i = 0; i < 100000; ++i)
+    {
+        uint64_t bits = rng();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if (v != v || v - v != 0)
+            continue;
+        auto str = format(v);
+        EXPECT_EQ(strtod(str.c_str(), nullptr), v) << str;
+    }
+}
+
+TEST(LogStream, Floats)
+{
+    EXPECT_EQ(format(0.1f), "0.1");
+    EXPECT_EQ(format(-2.5e-7f), "-2.5e-07");
+    EXPECT_EQ(format(16777216.0f), "16777216");
+    EXPECT_EQ(format(std::numeric_limits<float>::max()), "3.4028235e+38");
+    EXPECT_EQ(format(std::numeric_limits<float>::denorm_min()), "1e-45");
+
+    std::mt19937 rng(3);
+    for (int i = 0; i < 100000; ++i)
+    {
+        uint32_t bits = rng();
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        if (v != v || v - v != 0)
+            continue;
+        auto str = format(v);
+        EXPECT_EQ(strtof(str.c_str(), nullptr), v) << str;
+    }
+}
+
+TEST(LogStream, LongLines)
+{
+    LogStream stream;
+    std::string expected;
+    for (int i = 0; i < 1000; ++i)
+    {
+        stream << i << ' ' << 0.5 * i << ' ';
+        expected += std::to_string(i) + ' ' + format(0.5 * i) + ' ';
+    }
+    EXPECT_EQ(std::string(stream.bufferData(), stream.bufferLength()),
+              expected);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
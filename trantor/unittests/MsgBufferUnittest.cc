@@ -2,6 +2,9 @@
 #include <gtest/gtest.h>
 #include <string>
 #include <iostream>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 using namespace trantor;
 TEST(MsgBufferTest, readableTest)
 {
@@ -48,6 +51,20 @@ TEST(MsgBufferTest, addInFrontTest)
     EXPECT_EQ(84, buffer.writableBytes());
 }
 
+TEST(MsgBufferTest, shrinkToFitTest)
+{
+    MsgBuffer buffer(100);
+
+    buffer.append(std::string(10000, 'a'));
+    EXPECT_GE(buffer.capacity(), 10000);
+    buffer.retrieve(9990);
+    buffer.shrinkToFit(100);
+    EXPECT_LT(buffer.capacity(), 1000);
+    EXPECT_EQ(10, buffer.readableBytes());
+    EXPECT_EQ(std::string(10, 'a'), buffer.read(10));
+    EXPECT_EQ(100, buffer.writableBytes());
+}
+
 TEST(MsgBuffer, MoveContrustor)
 {
     MsgBuffer buf1(100);
@@ -71,6 +88,142 @@ TEST(Msgbuffer, MoveAssignmentOperator)
     EXPECT_EQ(bufptr, buffnew.peek());
     EXPECT_EQ(writable, buffnew.writableBytes());
 }
+TEST(MsgBufferTest, findTest)
+{
+    MsgBuffer buffer;
+    EXPECT_EQ(NULL, buffer.findCRLF());
+    EXPECT_EQ(NULL, buffer.find("ab"));
+    EXPECT_EQ(NULL, buffer.findAnyOf("ab"));
+    buffer.append("GET / HTTP/1.1\r\nHost: a\r\n\r\n");
+    EXPECT_EQ(buffer.peek() + 14, buffer.findCRLF());
+    EXPECT_EQ(buffer.peek() + 23, buffer.find("\r\n\r\n"));
+    EXPECT_EQ(buffer.peek() + 3, buffer.find(' '));
+    EXPECT_EQ(buffer.peek() + 3, buffer.findAnyOf(" /"));
+    EXPECT_EQ(buffer.peek() + 4, buffer.findAnyOf("/"));
+    EXPECT_EQ(NULL, buffer.find("HTTP/2"));
+    EXPECT_EQ(NULL, buffer.findAnyOf("xyz"));
+    buffer.retrieve(16);
+    EXPECT_EQ(buffer.peek() + 7, buffer.findCRLF());
+}
+TEST(MsgBufferTest, findAtAnyPosition)
+{
+    // Cover the vector loops and the scalar tails at every offset
+    const std::string delims[] = {"\r\n",
+                                  "--boundary",
+                                  "a",
+                                  "abcdefghijklmnopq"};
+    const std::string sets[] = {",;",
+                                "0123456789abcdef",
+                                "0123456789abcdefg"};
+    for (size_t size = 0; size < 70; ++size)
+    {
+        for (size_t pos = 0; pos <= size; ++pos)
+        {
+            for (auto &delim : delims)
+            {
+                MsgBuffer buffer;
+                buffer.append(std::string(pos, 'x'));
+                buffer.append(delim);
+                buffer.append(std::string(size - pos, 'x'));
+                // A partial match before the real one
+                buffer.addInFront(delim.data(), delim.size() - 1);
+                EXPECT_EQ(buffer.peek() + delim.size() - 1 + pos,
+                          buffer.find(delim));
+                buffer.retrieve(delim.size() - 1 + pos + 1);
+                EXPECT_EQ(NULL, buffer.find(delim));
+            }
+            for (auto &set : sets)
+            {
+                MsgBuffer buffer;
+                buffer.append(std::string(pos, 'x'));
+                buffer.append(set.substr(set.size() - 1));
+                buffer.append(std::string(size - pos, 'x'));
+                EXPECT_EQ(buffer.peek() + pos, buffer.findAnyOf(set));
+                buffer.retrieve(pos + 1);
+                EXPECT_EQ(NULL, buffer.findAnyOf(set));
+            }
+        }
+    }
+}
+#ifndef _WIN32
+TEST(MsgBufferTest, readFdWithLength)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::string data(40000, 'r');
+    ASSERT_EQ(static_cast<ssize_t>(data.size()),
+              write(fds[1], data.data(), data.size()));
+    MsgBuffer buffer(100);
+    int err = 0;
+    // Small sizes don't grow the buffer beyond what the data needs
+    EXPECT_EQ(100 + 8192, buffer.readFd(fds[0], &err, 1000));
+    EXPECT_EQ(100 + 8192, buffer.readableBytes());
+    // Large sizes are read directly in one call
+    EXPECT_EQ(data.size() - 100 - 8192,
+              buffer.readFd(fds[0], &err, data.size()));
+    EXPECT_EQ(data, std::string(buffer.peek(), buffer.readableBytes()));
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+#ifdef __linux__
+TEST(MsgBufferTest, ringBuffer)
+{
+    MsgBuffer buffer;
+    buffer.append("abc");
+    ASSERT_TRUE(buffer.enableRingBuffer(100));
+    EXPECT_TRUE(buffer.isRingBuffer());
+    size_t capacity = buffer.capacity();
+    EXPECT_GE(capacity, 100);
+    EXPECT_EQ("abc", buffer.read(3));
+    // Wrap around many times, the readable data stays contiguous
+    std::string expected;
+    size_t written = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::string chunk(capacity / 3 + i % 7,
+                          static_cast<char>('a' + i % 26));
+        buffer.append(chunk);
+        written += chunk.size();
+        expected.append(chunk);
+        if (buffer.readableBytes() > capacity / 2)
+        {
+            size_t len = buffer.readableBytes() - 10;
+            EXPECT_EQ(expected.substr(0, len), buffer.read(len));
+            expected.erase(0, len);
+        }
+        EXPECT_EQ(expected,
+                  std::string(buffer.peek(), buffer.readableBytes()));
+    }
+    EXPECT_GT(written, capacity * 100);
+    EXPECT_EQ(capacity, buffer.capacity());
+
+    // Prepending wraps backwards
+    buffer.retrieveAll();
+    buffer.append("world");
+    buffer.addInFront("hello ", 6);
+    EXPECT_EQ("hello world", buffer.read(11));
+
+    // Copies and moves keep the mode
+    buffer.append("xyz");
+    MsgBuffer copy(buffer);
+    EXPECT_TRUE(copy.isRingBuffer());
+    EXPECT_EQ("xyz", copy.read(3));
+    MsgBuffer moved(std::move(copy));
+    EXPECT_TRUE(moved.isRingBuffer());
+    MsgBuffer normal;
+    normal.swap(buffer);
+    EXPECT_FALSE(buffer.isRingBuffer());
+    EXPECT_TRUE(normal.isRingBuffer());
+    EXPECT_EQ("xyz", normal.read(3));
+
+    // Grows when too much data is pending
+    normal.append(std::string(capacity * 3, 'g'));
+    EXPECT_TRUE(normal.isRingBuffer());
+    EXPECT_GE(normal.capacity(), capacity * 3);
+    EXPECT_EQ(std::string(capacity * 3, 'g'), normal.read(capacity * 3));
+}
+#endif
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
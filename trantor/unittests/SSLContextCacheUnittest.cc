@@ -0,0 +1,60 @@
+#include <trantor/net/TcpConnection.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+using namespace trantor;
+
+static SSLContextPtr tryGetContext(const TLSPolicy &policy, bool server)
+{
+    try
+    {
+        return getSharedSSLContext(policy, server);
+    }
+    catch (const std::runtime_error &)
+    {
+        // built without TLS support
+        return nullptr;
+    }
+}
+
+TEST(SSLContextCache, SharedByEquivalentPolicies)
+{
+    auto policy1 = TLSPolicy::defaultClientPolicy("example.com");
+    policy1->setValidate(false);
+    auto ctx1 = tryGetContext(*policy1, false);
+    if (!ctx1)
+        GTEST_SKIP() << "TLS is not supported";
+
+    // The hostname is set per connection, it does not change the context
+    auto policy2 = TLSPolicy::defaultClientPolicy("example.org");
+    policy2->setValidate(false);
+    EXPECT_EQ(ctx1, tryGetContext(*policy2, false));
+
+    policy2->setAlpnProtocols({"h2"});
+    auto ctx2 = tryGetContext(*policy2, false);
+    EXPECT_NE(ctx1, ctx2);
+    EXPECT_EQ(ctx2, tryGetContext(*policy2, false));
+}
+
+TEST(SSLContextCache, Invalidate)
+{
+    auto policy = TLSPolicy::defaultClientPolicy();
+    policy->setValidate(false).setConfCmds({{"MinProtocol", "TLSv1.2"}});
+    auto ctx1 = tryGetContext(*policy, false);
+    if (!ctx1)
+        GTEST_SKIP() << "TLS is not supported";
+    EXPECT_EQ(ctx1, tryGetContext(*policy, false));
+
+    invalidateSharedSSLContext(*policy, false);
+    auto ctx2 = tryGetContext(*policy, false);
+    EXPECT_NE(ctx1, ctx2);
+    EXPECT_EQ(ctx2, tryGetContext(*policy, false));
+
+    clearSharedSSLContexts();
+    EXPECT_NE(ctx2, tryGetContext(*policy, false));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,157 @@
+#include <trantor/utils/SegmentedBuffer.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+using namespace trantor;
+TEST(SegmentedBufferTest, appendTest)
+{
+    SegmentedBuffer buffer;
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(0, buffer.segmentCount());
+    std::string data(SegmentedBuffer::kBlockSize * 2 + 100, 'a');
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>('a' + i % 26);
+    buffer.append(data);
+    EXPECT_EQ(data.size(), buffer.readableBytes());
+    EXPECT_EQ(3, buffer.segmentCount());
+    buffer.retrieve(10);
+    EXPECT_EQ(data.substr(10, 20), buffer.read(20));
+    EXPECT_EQ(data.substr(30), buffer.read(data.size()));
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(0, buffer.segmentCount());
+}
+TEST(SegmentedBufferTest, prependTest)
+{
+    SegmentedBuffer buffer;
+    buffer.append(std::string("world"));
+    buffer.prepend("hello ", 6);
+    EXPECT_EQ(2, buffer.segmentCount());
+    buffer.prepend(">", 1);
+    EXPECT_EQ(2, buffer.segmentCount());
+    buffer.retrieve(3);
+    buffer.prepend("he", 2);
+    EXPECT_EQ(2, buffer.segmentCount());
+    EXPECT_EQ("hello world", buffer.read(100));
+}
+TEST(SegmentedBufferTest, spliceTest)
+{
+    SegmentedBuffer a, b, c;
+    a.append(std::string("bbb"));
+    b.append(std::string("ccc"));
+    c.append(std::string("aaa"));
+    a.append(std::move(b));
+    a.prepend(std::move(c));
+    EXPECT_TRUE(b.empty());
+    EXPECT_TRUE(c.empty());
+    EXPECT_EQ(3, a.segmentCount());
+    EXPECT_EQ(9, a.readableBytes());
+    SegmentedBuffer d(std::move(a));
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ("aaabbbccc", d.read(9));
+}
+TEST(SegmentedBufferTest, contiguousTest)
+{
+    SegmentedBuffer buffer;
+    buffer.append(std::string("abc"));
+    SegmentedBuffer tail;
+    tail.append(std::string("defg"));
+    buffer.append(std::move(tail));
+    size_t len;
+    buffer.peek(len);
+    EXPECT_EQ(3, len);
+    const char *data = buffer.contiguous(5);
+    EXPECT_EQ("abcde", std::string(data, 5));
+    EXPECT_EQ(7, buffer.readableBytes());
+    EXPECT_EQ("abcdefg", buffer.read(7));
+    buffer.append(std::string("xyz"));
+    data = buffer.contiguous(2);
+    EXPECT_EQ("xy", std::string(data, 2));
+    EXPECT_EQ(1, buffer.segmentCount());
+}
+TEST(SegmentedBufferTest, sliceTest)
+{
+    BufferSlice slice;
+    EXPECT_TRUE(slice.empty());
+    {
+        SegmentedBuffer buffer;
+        buffer.append(std::string("hello world"));
+        slice = buffer.readSlice(5);
+        EXPECT_EQ(6, buffer.readableBytes());
+        // Must not overwrite the sliced bytes
+        buffer.prepend("12345", 5);
+        buffer.append(std::string("!"));
+        EXPECT_EQ("12345 world!", buffer.read(100));
+        EXPECT_EQ("hello", slice.toString());
+    }
+    // The storage outlives the buffer
+    EXPECT_EQ("hello", slice.toString());
+    auto sub = slice.subSlice(1, 3);
+    EXPECT_EQ("ell", sub.toString());
+    EXPECT_EQ("llo", slice.subSlice(2).toString());
+    EXPECT_TRUE(slice.subSlice(5).empty());
+    BufferSlice moved(std::move(slice));
+    EXPECT_TRUE(slice.empty());
+    EXPECT_EQ("hello", moved.toString());
+    moved = sub;
+    EXPECT_EQ("ell", moved.toString());
+}
+TEST(SegmentedBufferTest, sliceAcrossBlocks)
+{
+    SegmentedBuffer buffer;
+    std::string data(SegmentedBuffer::kBlockSize + 10, 'z');
+    buffer.append(std::string(SegmentedBuffer::kBlockSize - 10, 'a'));
+    buffer.append(data);
+    buffer.retrieve(SegmentedBuffer::kBlockSize - 10);
+    EXPECT_EQ(2, buffer.segmentCount());
+    auto slice = buffer.readSlice(data.size());
+    EXPECT_TRUE(buffer.empty());
+    // Released in another thread
+    std::thread([slice]() {
+        EXPECT_EQ(std::string(SegmentedBuffer::kBlockSize + 10, 'z'),
+                  slice.toString());
+    }).join();
+    EXPECT_EQ(data, slice.toString());
+}
+#ifndef _WIN32
+TEST(SegmentedBufferTest, readFdTest)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::string data(SegmentedBuffer::kBlockSize + 1000, 'x');
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>(i % 251);
+    ASSERT_EQ(static_cast<ssize_t>(data.size()),
+              write(fds[1], data.data(), data.size()));
+    SegmentedBuffer buffer;
+    buffer.append(std::string("head"));
+    int err = 0;
+    ssize_t n = 0;
+    size_t total = 0;
+    while (total < data.size())
+    {
+        n = buffer.readFd(fds[0], &err);
+        ASSERT_GT(n, 0);
+        total += n;
+    }
+    EXPECT_EQ(data.size() + 4, buffer.readableBytes());
+    EXPECT_EQ(2, buffer.segmentCount());
+
+    struct iovec vec[4];
+    EXPECT_EQ(2, buffer.peekSegments(vec, 4));
+    EXPECT_EQ(1, buffer.peekSegments(vec, 1));
+    EXPECT_EQ(SegmentedBuffer::kBlockSize, vec[0].iov_len);
+    EXPECT_EQ("head", buffer.read(4));
+    EXPECT_EQ(data, buffer.read(data.size()));
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,247 @@
+#include <trantor/utils/Logger.h>
+#include <gtest/gtest.h>
+#include "LogCapture.h"
+#include <random>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+using namespace trantor;
+using namespace trantor::test;
+
+namespace
+{
+std::string toString(const LogStream &stream)
+{
+    return std::string(stream.bufferData(), stream.bufferLength());
+}
+
+// A byte at a time, the reference of the vectorized escaping
+std::string escape(const std::string &str)
+{
+    std::string result;
+    for (char c : str)
+    {
+        switch (c)
+        {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            case '\n':
+                result += "\\n";
+                break;
+            case '\r':
+                result += "\\r";
+                break;
+            case '\t':
+                result += "\\t";
+                break;
+            case '\b':
+                result += "\\b";
+                break;
+            case '\f':
+                result += "\\f";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04X", c);
+                    result += buf;
+                }
+                else
+                {
+                    result += c;
+                }
+        }
+    }
+    return result;
+}
+
+// The line from the key, without the fields before it
+std::string fromKey(const std::string &line, const std::string &key)
+{
+    auto pos = line.find(key);
+    return pos == std::string::npos ? line : line.substr(pos);
+}
+}  // namespace
+
+TEST(StructuredLog, TextFields)
+{
+    LogStream stream;
+    std::string path = "/a b";
+    stream << "done" << LogField("status", 200) << LogField("path", path)
+           << LogField("ok", true) << LogField("ratio", 0.5)
+           << LogField("size", static_cast<uint64_t>(1) << 40)
+           << LogField("user", nullptr) << LogField("empty", "")
+           << LogField("sep", '=');
+    EXPECT_EQ(toString(stream),
+              "done status=200 path=\"/a b\" ok=true ratio=0.5 "
+              "size=1099511627776 user=null empty=\"\" sep=\"=\"");
+}
+
+TEST(StructuredLog, Json)
+{
+    LogStream stream;
+    stream.beginRecord(LogFormat::Json);
+    stream << LogField("level", "info") << "say \"hi\"\n"
+           << LogField("n", -3) << LogField("x", 1e17)
+           << LogField("nan", std::nan("")) << LogField("key\"", "v\\")
+           << " then " << 42;
+    stream.endRecord();
+    EXPECT_EQ(toString(stream),
+              "{\"level\":\"info\",\"msg\":\"say \\\"hi\\\"\\n\",\"n\":-3,"
+              "\"x\":1e+17,\"nan\":\"nan\",\"key\\\"\":\"v\\\\\","
+              "\"text\":\" then 42\"}\n");
+
+    // Without a message
+    stream.resetBuffer();
+    stream.beginRecord(LogFormat::Json);
+    stream << LogField("a", 1);
+    stream.endRecord();
+    EXPECT_EQ(toString(stream), "{\"a\":1}\n");
+}
+
+TEST(StructuredLog, Logfmt)
+{
+    LogStream stream;
+    stream.beginRecord(LogFormat::Logfmt);
+    stream << LogField("level", "warn") << 3 << " retries"
+           << LogField("host", "example.com") << LogField("q", "a=b")
+           << LogField("tab", "\t") << LogField("utf8", "h\xC3\xA9");
+    stream.endRecord();
+    EXPECT_EQ(toString(stream),
+              "level=warn msg=\"3 retries\" host=example.com q=\"a=b\" "
+              "tab=\"\\t\" utf8=h\xC3\xA9\n");
+}
+
+TEST(StructuredLog, Escaping)
+{
+    // Long strings with the bytes to escape anywhere in the vectors
+    std::mt19937 rng(1);
+    const char special[] = "\"\\\n\x01\x1f ";
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string str(rng() % 100, 'a');
+        for (auto &c : str)
+        {
+            auto r = rng() % 16;
+            if (r < sizeof(special) - 1)
+                c = special[r];
+            else if (r == 15)
+                c = static_cast<char>(0x80 + rng() % 0x80);
+        }
+        LogStream stream;
+        stream.beginRecord(LogFormat::Json);
+        stream << LogField("s", str);
+        ASSERT_EQ(toString(stream), "{\"s\":\"" + escape(str) + "\"") << i;
+    }
+}
+
+TEST(StructuredLog, LargeMessage)
+{
+    // Beyond the fixed buffer of the stream
+    std::string str(10000, 'x');
+    str[5000] = '"';
+    LogStream stream;
+    stream.beginRecord(LogFormat::Logfmt);
+    stream << LogField("a", 1) << LogField("s", str);
+    stream.endRecord();
+    EXPECT_EQ(toString(stream), "a=1 s=\"" + escape(str) + "\"\n");
+}
+
+TEST(StructuredLog, LoggerJson)
+{
+    Logger::setLogFormat(LogFormat::Json);
+    captureOutput();
+    Logger::setDisplayLocalTime(false);
+    LOG_INFO << "request done" << LogField("status", 200);
+    int line = __LINE__ - 1;
+    LOG_WARN << LogField("queue", 10);
+    errno = ENOENT;
+    LOG_SYSERR << "open failed";
+    restoreOutput();
+
+    ASSERT_EQ(outputLines().size(), 3UL);
+    auto &first = outputLines()[0];
+    // {"time":"2024-01-01T12:00:00.000000Z","level":"info","thread":1234,
+    ASSERT_EQ(first.compare(0, 9, "{\"time\":\""), 0) << first;
+    EXPECT_EQ(first[13], '-');
+    EXPECT_EQ(first[19], 'T');
+    EXPECT_EQ(first.substr(35, 2), "Z\"");
+    const std::string level = ",\"level\":\"info\",\"thread\":";
+    auto pos = first.find(level);
+    ASSERT_NE(pos, std::string::npos) << first;
+    EXPECT_EQ(first.substr(first.find(',', pos + level.length())),
+              ",\"msg\":\"request done\",\"status\":200,"
+              "\"file\":\"StructuredLogUnittest.cc\",\"line\":" +
+                  std::to_string(line) + "}\n");
+    EXPECT_NE(outputLines()[1].find(",\"level\":\"warn\","), std::string::npos);
+    EXPECT_NE(outputLines()[1].find(",\"queue\":10,\"file\":"),
+              std::string::npos);
+    EXPECT_NE(outputLines()[2].find(",\"error\":\"" +
+                                  std::string(strerror(ENOENT)) +
+                                  "\",\"errno\":" + std::to_string(ENOENT) +
+                                  ",\"msg\":\"open failed\""),
+              std::string::npos)
+        << outputLines()[2];
+}
+
+TEST(StructuredLog, LoggerLogfmt)
+{
+    auto level = Logger::logLevel();
+    Logger::setLogLevel(Logger::kDebug);
+    Logger::setLogFormat(LogFormat::Logfmt);
+    captureOutput();
+    LOG_DEBUG << "cache miss" << LogField("key", "user 1");
+    restoreOutput();
+    Logger::setLogLevel(level);
+
+    ASSERT_EQ(outputLines().size(), 1UL);
+    auto &line = outputLines()[0];
+    EXPECT_EQ(line.compare(0, 5, "time="), 0) << line;
+    auto message = fromKey(line, " func=");
+    EXPECT_EQ(message.substr(0, message.find(" line=")),
+              " func=TestBody msg=\"cache miss\" key=\"user 1\" "
+              "file=StructuredLogUnittest.cc");
+    EXPECT_NE(line.find(" level=debug thread="), std::string::npos);
+    EXPECT_EQ(line.back(), '\n');
+}
+
+TEST(StructuredLog, LoggerText)
+{
+    Logger::setLogFormat(LogFormat::Text);
+    captureOutput();
+    LOG_INFO << "request done" << LogField("status", 200);
+    restoreOutput();
+    ASSERT_EQ(outputLines().size(), 1UL);
+    EXPECT_NE(outputLines()[0].find(" INFO  request done status=200 - "
+                                  "StructuredLogUnittest.cc:"),
+              std::string::npos);
+}
+
+TEST(StructuredLog, LostMessages)
+{
+    LogStream text, json, logfmt;
+    Logger::formatLostMessages(text, 3);
+    Logger::setLogFormat(LogFormat::Json);
+    Logger::formatLostMessages(json, 3);
+    Logger::setLogFormat(LogFormat::Logfmt);
+    Logger::formatLostMessages(logfmt, 3);
+    Logger::setLogFormat(LogFormat::Text);
+    EXPECT_EQ(toString(text), "3 log information is lost\n");
+    EXPECT_EQ(toString(json),
+              "{\"level\":\"error\",\"msg\":\"log information is lost\","
+              "\"lost\":3}\n");
+    EXPECT_EQ(toString(logfmt),
+              "level=error msg=\"log information is lost\" lost=3\n");
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+#include <trantor/net/TcpClient.h>
+#include <trantor/net/TcpServer.h>
+#include <trantor/net/EventLoopThread.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <thread>
+using namespace trantor;
+
+namespace
+{
+template <typename Pred>
+bool waitFor(Pred pred)
+{
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (pred())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return pred();
+}
+}  // namespace
+
+// The reads filling the read size are followed by another read, which finds
+// the socket drained and must not close the connection
+TEST(TcpConnection, LargeReadKeepsConnection)
+{
+    const size_t kTotal = 8 * 1024 * 1024;
+    EventLoopThread serverThread;
+    EventLoopThread clientThread;
+    serverThread.run();
+    clientThread.run();
+
+    std::atomic<size_t> received{0};
+    std::atomic<bool> serverClosed{false};
+    TcpServer server(serverThread.getLoop(),
+                     InetAddress("127.0.0.1", 0),
+                     "large_read_test");
+    server.setRecvMessageCallback(
+        [&received, kTotal](const TcpConnectionPtr &conn, MsgBuffer *buffer) {
+            received += buffer->readableBytes();
+            buffer->retrieveAll();
+            if (received == kTotal)
+                conn->send("ok");
+        });
+    server.setConnectionCallback(
+        [&serverClosed](const TcpConnectionPtr &conn) {
+            if (conn->disconnected())
+                serverClosed = true;
+        });
+    server.start();
+    // The server listens in its loop
+    std::atomic<bool> listening{false};
+    serverThread.getLoop()->queueInLoop(
+        [&listening]() { listening = true; });
+    EXPECT_TRUE(waitFor([&listening]() { return listening.load(); }));
+
+    std::atomic<bool> replied{false};
+    std::atomic<bool> clientClosed{false};
+    auto client = std::make_shared<TcpClient>(clientThread.getLoop(),
+                                              server.address(),
+                                              "client");
+    client->setConnectionCallback(
+        [&clientClosed, kTotal](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+                conn->send(std::string(kTotal, 'x'));
+            else
+                clientClosed = true;
+        });
+    client->setMessageCallback(
+        [&replied](const TcpConnectionPtr &, MsgBuffer *buffer) {
+            if (buffer->readableBytes() >= 2)
+                replied = true;
+        });
+    client->connect();
+
+    EXPECT_TRUE(waitFor([&replied]() { return replied.load(); }));
+    EXPECT_EQ(received, kTotal);
+    EXPECT_FALSE(serverClosed);
+    EXPECT_FALSE(clientClosed);
+    client->disconnect();
+    EXPECT_TRUE(waitFor([&serverClosed]() { return serverClosed.load(); }));
+    server.stop();
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
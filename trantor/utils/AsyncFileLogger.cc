@@ -14,48 +14,572 @@
 
 #include <trantor/utils/AsyncFileLogger.h>
 #include <trantor/utils/Utilities.h>
+#include <trantor/utils/BufferPool.h>
+#include <trantor/utils/LogRing.h>
 #if !defined(_WIN32) || defined(__MINGW32__)
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #ifdef __linux__
 #include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #endif
 #else
 #include <windows.h>
 #endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 #include <string.h>
+#include <assert.h>
 #include <algorithm>
 #include <iostream>
 #include <functional>
 #include <chrono>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <queue>
+#include <stdexcept>
 
 namespace trantor
 {
 static constexpr std::chrono::seconds kLogFlushTimeout{1};
 static constexpr size_t kMemBufferSize{4 * 1024 * 1024};
+// How often the logger thread collects the per-thread buffers
+static constexpr std::chrono::milliseconds kThreadBufferPollInterval{50};
+static constexpr size_t kCompressionChunkSize{256 * 1024};
+// How much a mapped log file is extended and mapped at once
+static constexpr uint64_t kMappedFileStep{16 * 1024 * 1024};
 extern const char *strerror_tl(int savedErrno);
 }  // namespace trantor
 
 using namespace trantor;
 
+static void reserveLogBuffer(std::string &buffer)
+{
+    buffer.reserve(kMemBufferSize);
+    detail::adviseHugePages(&buffer[0], buffer.capacity());
+}
+
+static const char *compressedSuffix(AsyncFileLogger::Compression compression)
+{
+    switch (compression)
+    {
+        case AsyncFileLogger::Compression::Gzip:
+            return ".gz";
+        case AsyncFileLogger::Compression::Zstd:
+            return ".zst";
+        default:
+            return "";
+    }
+}
+
+// The suffix of the output of a compression until it is complete
+static const char kTemporarySuffix[] = ".tmp";
+
+static FILE *openLogFile(const std::string &fileName, bool write)
+{
+#ifndef _MSC_VER
+    return fopen(fileName.c_str(), write ? "wb" : "rb");
+#else
+    // Convert UTF-8 file to UCS-2
+    auto wName{utils::toNativePath(fileName)};
+    return _wfopen(wName.c_str(), write ? L"wb" : L"rb");
+#endif
+}
+
+static int removeLogFile(const std::string &fileName)
+{
+#if !defined(_WIN32) || defined(__MINGW32__)
+    return remove(fileName.c_str());
+#else
+    // Convert UTF-8 file to UCS-2
+    auto wName{utils::toNativePath(fileName)};
+    return _wremove(wName.c_str());
+#endif
+}
+
+static int renameLogFile(const std::string &from, const std::string &to)
+{
+#if !defined(_WIN32) || defined(__MINGW32__)
+    return rename(from.c_str(), to.c_str());
+#else
+    // Convert UTF-8 file to UCS-2
+    auto wFrom{utils::toNativePath(from)};
+    auto wTo{utils::toNativePath(to)};
+    _wremove(wTo.c_str());
+    return _wrename(wFrom.c_str(), wTo.c_str());
+#endif
+}
+
+#ifdef USE_ZLIB
+static bool gzipStream(FILE *in, FILE *out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 15 + 16: the largest window with a gzip header
+    if (deflateInit2(&stream,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     15 + 16,
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    std::vector<char> input(kCompressionChunkSize);
+    std::vector<char> output(kCompressionChunkSize);
+    bool ok = true;
+    int flush;
+    do
+    {
+        size_t n = fread(input.data(), 1, input.size(), in);
+        if (ferror(in))
+        {
+            ok = false;
+            break;
+        }
+        flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef *>(input.data());
+        stream.avail_in = static_cast<uInt>(n);
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = static_cast<uInt>(output.size());
+            deflate(&stream, flush);
+            size_t length = output.size() - stream.avail_out;
+            if (fwrite(output.data(), 1, length, out) != length)
+                ok = false;
+        } while (ok && stream.avail_out == 0);
+    } while (ok && flush != Z_FINISH);
+    deflateEnd(&stream);
+    return ok;
+}
+#endif
+
+#ifdef USE_ZSTD
+static bool zstdStream(FILE *in, FILE *out)
+{
+    auto context = ZSTD_createCCtx();
+    if (!context)
+        return false;
+    std::vector<char> input(kCompressionChunkSize);
+    std::vector<char> output(kCompressionChunkSize);
+    bool ok = true;
+    bool last;
+    do
+    {
+        size_t n = fread(input.data(), 1, input.size(), in);
+        if (ferror(in))
+        {
+            ok = false;
+            break;
+        }
+        last = feof(in) != 0;
+        auto mode = last ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer inBuffer{input.data(), n, 0};
+        bool done;
+        do
+        {
+            ZSTD_outBuffer outBuffer{output.data(), output.size(), 0};
+            size_t remaining =
+                ZSTD_compressStream2(context, &outBuffer, &inBuffer, mode);
+            if (ZSTD_isError(remaining) ||
+                fwrite(output.data(), 1, outBuffer.pos, out) != outBuffer.pos)
+            {
+                ok = false;
+                break;
+            }
+            done = last ? remaining == 0 : inBuffer.pos == inBuffer.size;
+        } while (!done);
+    } while (ok && !last);
+    ZSTD_freeCCtx(context);
+    return ok;
+}
+#endif
+
+static bool compressStream(FILE *in,
+                           FILE *out,
+                           AsyncFileLogger::Compression compression)
+{
+    switch (compression)
+    {
+#ifdef USE_ZLIB
+        case AsyncFileLogger::Compression::Gzip:
+            return gzipStream(in, out);
+#endif
+#ifdef USE_ZSTD
+        case AsyncFileLogger::Compression::Zstd:
+            return zstdStream(in, out);
+#endif
+        default:
+            return false;
+    }
+}
+
+// Replace the file with its compressed version. The output is written to a
+// temporary file first, so that a partial output is never taken for a
+// compressed log.
+static void compressLogFile(const std::string &fileName,
+                            AsyncFileLogger::Compression compression)
+{
+    FILE *in = openLogFile(fileName, false);
+    if (!in)
+    {
+        // Already deleted
+        if (errno != ENOENT)
+            fprintf(stderr,
+                    "Can't open file %s: %s\n",
+                    fileName.c_str(),
+                    strerror_tl(errno));
+        return;
+    }
+    std::string outName = fileName + compressedSuffix(compression);
+    std::string tmpName = outName + kTemporarySuffix;
+    FILE *out = openLogFile(tmpName, true);
+    if (!out)
+    {
+        fprintf(stderr,
+                "Can't open file %s: %s\n",
+                tmpName.c_str(),
+                strerror_tl(errno));
+        fclose(in);
+        return;
+    }
+    bool ok = compressStream(in, out, compression);
+    fclose(in);
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok || renameLogFile(tmpName, outName) != 0)
+    {
+        fprintf(stderr, "Failed to compress file %s\n", fileName.c_str());
+        removeLogFile(tmpName);
+        return;
+    }
+    removeLogFile(fileName);
+}
+
+// Remove a log file and its compressed versions, complete or not
+static void removeLogFiles(const std::string &fileName)
+{
+    int r = removeLogFile(fileName);
+    int savedErrno = errno;
+    for (auto compression : {AsyncFileLogger::Compression::Gzip,
+                             AsyncFileLogger::Compression::Zstd})
+    {
+        std::string compressedName = fileName + compressedSuffix(compression);
+        if (removeLogFile(compressedName) == 0)
+            r = 0;
+        removeLogFile(compressedName + kTemporarySuffix);
+    }
+    if (r != 0 && savedErrno != ENOENT)
+    {
+        fprintf(stderr,
+                "Failed to remove file %s: %s\n",
+                fileName.c_str(),
+                strerror_tl(savedErrno));
+    }
+}
+
+// Run the compression of the switched files and their deletion in order, in
+// a thread which does not compete with the application for the CPU and the
+// disk.
+class AsyncFileLogger::LoggerFile::Compressor : NonCopyable
+{
+  public:
+    Compressor() : thread_(&Compressor::threadFunc, this)
+    {
+    }
+    // The pending tasks are run first
+    ~Compressor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        thread_.join();
+    }
+    void run(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cond_.notify_one();
+    }
+
+  private:
+    void threadFunc()
+    {
+#ifdef __linux__
+        prctl(PR_SET_NAME, "LogCompressor");
+        // The nice value and the IO priority of a Linux thread are its own
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#ifdef SYS_ioprio_set
+        // IOPRIO_WHO_PROCESS of the calling thread, IOPRIO_CLASS_IDLE
+        syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+#elif defined(_WIN32)
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            while (!stop_ && tasks_.empty())
+                cond_.wait_for(lock, kLogFlushTimeout);
+            if (tasks_.empty())
+                return;
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_{false};
+    std::thread thread_;
+};
+
+#ifndef _WIN32
+// A log file written through a shared mapping. The mapping moves along the
+// file in steps of kMappedFileStep, the file is extended to the end of the
+// mapping and truncated to the length of its content when it is closed.
+class AsyncFileLogger::LoggerFile::MappedFile : NonCopyable
+{
+  public:
+    static std::unique_ptr<MappedFile> open(const std::string &fileName)
+    {
+        int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        std::unique_ptr<MappedFile> file(
+            new MappedFile(fd, static_cast<uint64_t>(st.st_size)));
+        file->findEnd();
+        return file;
+    }
+    ~MappedFile()
+    {
+        unmap();
+        if (ftruncate(fd_, static_cast<off_t>(length_)) != 0)
+        {
+            fprintf(stderr,
+                    "Failed to truncate log file: %s\n",
+                    strerror_tl(errno));
+        }
+        ::close(fd_);
+    }
+    void write(const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            if (!data_ || length_ == mapOffset_ + kMappedFileStep)
+            {
+                if (!map())
+                {
+                    writeDirectly(data, len);
+                    return;
+                }
+            }
+            auto n = static_cast<size_t>(
+                std::min<uint64_t>(len,
+                                   mapOffset_ + kMappedFileStep - length_));
+            memcpy(data_ + (length_ - mapOffset_), data, n);
+            length_ += n;
+            data += n;
+            len -= n;
+        }
+    }
+    uint64_t length() const
+    {
+        return length_;
+    }
+
+  private:
+    MappedFile(int fd, uint64_t fileSize)
+        : fd_(fd), length_(fileSize), fileSize_(fileSize)
+    {
+    }
+    // The file keeps the zeros after its content when the process crashed
+    // while it was mapped, the content ends at the last non-zero byte.
+    void findEnd()
+    {
+        char buf[64 * 1024];
+        while (length_ > 0)
+        {
+            auto n = static_cast<size_t>(
+                std::min<uint64_t>(length_, sizeof(buf)));
+            auto offset = static_cast<off_t>(length_ - n);
+            if (pread(fd_, buf, n, offset) != static_cast<ssize_t>(n))
+                break;
+            size_t i = n;
+            while (i > 0 && buf[i - 1] == '\0')
+                --i;
+            length_ -= n - i;
+            if (i > 0)
+                break;
+        }
+    }
+    bool map()
+    {
+        unmap();
+        static const uint64_t pageSize =
+            static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        mapOffset_ = length_ - length_ % pageSize;
+        auto end = mapOffset_ + kMappedFileStep;
+        if (end > fileSize_)
+        {
+#ifdef __linux__
+            // Allocate the blocks, so that a full disk fails here instead of
+            // raising SIGBUS on a write into the mapping
+            int err = posix_fallocate(fd_,
+                                      static_cast<off_t>(fileSize_),
+                                      static_cast<off_t>(end - fileSize_));
+#else
+            int err = ftruncate(fd_, static_cast<off_t>(end)) == 0 ? 0 : errno;
+#endif
+            if (err != 0)
+            {
+                fprintf(stderr,
+                        "Failed to extend log file: %s\n",
+                        strerror_tl(err));
+                return false;
+            }
+            fileSize_ = end;
+        }
+        void *data = mmap(nullptr,
+                          kMappedFileStep,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          fd_,
+                          static_cast<off_t>(mapOffset_));
+        if (data == MAP_FAILED)
+        {
+            fprintf(stderr,
+                    "Failed to map log file: %s\n",
+                    strerror_tl(errno));
+            return false;
+        }
+        data_ = static_cast<char *>(data);
+        return true;
+    }
+    void unmap()
+    {
+        if (data_)
+        {
+            munmap(data_, kMappedFileStep);
+            data_ = nullptr;
+        }
+    }
+    // Used when the file can not be extended or mapped
+    void writeDirectly(const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            auto n = pwrite(fd_, data, len, static_cast<off_t>(length_));
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                fprintf(stderr,
+                        "Failed to write log file: %s\n",
+                        strerror_tl(errno));
+                return;
+            }
+            length_ += static_cast<uint64_t>(n);
+            data += n;
+            len -= static_cast<size_t>(n);
+        }
+        fileSize_ = std::max(fileSize_, length_);
+    }
+
+    int fd_;
+    char *data_{nullptr};
+    uint64_t mapOffset_{0};
+    // The length of the content
+    uint64_t length_{0};
+    // The length of the file, including the zeros after the content
+    uint64_t fileSize_{0};
+};
+#else
+// Log files are not mapped on Windows, they are written with stdio
+class AsyncFileLogger::LoggerFile::MappedFile : NonCopyable
+{
+  public:
+    static std::unique_ptr<MappedFile> open(const std::string &)
+    {
+        return nullptr;
+    }
+    void write(const char *, size_t)
+    {
+    }
+    uint64_t length() const
+    {
+        return 0;
+    }
+};
+#endif
+
+class AsyncFileLogger::ThreadBuffer : public detail::LogRing
+{
+  public:
+    using LogRing::LogRing;
+
+    // A process-wide id for each logger, the buffers cached by the threads
+    // are looked up by it
+    static uint64_t newLoggerId()
+    {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+};
+
+static int64_t monotonicTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 AsyncFileLogger::AsyncFileLogger()
-    : logBufferPtr_(new std::string), nextBufferPtr_(new std::string)
+    : logBufferPtr_(new std::string),
+      nextBufferPtr_(new std::string),
+      id_(ThreadBuffer::newLoggerId())
 {
-    logBufferPtr_->reserve(kMemBufferSize);
-    nextBufferPtr_->reserve(kMemBufferSize);
+    reserveLogBuffer(*logBufferPtr_);
+    reserveLogBuffer(*nextBufferPtr_);
 }
 
 AsyncFileLogger::~AsyncFileLogger()
 {
     // std::cout << "~AsyncFileLogger" << std::endl;
     stopFlag_ = true;
+    spaceCond_.notify_all();
     if (threadPtr_)
     {
         cond_.notify_all();
         threadPtr_->join();
     }
     // std::cout << "thread exit" << std::endl;
+    if (threadBufferSize_ > 0)
+        drainThreadBuffers();
     {
         std::lock_guard<std::mutex> guard_(mutex_);
         if (logBufferPtr_->length() > 0)
@@ -71,44 +595,227 @@ AsyncFileLogger::~AsyncFileLogger()
     }
 }
 
+void AsyncFileLogger::enablePerThreadBuffers(size_t bufferSize)
+{
+    assert(!threadPtr_);
+    size_t capacity = 4096;
+    while (capacity < bufferSize)
+        capacity <<= 1;
+    threadBufferSize_ = capacity;
+}
+
+AsyncFileLogger::ThreadBuffer *AsyncFileLogger::threadBuffer()
+{
+    // The buffers are owned by the loggers, so that they are released with
+    // them. The cache only keeps a pointer while the logger lives.
+    struct CachedBuffer
+    {
+        uint64_t id;
+        ThreadBuffer *buffer;
+        std::weak_ptr<ThreadBuffer> owner;
+    };
+    struct CachedBuffers
+    {
+        std::vector<CachedBuffer> buffers;
+        ~CachedBuffers()
+        {
+            // Let the logger thread release the buffers once collected
+            for (auto &buffer : buffers)
+            {
+                auto ptr = buffer.owner.lock();
+                if (ptr)
+                    ptr->close();
+            }
+        }
+    };
+    static thread_local CachedBuffers cache;
+    for (auto &buffer : cache.buffers)
+    {
+        if (buffer.id == id_)
+            return buffer.buffer;
+    }
+    // Forget the buffers of the loggers that are gone
+    cache.buffers.erase(std::remove_if(cache.buffers.begin(),
+                                       cache.buffers.end(),
+                                       [](const CachedBuffer &buffer) {
+                                           return buffer.owner.expired();
+                                       }),
+                        cache.buffers.end());
+    auto buffer = std::make_shared<ThreadBuffer>(threadBufferSize_);
+    {
+        std::lock_guard<std::mutex> lock(threadBuffersMutex_);
+        threadBuffers_.push_back(buffer);
+    }
+    cache.buffers.push_back({id_, buffer.get(), buffer});
+    return buffer.get();
+}
+
+void AsyncFileLogger::drainThreadBuffers()
+{
+    std::vector<ThreadBufferPtr> buffers;
+    {
+        std::lock_guard<std::mutex> lock(threadBuffersMutex_);
+        buffers = threadBuffers_;
+    }
+    auto bufferPtr = std::make_shared<std::string>();
+
+    // Merge the buffers by the time of the messages
+    detail::mergeLogRings(
+        buffers,
+        monotonicTime(),
+        [this, &bufferPtr](ThreadBuffer &, const ThreadBuffer::Record *record) {
+            if (bufferPtr->length() + record->length > kMemBufferSize)
+            {
+                writeLogToFile(bufferPtr);
+                bufferPtr->clear();
+            }
+            bufferPtr->append(reinterpret_cast<const char *>(record + 1),
+                              record->length);
+            bytesQueued_.fetch_sub(record->length, std::memory_order_relaxed);
+        });
+    if (bufferPtr->length() > 0)
+        writeLogToFile(bufferPtr);
+
+    // Release the buffers of the threads that are gone
+    std::lock_guard<std::mutex> lock(threadBuffersMutex_);
+    detail::removeClosedLogRings(threadBuffers_);
+}
+
 void AsyncFileLogger::output(const char *msg, const uint64_t len)
 {
-    std::lock_guard<std::mutex> guard_(mutex_);
+    auto level = Logger::outputLevel();
+    if (threadBufferSize_ > 0 && len <= threadBufferSize_ / 4)
+    {
+        auto buffer = threadBuffer();
+        // Counted before the logger thread can take the message
+        bytesQueued_.fetch_add(len, std::memory_order_relaxed);
+        if (buffer->tryPush(monotonicTime(), msg, static_cast<size_t>(len)))
+        {
+            if (buffer->shouldNotify())
+                cond_.notify_one();
+            return;
+        }
+        // The buffer of the thread is full, the message goes to the shared
+        // buffer under the overflow policy
+        bytesQueued_.fetch_sub(len, std::memory_order_relaxed);
+        cond_.notify_one();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
     if (len > kMemBufferSize)
+    {
+        dropMessage(level);
         return;
+    }
     if (!logBufferPtr_)
     {
         logBufferPtr_ = std::make_shared<std::string>();
-        logBufferPtr_->reserve(kMemBufferSize);
+        reserveLogBuffer(*logBufferPtr_);
+    }
+    if (writeBuffers_.size() > maxPendingBuffers_ && !makeRoom(lock, level))
+    {
+        dropMessage(level);
+        return;
     }
     if (logBufferPtr_->capacity() - logBufferPtr_->length() < len)
     {
         swapBuffer();
         cond_.notify_one();
     }
-    if (writeBuffers_.size() > 25)  // 100M bytes logs in buffer
-    {
-        ++lostCounter_;
-        return;
-    }
 
     if (lostCounter_ > 0)
     {
-        char logErr[128];
-        auto strlen =
-            snprintf(logErr,
-                     sizeof(logErr),
-                     "%llu log information is lost\n",
-                     static_cast<long long unsigned int>(lostCounter_));
+        LogStream logErr;
+        Logger::formatLostMessages(logErr, lostCounter_);
         lostCounter_ = 0;
-        logBufferPtr_->append(logErr, strlen);
+        logBufferPtr_->append(logErr.bufferData(), logErr.bufferLength());
+        bytesQueued_.fetch_add(logErr.bufferLength(),
+                               std::memory_order_relaxed);
     }
     logBufferPtr_->append(msg, len);
+    ++logBufferLines_[level];
+    bytesQueued_.fetch_add(len, std::memory_order_relaxed);
+}
+
+void AsyncFileLogger::dropMessage(Logger::LogLevel level)
+{
+    ++lostCounter_;
+    linesDropped_[level].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool AsyncFileLogger::makeRoom(std::unique_lock<std::mutex> &lock,
+                               Logger::LogLevel level)
+{
+    switch (overflowPolicy_)
+    {
+        case OverflowPolicy::DropNewest:
+            return false;
+        case OverflowPolicy::DropOldest:
+            while (writeBuffers_.size() > maxPendingBuffers_)
+            {
+                auto bufferPtr = std::move(writeBuffers_.front());
+                writeBuffers_.pop();
+                auto &lines = writeBufferLines_.front();
+                for (size_t i = 0; i < lines.size(); ++i)
+                {
+                    lostCounter_ += lines[i];
+                    linesDropped_[i].fetch_add(lines[i],
+                                               std::memory_order_relaxed);
+                }
+                writeBufferLines_.pop_front();
+                bytesQueued_.fetch_sub(bufferPtr->length(),
+                                       std::memory_order_relaxed);
+                buffersPending_.fetch_sub(1, std::memory_order_relaxed);
+                if (!nextBufferPtr_)
+                {
+                    bufferPtr->clear();
+                    nextBufferPtr_ = std::move(bufferPtr);
+                }
+            }
+            return true;
+        case OverflowPolicy::Block:
+        {
+            auto deadline = std::chrono::steady_clock::now() + blockTimeout_;
+            while (writeBuffers_.size() > maxPendingBuffers_ && !stopFlag_)
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline)
+                    return false;
+                spaceCond_.wait_for(lock, deadline - now);
+            }
+            return true;
+        }
+        case OverflowPolicy::DropByLevel:
+            return level >= overflowKeepLevel_ &&
+                   writeBuffers_.size() <= 2 * maxPendingBuffers_;
+    }
+    return false;
+}
+
+AsyncFileLogger::Stats AsyncFileLogger::stats() const
+{
+    Stats stats;
+    stats.bytesQueued = bytesQueued_.load(std::memory_order_relaxed);
+    stats.buffersPending = buffersPending_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < linesDropped_.size(); ++i)
+        stats.linesDropped[i] =
+            linesDropped_[i].load(std::memory_order_relaxed);
+    stats.lastFlushLatency =
+        lastFlushLatency_.load(std::memory_order_relaxed);
+    stats.maxFlushLatency = maxFlushLatency_.load(std::memory_order_relaxed);
+    return stats;
 }
 
 void AsyncFileLogger::flush()
 {
     std::lock_guard<std::mutex> guard_(mutex_);
+    if (threadBufferSize_ > 0)
+    {
+        // Collect the per-thread buffers now
+        if (logBufferPtr_->length() > 0)
+            swapBuffer();
+        cond_.notify_one();
+        return;
+    }
     if (logBufferPtr_->length() > 0)
     {
         // std::cout<<"flush log buffer
@@ -127,7 +834,9 @@ void AsyncFileLogger::writeLogToFile(const StringPtr buf)
                                                        fileBaseName_,
                                                        fileExtName_,
                                                        switchOnLimitOnly_,
-                                                       maxFiles_));
+                                                       maxFiles_,
+                                                       compression_,
+                                                       mappedFile_));
     }
     loggerFilePtr_->writeLog(buf);
     if (loggerFilePtr_->getLength() > sizeLimit_)
@@ -147,6 +856,16 @@ void AsyncFileLogger::logThreadFunc()
             std::unique_lock<std::mutex> lock(mutex_);
             while (writeBuffers_.size() == 0 && !stopFlag_)
             {
+                if (threadBufferSize_ > 0)
+                {
+                    // The per-thread buffers are collected on each wakeup
+                    cond_.wait_for(lock, kThreadBufferPollInterval);
+                    if (logBufferPtr_->length() > 0)
+                    {
+                        swapBuffer();
+                    }
+                    break;
+                }
                 if (cond_.wait_for(lock, kLogFlushTimeout) ==
                     std::cv_status::timeout)
                 {
@@ -158,13 +877,21 @@ void AsyncFileLogger::logThreadFunc()
                 }
             }
             tmpBuffers_.swap(writeBuffers_);
+            writeBufferLines_.clear();
         }
+        spaceCond_.notify_all();
+        bool written = !tmpBuffers_.empty() || threadBufferSize_ > 0;
+        auto start = std::chrono::steady_clock::now();
+        if (threadBufferSize_ > 0)
+            drainThreadBuffers();
 
         while (!tmpBuffers_.empty())
         {
             StringPtr tmpPtr = (StringPtr &&)tmpBuffers_.front();
             tmpBuffers_.pop();
             writeLogToFile(tmpPtr);
+            bytesQueued_.fetch_sub(tmpPtr->length(), std::memory_order_relaxed);
+            buffersPending_.fetch_sub(1, std::memory_order_relaxed);
             tmpPtr->clear();
             {
                 std::unique_lock<std::mutex> lock(mutex_);
@@ -173,9 +900,48 @@ void AsyncFileLogger::logThreadFunc()
         }
         if (loggerFilePtr_)
             loggerFilePtr_->flush();
+        if (!written)
+            continue;
+        auto latency = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+        lastFlushLatency_.store(latency, std::memory_order_relaxed);
+        if (latency > maxFlushLatency_.load(std::memory_order_relaxed))
+            maxFlushLatency_.store(latency, std::memory_order_relaxed);
     }
 }
 
+bool AsyncFileLogger::hasCompressionSupport(Compression compression)
+{
+    switch (compression)
+    {
+        case Compression::None:
+            return true;
+        case Compression::Gzip:
+#ifdef USE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case Compression::Zstd:
+#ifdef USE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+void AsyncFileLogger::setCompression(Compression compression)
+{
+    if (!hasCompressionSupport(compression))
+        throw std::invalid_argument(
+            "trantor was built without support for this compression");
+    compression_ = compression;
+}
+
 void AsyncFileLogger::startLogging()
 {
     threadPtr_ = std::unique_ptr<std::thread>(
@@ -186,17 +952,25 @@ AsyncFileLogger::LoggerFile::LoggerFile(const std::string &filePath,
                                         const std::string &fileBaseName,
                                         const std::string &fileExtName,
                                         bool switchOnLimitOnly,
-                                        size_t maxFiles)
+                                        size_t maxFiles,
+                                        Compression compression,
+                                        bool mapped)
     : creationDate_(Date::date()),
       filePath_(filePath),
       fileBaseName_(fileBaseName),
       fileExtName_(fileExtName),
       switchOnLimitOnly_(switchOnLimitOnly),
-      maxFiles_(maxFiles)
+      maxFiles_(maxFiles),
+      compression_(compression),
+      mapped_(mapped)
 {
     open();
 
-    if (maxFiles_ > 0)
+    if (compression_ != Compression::None)
+    {
+        compressor_.reset(new Compressor);
+    }
+    if (maxFiles_ > 0 || compressor_)
     {
         initFilenameQueue();
     }
@@ -209,6 +983,12 @@ AsyncFileLogger::LoggerFile::LoggerFile(const std::string &filePath,
 void AsyncFileLogger::LoggerFile::open()
 {
     fileFullName_ = filePath_ + fileBaseName_ + fileExtName_;
+    if (mapped_)
+    {
+        mappedFile_ = MappedFile::open(fileFullName_);
+        if (mappedFile_)
+            return;
+    }
 #ifndef _MSC_VER
     fp_ = fopen(fileFullName_.c_str(), "a");
 #else
@@ -225,7 +1005,11 @@ void AsyncFileLogger::LoggerFile::open()
 uint64_t AsyncFileLogger::LoggerFile::fileSeq_{0};
 void AsyncFileLogger::LoggerFile::writeLog(const StringPtr buf)
 {
-    if (fp_)
+    if (mappedFile_)
+    {
+        mappedFile_->write(buf->data(), buf->length());
+    }
+    else if (fp_)
     {
         // std::cout<<"write "<<buf->length()<<" bytes to file"<<std::endl;
         fwrite(buf->c_str(), 1, buf->length(), fp_);
@@ -234,6 +1018,7 @@ void AsyncFileLogger::LoggerFile::writeLog(const StringPtr buf)
 
 void AsyncFileLogger::LoggerFile::flush()
 {
+    // The content of a mapped file is already in the page cache
     if (fp_)
     {
         fflush(fp_);
@@ -242,6 +1027,8 @@ void AsyncFileLogger::LoggerFile::flush()
 
 uint64_t AsyncFileLogger::LoggerFile::getLength()
 {
+    if (mappedFile_)
+        return mappedFile_->length();
     if (fp_)
         return ftell(fp_);
     return 0;
@@ -255,10 +1042,15 @@ uint64_t AsyncFileLogger::LoggerFile::getLength()
  */
 void AsyncFileLogger::LoggerFile::switchLog(bool openNewOne)
 {
-    if (fp_)
+    if (fp_ || mappedFile_)
     {
-        fclose(fp_);
-        fp_ = nullptr;
+        if (fp_)
+        {
+            fclose(fp_);
+            fp_ = nullptr;
+        }
+        // Truncates the mapped file to its content
+        mappedFile_.reset();
 
         char seq[12];
         snprintf(seq,
@@ -279,6 +1071,13 @@ void AsyncFileLogger::LoggerFile::switchLog(bool openNewOne)
         auto wNewName{utils::toNativePath(newName)};
         _wrename(wFullName.c_str(), wNewName.c_str());
 #endif
+        if (compressor_)
+        {
+            auto compression = compression_;
+            compressor_->run([newName, compression]() {
+                compressLogFile(newName, compression);
+            });
+        }
         if (maxFiles_ > 0)
         {
             filenameQueue_.push_back(newName);
@@ -303,7 +1102,7 @@ AsyncFileLogger::LoggerFile::~LoggerFile()
 
 void AsyncFileLogger::LoggerFile::initFilenameQueue()
 {
-    if (maxFiles_ <= 0)
+    if (maxFiles_ <= 0 && !compressor_)
     {
         return;
     }
@@ -323,9 +1122,38 @@ void AsyncFileLogger::LoggerFile::initFilenameQueue()
         return;
     }
 
+    struct Versions
+    {
+        bool uncompressed{false};
+        bool compressed{false};
+    };
+    // The files by their uncompressed name, in the order of their names
+    std::map<std::string, Versions> files;
     while ((dirp = readdir(dp)) != nullptr)
     {
         std::string name = dirp->d_name;
+        // The output of a compression interrupted by the end of the process
+        const size_t tmpLength = sizeof(kTemporarySuffix) - 1;
+        bool temporary = name.size() > tmpLength &&
+                         name.compare(name.size() - tmpLength,
+                                      tmpLength,
+                                      kTemporarySuffix) == 0;
+        if (temporary)
+            name.resize(name.size() - tmpLength);
+        bool compressed = false;
+        for (auto compression : {Compression::Gzip, Compression::Zstd})
+        {
+            std::string suffix = compressedSuffix(compression);
+            if (name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(),
+                             suffix.size(),
+                             suffix) == 0)
+            {
+                name.resize(name.size() - suffix.size());
+                compressed = true;
+                break;
+            }
+        }
         // <base>.yymmdd-hhmmss.000000<ext>
         // NOTE: magic number 21: the length of middle part of generated name
         if (name.size() != fileBaseName_.size() + 21 + fileExtName_.size() ||
@@ -336,7 +1164,7 @@ void AsyncFileLogger::LoggerFile::initFilenameQueue()
         {
             continue;
         }
-        std::string fullname = filePath_ + name;
+        std::string fullname = filePath_ + dirp->d_name;
         if (stat(fullname.c_str(), &st) == -1)
         {
             fprintf(stderr,
@@ -349,26 +1177,52 @@ void AsyncFileLogger::LoggerFile::initFilenameQueue()
         {
             continue;
         }
-        filenameQueue_.push_back(fullname);
-        std::push_heap(filenameQueue_.begin(),
-                       filenameQueue_.end(),
-                       std::greater<>());
-        if (filenameQueue_.size() > maxFiles_)
-        {
-            std::pop_heap(filenameQueue_.begin(),
-                          filenameQueue_.end(),
-                          std::greater<>());
-            auto fileToRemove = std::move(filenameQueue_.back());
-            filenameQueue_.pop_back();
-            remove(fileToRemove.c_str());
+        if (temporary)
+        {
+            // The original is still there, and compressed again below
+            if (compressed)
+                removeLogFile(fullname);
+            continue;
         }
+        auto &versions = files[filePath_ + name];
+        if (compressed)
+            versions.compressed = true;
+        else
+            versions.uncompressed = true;
     }
     closedir(dp);
+
+    size_t toRemove =
+        maxFiles_ > 0 && files.size() > maxFiles_ ? files.size() - maxFiles_
+                                                  : 0;
+    for (auto &file : files)
+    {
+        if (toRemove > 0)
+        {
+            --toRemove;
+            removeLogFiles(file.first);
+            continue;
+        }
+        if (maxFiles_ > 0)
+            filenameQueue_.push_back(file.first);
+        if (!file.second.uncompressed || !compressor_)
+            continue;
+        if (file.second.compressed)
+        {
+            // The compression was done, but not the removal of the original
+            removeLogFile(file.first);
+        }
+        else
+        {
+            auto name = file.first;
+            auto compression = compression_;
+            compressor_->run(
+                [name, compression]() { compressLogFile(name, compression); });
+        }
+    }
 #else
     // TODO: windows implementation
 #endif
-
-    std::sort(filenameQueue_.begin(), filenameQueue_.end(), std::less<>());
 }
 
 void AsyncFileLogger::LoggerFile::deleteOldFiles()
@@ -377,27 +1231,20 @@ void AsyncFileLogger::LoggerFile::deleteOldFiles()
     {
         std::string filename = std::move(filenameQueue_.front());
         filenameQueue_.pop_front();
-
-#if !defined(_WIN32) || defined(__MINGW32__)
-        int r = remove(filename.c_str());
-#else
-        // Convert UTF-8 file to UCS-2
-        auto wName{utils::toNativePath(filename)};
-        int r = _wremove(wName.c_str());
-#endif
-        if (r != 0)
-        {
-            fprintf(stderr,
-                    "Failed to remove file %s: %s\n",
-                    filename.c_str(),
-                    strerror_tl(errno));
-        }
+        // After the compression of the file if it is pending
+        if (compressor_)
+            compressor_->run([filename]() { removeLogFiles(filename); });
+        else
+            removeLogFiles(filename);
     }
 }
 
 void AsyncFileLogger::swapBuffer()
 {
     writeBuffers_.push(logBufferPtr_);
+    writeBufferLines_.push_back(logBufferLines_);
+    logBufferLines_.fill(0);
+    buffersPending_.fetch_add(1, std::memory_order_relaxed);
     if (nextBufferPtr_)
     {
         logBufferPtr_ = nextBufferPtr_;
@@ -407,6 +1254,6 @@ void AsyncFileLogger::swapBuffer()
     else
     {
         logBufferPtr_ = std::make_shared<std::string>();
-        logBufferPtr_->reserve(kMemBufferSize);
+        reserveLogBuffer(*logBufferPtr_);
     }
 }
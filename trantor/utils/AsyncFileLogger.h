@@ -16,7 +16,12 @@
 
 #include <trantor/utils/NonCopyable.h>
 #include <trantor/utils/Date.h>
+#include <trantor/utils/Logger.h>
 #include <trantor/exports.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <string>
@@ -24,6 +29,7 @@
 #include <sstream>
 #include <memory>
 #include <queue>
+#include <vector>
 
 namespace trantor
 {
@@ -39,7 +45,8 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
 {
   public:
     /**
-     * @brief Write the message to the log file.
+     * @brief Write the message to the log file. The level of the message is
+     * taken from Logger::outputLevel().
      *
      * @param msg
      * @param len
@@ -71,7 +78,8 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
 
     /**
      * @brief Set the max number of log files. When the number exceeds the
-     * limit, the oldest log file will be deleted.
+     * limit, the oldest log file will be deleted. A compressed file counts as
+     * the file it was compressed from.
      *
      * @param maxFiles
      */
@@ -80,6 +88,36 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
         maxFiles_ = maxFiles;
     }
 
+    /**
+     * @brief The compression of the switched log files.
+     */
+    enum class Compression
+    {
+        None,
+        // ".gz" files, needs zlib
+        Gzip,
+        // ".zst" files, needs zstd
+        Zstd
+    };
+
+    /**
+     * @brief Compress the log files once they are switched. The files are
+     * compressed in a background thread with a low CPU and IO priority, a
+     * compressed file replaces the original one. The files switched by a
+     * previous run and left uncompressed are compressed at startup.
+     *
+     * @note This method must be called before startLogging().
+     * @throw std::invalid_argument if trantor was built without the library
+     * of the compression, see hasCompressionSupport().
+     */
+    void setCompression(Compression compression);
+
+    /**
+     * @brief Check whether trantor was built with the library of the
+     * compression.
+     */
+    static bool hasCompressionSupport(Compression compression);
+
     /**
      * @brief Set whether to switch the log file when the AsyncFileLogger object
      * is destroyed. If this flag is set to true, the log file is not switched
@@ -112,6 +150,120 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
         if (filePath_[filePath_.length() - 1] != '/')
             filePath_ = filePath_ + "/";
     }
+
+    /**
+     * @brief Let each thread calling output() write into its own buffer, so
+     * that logging does not take any lock. The logger thread collects the
+     * buffers of all the threads and merges the messages in the order they
+     * were output. Messages larger than a quarter of the buffer, and the
+     * ones that do not fit in the buffer of their thread, go through the
+     * shared buffer and may be written out of order.
+     *
+     * @param bufferSize The size of the buffer of each thread, rounded up to
+     * a power of two.
+     * @note This method must be called before startLogging().
+     */
+    void enablePerThreadBuffers(size_t bufferSize = 1024 * 1024);
+
+    /**
+     * @brief Write the log file through a memory mapping instead of stdio.
+     * The file is extended and mapped in large steps, and truncated to the
+     * size of its content when it is switched or closed. The messages
+     * written into the mapping survive a crash of the process without a
+     * flush. The trailing zeros a crash leaves are trimmed when the file is
+     * opened again.
+     *
+     * @note This method must be called before startLogging(). Readers of the
+     * file being written may see zeros after its content. It has no effect on
+     * Windows.
+     */
+    void enableMappedFile(bool flag = true)
+    {
+        mappedFile_ = flag;
+    }
+
+    /**
+     * @brief What output() does with a message when the logger thread is
+     * behind, i.e. when more buffers than the limit set by
+     * setMaxPendingBuffers() are waiting to be written. The dropped messages
+     * are counted in stats() and reported in the log file.
+     */
+    enum class OverflowPolicy
+    {
+        // Drop the new messages, the default
+        DropNewest,
+        // Drop the oldest buffer waiting to be written
+        DropOldest,
+        // Wait for the logger thread, up to the timeout set by
+        // setBlockTimeout(), then drop the message
+        Block,
+        // Drop the messages below the level set by setOverflowKeepLevel(),
+        // keep the others up to twice the limit of buffers
+        DropByLevel
+    };
+
+    /**
+     * @brief Set the policy of output() when the logger thread is behind.
+     *
+     * @note The policy applies to the shared buffer, which also takes the
+     * messages that do not fit in the buffer of their thread, see
+     * enablePerThreadBuffers().
+     */
+    void setOverflowPolicy(OverflowPolicy policy)
+    {
+        overflowPolicy_ = policy;
+    }
+
+    /**
+     * @brief Set the number of full buffers of 4MB which can wait to be
+     * written before the overflow policy applies. The default is 25.
+     */
+    void setMaxPendingBuffers(size_t maxBuffers)
+    {
+        maxPendingBuffers_ = maxBuffers;
+    }
+
+    /**
+     * @brief Set how long output() waits for the logger thread with the
+     * Block policy. The default is 1 second.
+     */
+    void setBlockTimeout(std::chrono::milliseconds timeout)
+    {
+        blockTimeout_ = timeout;
+    }
+
+    /**
+     * @brief Set the lowest level kept by the DropByLevel policy. The default
+     * is kWarn.
+     */
+    void setOverflowKeepLevel(Logger::LogLevel level)
+    {
+        overflowKeepLevel_ = level;
+    }
+
+    /**
+     * @brief The counters of the logger.
+     */
+    struct Stats
+    {
+        // The bytes output and not written to the file yet
+        uint64_t bytesQueued{0};
+        // The full buffers not written to the file yet
+        uint64_t buffersPending{0};
+        // The messages dropped, by level
+        std::array<uint64_t, Logger::kNumberOfLogLevels> linesDropped{};
+        // The time the logger thread took to write and flush its last batch
+        // of buffers, and the longest one, in microseconds
+        uint64_t lastFlushLatency{0};
+        uint64_t maxFlushLatency{0};
+    };
+
+    /**
+     * @brief Get the counters of the logger, which are updated atomically and
+     * can be read from any thread.
+     */
+    Stats stats() const;
+
     ~AsyncFileLogger();
     AsyncFileLogger();
 
@@ -133,6 +285,8 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
     bool switchOnLimitOnly_{false};  // by default false, will generate new
                                      // file name on each destroy.
     size_t maxFiles_{0};
+    Compression compression_{Compression::None};
+    bool mappedFile_{false};
 
     class LoggerFile : NonCopyable
     {
@@ -141,7 +295,9 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
                    const std::string &fileBaseName,
                    const std::string &fileExtName,
                    bool switchOnLimitOnly = false,
-                   size_t maxFiles = 0);
+                   size_t maxFiles = 0,
+                   Compression compression = Compression::None,
+                   bool mapped = false);
         ~LoggerFile();
         void writeLog(const StringPtr buf);
         void open();
@@ -149,7 +305,7 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
         uint64_t getLength();
         explicit operator bool() const
         {
-            return fp_ != nullptr;
+            return fp_ != nullptr || mappedFile_ != nullptr;
         }
         void flush();
 
@@ -158,6 +314,9 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
         void deleteOldFiles();
 
         FILE *fp_{nullptr};
+        // Writes the file instead of fp_ when it is mapped
+        class MappedFile;
+        std::unique_ptr<MappedFile> mappedFile_;
         Date creationDate_;
         std::string fileFullName_;
         std::string filePath_;
@@ -170,11 +329,48 @@ class TRANTOR_EXPORT AsyncFileLogger : NonCopyable
         size_t maxFiles_{0};
         // store generated filenames
         std::deque<std::string> filenameQueue_;
+        Compression compression_{Compression::None};
+        // Compresses and deletes the switched files in the background, set
+        // when the files are compressed
+        class Compressor;
+        std::unique_ptr<Compressor> compressor_;
+        bool mapped_{false};
     };
     std::unique_ptr<LoggerFile> loggerFilePtr_;
 
     uint64_t lostCounter_{0};
     void swapBuffer();
+
+    using LineCounts = std::array<uint64_t, Logger::kNumberOfLogLevels>;
+    OverflowPolicy overflowPolicy_{OverflowPolicy::DropNewest};
+    size_t maxPendingBuffers_{25};  // 100M bytes logs in buffer
+    std::chrono::milliseconds blockTimeout_{1000};
+    Logger::LogLevel overflowKeepLevel_{Logger::kWarn};
+    // Notified when the logger thread takes the buffers to write
+    std::condition_variable spaceCond_;
+    // The messages of logBufferPtr_ and writeBuffers_ by level, to count the
+    // lines of the dropped buffers
+    LineCounts logBufferLines_{};
+    std::deque<LineCounts> writeBufferLines_;
+    bool makeRoom(std::unique_lock<std::mutex> &lock, Logger::LogLevel level);
+    void dropMessage(Logger::LogLevel level);
+
+    std::atomic<uint64_t> bytesQueued_{0};
+    std::atomic<uint64_t> buffersPending_{0};
+    std::array<std::atomic<uint64_t>, Logger::kNumberOfLogLevels>
+        linesDropped_{};
+    std::atomic<uint64_t> lastFlushLatency_{0};
+    std::atomic<uint64_t> maxFlushLatency_{0};
+
+    class ThreadBuffer;
+    using ThreadBufferPtr = std::shared_ptr<ThreadBuffer>;
+    // Identifies the logger in the buffers cached by each thread
+    const uint64_t id_;
+    size_t threadBufferSize_{0};
+    std::mutex threadBuffersMutex_;
+    std::vector<ThreadBufferPtr> threadBuffers_;
+    ThreadBuffer *threadBuffer();
+    void drainThreadBuffers();
 };
 
 }  // namespace trantor
@@ -0,0 +1,167 @@
+/**
+ *
+ *  @file BinaryCodec.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/utils/BinaryCodec.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__GNUC__) || defined(__clang__)
+// Compiled with the target attribute and only used when the CPU supports it
+#define TRANTOR_BYTE_SWAP_X86
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define TRANTOR_BYTE_SWAP_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace trantor::codec;
+
+namespace
+{
+using ByteSwapFunc = size_t (*)(char *, const char *, size_t, size_t);
+
+// The vector implementations swap as many whole vectors as possible and
+// return the number of bytes done, the rest is swapped one by one.
+
+#ifdef TRANTOR_BYTE_SWAP_X86
+// Shuffle masks reversing each 2, 4 or 8 bytes of a 16 bytes lane
+alignas(16) const char kSwapMasks[3][16] = {
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}};
+
+inline const char *swapMask(size_t width)
+{
+    return kSwapMasks[width == 2 ? 0 : (width == 4 ? 1 : 2)];
+}
+
+__attribute__((target("ssse3"))) size_t byteSwapSSSE3(char *dst,
+                                                      const char *src,
+                                                      size_t len,
+                                                      size_t width)
+{
+    const __m128i mask =
+        _mm_load_si128(reinterpret_cast<const __m128i *>(swapMask(width)));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) size_t byteSwapAVX2(char *dst,
+                                                    const char *src,
+                                                    size_t len,
+                                                    size_t width)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(swapMask(width))));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+#endif
+
+#ifdef TRANTOR_BYTE_SWAP_NEON
+size_t byteSwapNEON(char *dst, const char *src, size_t len, size_t width)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        if (width == 2)
+            v = vrev16q_u8(v);
+        else if (width == 4)
+            v = vrev32q_u8(v);
+        else
+            v = vrev64q_u8(v);
+        vst1q_u8(reinterpret_cast<uint8_t *>(dst + i), v);
+    }
+    return i;
+}
+#endif
+
+#ifndef TRANTOR_BYTE_SWAP_NEON
+size_t byteSwapNone(char *, const char *, size_t, size_t)
+{
+    return 0;
+}
+#endif
+
+ByteSwapFunc selectImpl()
+{
+#ifdef TRANTOR_BYTE_SWAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return byteSwapAVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return byteSwapSSSE3;
+#endif
+#ifdef TRANTOR_BYTE_SWAP_NEON
+    return byteSwapNEON;
+#else
+    return byteSwapNone;
+#endif
+}
+
+template <typename U>
+void byteSwapScalar(char *dst, const char *src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        U u;
+        memcpy(&u, src + i * sizeof(U), sizeof(U));
+        u = detail::byteSwap(u);
+        memcpy(dst + i * sizeof(U), &u, sizeof(U));
+    }
+}
+}  // namespace
+
+void trantor::codec::detail::byteSwapCopy(void *dst,
+                                          const void *src,
+                                          size_t count,
+                                          size_t width)
+{
+    static const ByteSwapFunc impl = selectImpl();
+    auto d = static_cast<char *>(dst);
+    auto s = static_cast<const char *>(src);
+    size_t len = count * width;
+    size_t done = 0;
+    if (width == 2 || width == 4 || width == 8)
+        done = impl(d, s, len, width);
+    d += done;
+    s += done;
+    count -= done / width;
+    switch (width)
+    {
+        case 2:
+            byteSwapScalar<uint16_t>(d, s, count);
+            break;
+        case 4:
+            byteSwapScalar<uint32_t>(d, s, count);
+            break;
+        case 8:
+            byteSwapScalar<uint64_t>(d, s, count);
+            break;
+        default:
+            memmove(d, s, count * width);
+            break;
+    }
+}
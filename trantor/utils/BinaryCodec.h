@@ -0,0 +1,599 @@
+/**
+ *
+ *  @file BinaryCodec.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+#include <trantor/utils/MsgBuffer.h>
+#include <trantor/exports.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+namespace trantor
+{
+namespace codec
+{
+/**
+ * @brief The result of decoding a value or a message.
+ */
+enum class DecodeStatus
+{
+    Ok,
+    // The buffer ends in the middle of the value, nothing is consumed
+    NeedMoreData,
+    // The data can not be decoded, e.g. a varint longer than its type
+    Malformed
+};
+
+namespace detail
+{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool kHostBigEndian = true;
+#else
+constexpr bool kHostBigEndian = false;
+#endif
+
+inline uint8_t byteSwap(uint8_t v)
+{
+    return v;
+}
+inline uint16_t byteSwap(uint16_t v)
+{
+#ifdef _MSC_VER
+    return _byteswap_ushort(v);
+#else
+    return __builtin_bswap16(v);
+#endif
+}
+inline uint32_t byteSwap(uint32_t v)
+{
+#ifdef _MSC_VER
+    return _byteswap_ulong(v);
+#else
+    return __builtin_bswap32(v);
+#endif
+}
+inline uint64_t byteSwap(uint64_t v)
+{
+#ifdef _MSC_VER
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+template <size_t N>
+struct UnsignedOfSize;
+template <>
+struct UnsignedOfSize<1>
+{
+    using type = uint8_t;
+};
+template <>
+struct UnsignedOfSize<2>
+{
+    using type = uint16_t;
+};
+template <>
+struct UnsignedOfSize<4>
+{
+    using type = uint32_t;
+};
+template <>
+struct UnsignedOfSize<8>
+{
+    using type = uint64_t;
+};
+
+/**
+ * @brief Copy count integers of width bytes (2, 4 or 8) from src to dst,
+ * reversing the bytes of each. Uses SSSE3, AVX2 or NEON when available.
+ */
+TRANTOR_EXPORT void byteSwapCopy(void *dst,
+                                 const void *src,
+                                 size_t count,
+                                 size_t width);
+
+template <typename T, bool bigEndian>
+inline char *putFixed(char *p, T v)
+{
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "Only numbers can be encoded with a fixed size");
+    using U = typename UnsignedOfSize<sizeof(T)>::type;
+    U u;
+    memcpy(&u, &v, sizeof(T));
+    if (bigEndian != kHostBigEndian)
+        u = byteSwap(u);
+    memcpy(p, &u, sizeof(T));
+    return p + sizeof(T);
+}
+
+template <typename T, bool bigEndian>
+inline const char *getFixed(const char *p, T &v)
+{
+    using U = typename UnsignedOfSize<sizeof(T)>::type;
+    U u;
+    memcpy(&u, p, sizeof(T));
+    if (bigEndian != kHostBigEndian)
+        u = byteSwap(u);
+    memcpy(&v, &u, sizeof(T));
+    return p + sizeof(T);
+}
+}  // namespace detail
+
+/**
+ * @brief Write an unsigned LEB128 varint to p, which must have room for
+ * varintSize(v) bytes (10 at most).
+ *
+ * @return char* The end of the varint.
+ */
+inline char *putVarint(char *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint of at most maxBytes bytes from
+ * [p, end), p is moved past it on success.
+ */
+inline DecodeStatus getVarint(const char *&p,
+                              const char *end,
+                              uint64_t &v,
+                              size_t maxBytes = 10)
+{
+    uint64_t result = 0;
+    unsigned int shift = 0;
+    for (size_t i = 0; i < maxBytes; ++i, shift += 7)
+    {
+        if (p + i >= end)
+            return DecodeStatus::NeedMoreData;
+        auto byte = static_cast<uint8_t>(p[i]);
+        // The 10th byte holds the last bit of a 64-bit number
+        if (i == 9 && byte > 1)
+            return DecodeStatus::Malformed;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            p += i + 1;
+            v = result;
+            return DecodeStatus::Ok;
+        }
+    }
+    return DecodeStatus::Malformed;
+}
+
+/**
+ * @brief The size of the varint encoding v.
+ */
+inline size_t varintSize(uint64_t v)
+{
+    size_t size = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+/**
+ * @brief Map signed integers to unsigned ones so that numbers of small
+ * magnitude get short varints.
+ */
+inline uint64_t zigzagEncode(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+inline int64_t zigzagDecode(uint64_t v)
+{
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/**
+ * @brief Append a varint to the buffer.
+ */
+inline void appendVarint(MsgBuffer &buf, uint64_t v)
+{
+    buf.ensureWritableBytes(10);
+    char *begin = buf.beginWrite();
+    buf.hasWritten(putVarint(begin, v) - begin);
+}
+
+/**
+ * @brief Read a varint from the buffer, it is only consumed on success.
+ */
+inline DecodeStatus readVarint(MsgBuffer &buf, uint64_t &v)
+{
+    const char *p = buf.peek();
+    auto status = getVarint(p, p + buf.readableBytes(), v);
+    if (status == DecodeStatus::Ok)
+        buf.retrieve(p - buf.peek());
+    return status;
+}
+
+/*
+ * Encodings of a field. Each one provides:
+ *   kFixedSize: the encoded size for fixed size encodings, 0 otherwise.
+ *   maxSize(v): an upper bound of the encoded size of v.
+ *   encode(p, v): write v to p and return the end, there is always room.
+ *   decode(p, end, v): read v from [p, end) and move p past it. Fixed size
+ *   encodings only check the bounds when checked is true.
+ */
+
+/**
+ * @brief A number in a fixed number of bytes, most significant first.
+ */
+template <typename T>
+struct BigEndian
+{
+    static constexpr size_t kFixedSize = sizeof(T);
+    static size_t maxSize(const T &)
+    {
+        return sizeof(T);
+    }
+    static char *encode(char *p, const T &v)
+    {
+        return detail::putFixed<T, true>(p, v);
+    }
+    template <bool checked = true>
+    static DecodeStatus decode(const char *&p, const char *end, T &v)
+    {
+        if (checked && static_cast<size_t>(end - p) < sizeof(T))
+            return DecodeStatus::NeedMoreData;
+        p = detail::getFixed<T, true>(p, v);
+        return DecodeStatus::Ok;
+    }
+};
+
+/**
+ * @brief A number in a fixed number of bytes, least significant first.
+ */
+template <typename T>
+struct LittleEndian
+{
+    static constexpr size_t kFixedSize = sizeof(T);
+    static size_t maxSize(const T &)
+    {
+        return sizeof(T);
+    }
+    static char *encode(char *p, const T &v)
+    {
+        return detail::putFixed<T, false>(p, v);
+    }
+    template <bool checked = true>
+    static DecodeStatus decode(const char *&p, const char *end, T &v)
+    {
+        if (checked && static_cast<size_t>(end - p) < sizeof(T))
+            return DecodeStatus::NeedMoreData;
+        p = detail::getFixed<T, false>(p, v);
+        return DecodeStatus::Ok;
+    }
+};
+
+/**
+ * @brief An integer as a LEB128 varint, signed integers are zigzag encoded.
+ */
+template <typename T>
+struct Varint
+{
+    static_assert(std::is_integral<T>::value, "Varints are integers");
+    static constexpr size_t kFixedSize = 0;
+    static constexpr size_t kMaxBytes = (sizeof(T) * 8 + 6) / 7;
+    static size_t maxSize(const T &)
+    {
+        return kMaxBytes;
+    }
+    static char *encode(char *p, const T &v)
+    {
+        return putVarint(p, toUnsigned(v, std::is_signed<T>()));
+    }
+    template <bool checked = true>
+    static DecodeStatus decode(const char *&p, const char *end, T &v)
+    {
+        const char *q = p;
+        uint64_t u;
+        auto status = getVarint(q, end, u, kMaxBytes);
+        if (status != DecodeStatus::Ok)
+            return status;
+        using U = typename std::make_unsigned<T>::type;
+        if (u > static_cast<U>(-1))
+            return DecodeStatus::Malformed;
+        v = fromUnsigned(u, std::is_signed<T>());
+        p = q;
+        return DecodeStatus::Ok;
+    }
+
+  private:
+    static uint64_t toUnsigned(T v, std::true_type)
+    {
+        return zigzagEncode(v);
+    }
+    static uint64_t toUnsigned(T v, std::false_type)
+    {
+        return v;
+    }
+    static T fromUnsigned(uint64_t v, std::true_type)
+    {
+        return static_cast<T>(zigzagDecode(v));
+    }
+    static T fromUnsigned(uint64_t v, std::false_type)
+    {
+        return static_cast<T>(v);
+    }
+};
+
+/**
+ * @brief A std::string as its length in a varint followed by its bytes.
+ */
+struct Bytes
+{
+    static constexpr size_t kFixedSize = 0;
+    static size_t maxSize(const std::string &v)
+    {
+        return 10 + v.size();
+    }
+    static char *encode(char *p, const std::string &v)
+    {
+        p = putVarint(p, v.size());
+        memcpy(p, v.data(), v.size());
+        return p + v.size();
+    }
+    template <bool checked = true>
+    static DecodeStatus decode(const char *&p,
+                               const char *end,
+                               std::string &v)
+    {
+        const char *q = p;
+        uint64_t len;
+        auto status = getVarint(q, end, len);
+        if (status != DecodeStatus::Ok)
+            return status;
+        if (static_cast<uint64_t>(end - q) < len)
+            return DecodeStatus::NeedMoreData;
+        v.assign(q, static_cast<size_t>(len));
+        p = q + len;
+        return DecodeStatus::Ok;
+    }
+};
+
+/**
+ * @brief A std::vector of numbers as its size in a varint followed by the
+ * elements in fixed size, the byte order of the whole array is swapped at
+ * once when it differs from the one of the host.
+ */
+template <typename T, bool bigEndian = true>
+struct FixedArray
+{
+    static_assert(std::is_arithmetic<T>::value,
+                  "Only arrays of numbers can be encoded");
+    static constexpr size_t kFixedSize = 0;
+    static size_t maxSize(const std::vector<T> &v)
+    {
+        return 10 + v.size() * sizeof(T);
+    }
+    static char *encode(char *p, const std::vector<T> &v)
+    {
+        p = putVarint(p, v.size());
+        copy(p, v.data(), v.size());
+        return p + v.size() * sizeof(T);
+    }
+    template <bool checked = true>
+    static DecodeStatus decode(const char *&p,
+                               const char *end,
+                               std::vector<T> &v)
+    {
+        const char *q = p;
+        uint64_t count;
+        auto status = getVarint(q, end, count);
+        if (status != DecodeStatus::Ok)
+            return status;
+        if (static_cast<uint64_t>(end - q) / sizeof(T) < count)
+            return DecodeStatus::NeedMoreData;
+        v.resize(static_cast<size_t>(count));
+        copy(v.data(), q, v.size());
+        p = q + v.size() * sizeof(T);
+        return DecodeStatus::Ok;
+    }
+
+  private:
+    static void copy(void *dst, const void *src, size_t count)
+    {
+        if (sizeof(T) == 1 || bigEndian == detail::kHostBigEndian)
+            memcpy(dst, src, count * sizeof(T));
+        else
+            detail::byteSwapCopy(dst, src, count, sizeof(T));
+    }
+};
+
+/**
+ * @brief A member of a struct with its encoding, usually declared with
+ * TRANTOR_CODEC_FIELD.
+ */
+template <typename Class, typename Member, Member Class::*ptr, typename Enc>
+struct Field
+{
+    using ClassType = Class;
+    static constexpr size_t kFixedSize = Enc::kFixedSize;
+    static size_t maxSize(const Class &obj)
+    {
+        return Enc::maxSize(obj.*ptr);
+    }
+    static char *encode(char *p, const Class &obj)
+    {
+        return Enc::encode(p, obj.*ptr);
+    }
+    template <bool checked>
+    static DecodeStatus decode(const char *&p, const char *end, Class &obj)
+    {
+        return Enc::template decode<checked>(p, end, obj.*ptr);
+    }
+};
+
+#define TRANTOR_CODEC_FIELD(Class, member, ...)                           \
+    ::trantor::codec::Field<Class,                                        \
+                            decltype(Class::member),                      \
+                            &Class::member,                               \
+                            __VA_ARGS__>
+
+namespace detail
+{
+template <typename... Fields>
+struct FixedSizeOf;
+template <>
+struct FixedSizeOf<>
+{
+    static constexpr size_t value = 0;
+    static constexpr bool allFixed = true;
+};
+template <typename F, typename... Rest>
+struct FixedSizeOf<F, Rest...>
+{
+    static constexpr size_t value = F::kFixedSize + FixedSizeOf<Rest...>::value;
+    static constexpr bool allFixed =
+        F::kFixedSize > 0 && FixedSizeOf<Rest...>::allFixed;
+};
+
+template <typename F, typename... Rest>
+struct FirstOf
+{
+    using type = F;
+};
+}  // namespace detail
+
+/**
+ * @brief The binary layout of a struct, as a list of fields written in
+ * order. For example:
+ * @code
+   struct Header
+   {
+       uint32_t id;
+       uint64_t seq;
+       std::string name;
+   };
+   using HeaderLayout = trantor::codec::Layout<
+       TRANTOR_CODEC_FIELD(Header, id, trantor::codec::BigEndian<uint32_t>),
+       TRANTOR_CODEC_FIELD(Header, seq, trantor::codec::Varint<uint64_t>),
+       TRANTOR_CODEC_FIELD(Header, name, trantor::codec::Bytes)>;
+
+   HeaderLayout::encode(buffer, header);
+   @endcode
+ * Encoding reserves the room for the whole message once and then writes the
+ * fields without further checks. Decoding a layout made of fixed size fields
+ * only checks the size of the buffer once.
+ */
+template <typename... Fields>
+class Layout
+{
+  public:
+    using ClassType =
+        typename detail::FirstOf<Fields...>::type::ClassType;
+    static constexpr bool kIsFixedSize =
+        detail::FixedSizeOf<Fields...>::allFixed;
+    static constexpr size_t kFixedSize = detail::FixedSizeOf<Fields...>::value;
+
+    /**
+     * @brief An upper bound of the size of the encoded object.
+     */
+    static size_t maxSize(const ClassType &obj)
+    {
+        size_t size = 0;
+        int expand[] = {0, (size += Fields::maxSize(obj), 0)...};
+        (void)expand;
+        return size;
+    }
+
+    /**
+     * @brief Write obj to p, which has room for maxSize(obj) bytes.
+     *
+     * @return char* The end of the written data.
+     */
+    static char *encode(char *p, const ClassType &obj)
+    {
+        int expand[] = {0, (p = Fields::encode(p, obj), 0)...};
+        (void)expand;
+        return p;
+    }
+
+    /**
+     * @brief Append obj to the end of the buffer.
+     */
+    static void encode(MsgBuffer &buf, const ClassType &obj)
+    {
+        buf.ensureWritableBytes(kIsFixedSize ? kFixedSize : maxSize(obj));
+        char *begin = buf.beginWrite();
+        buf.hasWritten(encode(begin, obj) - begin);
+    }
+
+    /**
+     * @brief Read obj from [p, end). On success p is moved past the message,
+     * otherwise p is unchanged and obj may be partially assigned.
+     */
+    static DecodeStatus decode(const char *&p, const char *end, ClassType &obj)
+    {
+        const char *q = p;
+        DecodeStatus status = DecodeStatus::Ok;
+        if (kIsFixedSize)
+        {
+            if (static_cast<size_t>(end - q) < kFixedSize)
+                return DecodeStatus::NeedMoreData;
+            int expand[] = {
+                0, (Fields::template decode<false>(q, end, obj), 0)...};
+            (void)expand;
+        }
+        else
+        {
+            int expand[] = {0,
+                            (status == DecodeStatus::Ok
+                                 ? (status = Fields::template decode<true>(
+                                        q, end, obj),
+                                    0)
+                                 : 0)...};
+            (void)expand;
+        }
+        if (status == DecodeStatus::Ok)
+            p = q;
+        return status;
+    }
+
+    /**
+     * @brief Read obj from the beginning of the buffer, the message is only
+     * consumed on success.
+     */
+    static DecodeStatus decode(MsgBuffer &buf, ClassType &obj)
+    {
+        const char *p = buf.peek();
+        auto status = decode(p, p + buf.readableBytes(), obj);
+        if (status == DecodeStatus::Ok)
+            buf.retrieve(p - buf.peek());
+        return status;
+    }
+};
+
+template <typename... Fields>
+constexpr bool Layout<Fields...>::kIsFixedSize;
+template <typename... Fields>
+constexpr size_t Layout<Fields...>::kFixedSize;
+}  // namespace codec
+}  // namespace trantor
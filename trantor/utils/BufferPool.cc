@@ -0,0 +1,365 @@
+/**
+ *
+ *  BufferPool.cc
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/utils/BufferPool.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+using namespace trantor;
+
+namespace
+{
+// Size classes are the powers of two from 64 bytes to 64KB and the midpoints
+// between them, so at most a third of a chunk is wasted.
+constexpr size_t kMinClassSize{64};
+constexpr size_t kMaxPooledSize{64 * 1024};
+constexpr size_t kNumClasses{21};
+// Memory kept in the free list of each size class and thread
+constexpr size_t kMaxPooledBytesPerClass{256 * 1024};
+constexpr size_t kMinPooledChunks{4};
+constexpr size_t kHugePageSize{2 * 1024 * 1024};
+
+size_t classSize(size_t index)
+{
+    size_t base = kMinClassSize << (index / 2);
+    return (index % 2) ? base + base / 2 : base;
+}
+
+size_t classIndex(size_t size)
+{
+    size_t index = 0;
+    size_t base = kMinClassSize;
+    while (base < size)
+    {
+        if (base + base / 2 >= size)
+            return index + 1;
+        base <<= 1;
+        index += 2;
+    }
+    return index;
+}
+
+struct FreeChunk
+{
+    FreeChunk *next;
+};
+
+struct FreeList
+{
+    FreeChunk *head{nullptr};
+    size_t count{0};
+    void push(void *ptr)
+    {
+        auto chunk = static_cast<FreeChunk *>(ptr);
+        chunk->next = head;
+        head = chunk;
+        ++count;
+    }
+    void *pop()
+    {
+        auto chunk = head;
+        head = chunk->next;
+        --count;
+        return chunk;
+    }
+};
+
+// The huge page arena is one reserved range of addresses, so the chunks cut
+// from it are recognized by their address. They are never given back to the
+// heap, the ones left by exiting threads or beyond the pools of a thread are
+// kept in orphans_.
+class HugePageArena
+{
+  public:
+    bool init(size_t size);
+    bool enabled() const
+    {
+        return begin_.load(std::memory_order_acquire) != nullptr;
+    }
+    bool contains(const void *ptr) const
+    {
+        auto p = static_cast<const char *>(ptr);
+        auto begin = begin_.load(std::memory_order_acquire);
+        return begin && p >= begin && p < end_;
+    }
+    size_t usage() const
+    {
+        auto begin = begin_.load(std::memory_order_acquire);
+        if (!begin)
+            return 0;
+        auto next = next_.load(std::memory_order_relaxed);
+        return (next < end_ ? next : end_) - begin;
+    }
+    // Returns a new committed huge page or nullptr if the arena is used up.
+    char *newPage();
+    void *popOrphan(size_t index);
+    void pushOrphan(size_t index, void *ptr);
+
+  private:
+    std::atomic<char *> begin_{nullptr};
+    char *end_{nullptr};
+    std::atomic<char *> next_{nullptr};
+    // Cleared when the system has no huge pages reserved for MAP_HUGETLB
+    std::atomic<bool> useHugeTlb_{true};
+    std::mutex orphansMutex_;
+    FreeList orphans_[kNumClasses];
+    std::atomic<size_t> orphanCount_{0};
+};
+
+#ifdef __linux__
+bool HugePageArena::init(size_t size)
+{
+    size = (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    if (size == 0)
+        return false;
+    // Reserve one more page to align the range to the huge page size
+    void *base = ::mmap(nullptr,
+                        size + kHugePageSize,
+                        PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                        -1,
+                        0);
+    if (base == MAP_FAILED)
+        return false;
+    auto addr = reinterpret_cast<uintptr_t>(base);
+    auto aligned = (addr + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    if (aligned > addr)
+        ::munmap(base, aligned - addr);
+    if (aligned + size < addr + size + kHugePageSize)
+        ::munmap(reinterpret_cast<void *>(aligned + size),
+                 addr + kHugePageSize - aligned);
+    auto begin = reinterpret_cast<char *>(aligned);
+    end_ = begin + size;
+    next_.store(begin, std::memory_order_relaxed);
+    begin_.store(begin, std::memory_order_release);
+    return true;
+}
+
+char *HugePageArena::newPage()
+{
+    if (next_.load(std::memory_order_relaxed) >= end_)
+        return nullptr;
+    auto page = next_.fetch_add(kHugePageSize, std::memory_order_relaxed);
+    if (page >= end_)
+        return nullptr;
+    if (useHugeTlb_.load(std::memory_order_relaxed))
+    {
+        if (::mmap(page,
+                   kHugePageSize,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB,
+                   -1,
+                   0) != MAP_FAILED)
+            return page;
+        useHugeTlb_.store(false, std::memory_order_relaxed);
+    }
+    if (::mmap(page,
+               kHugePageSize,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+               -1,
+               0) == MAP_FAILED)
+        return nullptr;
+    // Transparent huge pages may be disabled, normal pages are fine then
+    ::madvise(page, kHugePageSize, MADV_HUGEPAGE);
+    return page;
+}
+#else
+bool HugePageArena::init(size_t)
+{
+    return false;
+}
+
+char *HugePageArena::newPage()
+{
+    return nullptr;
+}
+#endif
+
+void *HugePageArena::popOrphan(size_t index)
+{
+    if (orphanCount_.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+    std::lock_guard<std::mutex> lock(orphansMutex_);
+    auto &list = orphans_[index];
+    if (!list.head)
+        return nullptr;
+    orphanCount_.fetch_sub(1, std::memory_order_relaxed);
+    return list.pop();
+}
+
+void HugePageArena::pushOrphan(size_t index, void *ptr)
+{
+    std::lock_guard<std::mutex> lock(orphansMutex_);
+    orphans_[index].push(ptr);
+    orphanCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+HugePageArena &hugePageArena()
+{
+    // Never destroyed, chunks of the arena may be freed at exit
+    static HugePageArena *arena = new HugePageArena;
+    return *arena;
+}
+
+// Set when the pools of the thread are gone, memory freed after that (e.g. by
+// other thread-local objects) goes back to the heap directly.
+thread_local bool poolsDestroyed{false};
+
+struct ThreadPools
+{
+    FreeList lists[kNumClasses];
+    // The part of the current huge page not cut into chunks yet
+    char *pageCur{nullptr};
+    char *pageEnd{nullptr};
+    ~ThreadPools()
+    {
+        poolsDestroyed = true;
+        auto &arena = hugePageArena();
+        for (size_t i = 0; i < kNumClasses; ++i)
+        {
+            auto &list = lists[i];
+            while (list.head)
+            {
+                auto chunk = list.pop();
+                if (arena.contains(chunk))
+                    arena.pushOrphan(i, chunk);
+                else
+                    ::operator delete(chunk);
+            }
+        }
+    }
+    void *allocateFromArena(size_t index)
+    {
+        auto &arena = hugePageArena();
+        if (auto chunk = arena.popOrphan(index))
+            return chunk;
+        size_t size = classSize(index);
+        if (static_cast<size_t>(pageEnd - pageCur) < size)
+        {
+            // The rest of the page is lost, it is less than a chunk
+            auto page = arena.newPage();
+            if (!page)
+                return nullptr;
+            pageCur = page;
+            pageEnd = page + kHugePageSize;
+        }
+        auto chunk = pageCur;
+        pageCur += size;
+        return chunk;
+    }
+};
+
+ThreadPools &threadPools()
+{
+    static thread_local ThreadPools pools;
+    return pools;
+}
+}  // namespace
+
+void *trantor::detail::poolAllocate(size_t size)
+{
+    if (size > kMaxPooledSize)
+    {
+        auto ptr = ::operator new(size);
+        adviseHugePages(ptr, size);
+        return ptr;
+    }
+    auto index = classIndex(size);
+    if (!poolsDestroyed)
+    {
+        auto &pools = threadPools();
+        auto &list = pools.lists[index];
+        if (list.head)
+            return list.pop();
+        if (hugePageArena().enabled())
+        {
+            if (auto chunk = pools.allocateFromArena(index))
+                return chunk;
+        }
+    }
+    // Always allocate the whole class, the chunk may be pooled by another
+    // thread when it is freed
+    return ::operator new(classSize(index));
+}
+
+void trantor::detail::poolDeallocate(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+    if (size <= kMaxPooledSize)
+    {
+        auto index = classIndex(size);
+        if (!poolsDestroyed)
+        {
+            auto &list = threadPools().lists[index];
+            size_t maxCount = kMaxPooledBytesPerClass / classSize(index);
+            if (list.count < maxCount || list.count < kMinPooledChunks)
+            {
+                list.push(ptr);
+                return;
+            }
+        }
+        // Chunks of the arena are always kept. The ones the thread does not
+        // pool, e.g. when it frees the buffers of another thread, can be
+        // reused by any thread.
+        auto &arena = hugePageArena();
+        if (arena.contains(ptr))
+        {
+            arena.pushOrphan(index, ptr);
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
+void trantor::detail::adviseHugePages(void *ptr, size_t size)
+{
+#ifdef __linux__
+    if (size < kHugePageSize || !hugePageArena().enabled())
+        return;
+    auto addr = reinterpret_cast<uintptr_t>(ptr);
+    auto begin = (addr + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    auto end = (addr + size) / kHugePageSize * kHugePageSize;
+    if (begin < end)
+        ::madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+bool trantor::detail::inHugePageArena(const void *ptr)
+{
+    return hugePageArena().contains(ptr);
+}
+
+bool BufferPool::enableHugePages(size_t arenaSize)
+{
+    static const bool enabled = hugePageArena().init(arenaSize);
+    return enabled;
+}
+
+bool BufferPool::hugePagesEnabled()
+{
+    return hugePageArena().enabled();
+}
+
+size_t BufferPool::hugePageArenaUsage()
+{
+    return hugePageArena().usage();
+}
@@ -0,0 +1,125 @@
+/**
+ *
+ *  @file BufferPool.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+#include <trantor/exports.h>
+#include <stddef.h>
+#include <new>
+
+namespace trantor
+{
+namespace detail
+{
+/**
+ * @brief Get memory from the pools of the calling thread. Sizes up to 64KB
+ * are rounded up to a size class and served from a free list, larger ones
+ * come from the global heap.
+ */
+TRANTOR_EXPORT void *poolAllocate(size_t size);
+
+/**
+ * @brief Give back memory obtained from poolAllocate(), the size must be the
+ * one requested. The memory may be freed in any thread, it is then kept by
+ * the pools of that thread.
+ */
+TRANTOR_EXPORT void poolDeallocate(void *ptr, size_t size);
+
+/**
+ * @brief Ask the kernel to back the 2MB aligned part of [ptr, ptr + size)
+ * with transparent huge pages. Does nothing unless huge pages are enabled by
+ * BufferPool::enableHugePages().
+ */
+TRANTOR_EXPORT void adviseHugePages(void *ptr, size_t size);
+
+/**
+ * @brief Check if the memory is part of the huge page arena.
+ */
+TRANTOR_EXPORT bool inHugePageArena(const void *ptr);
+}  // namespace detail
+
+/**
+ * @brief Settings of the buffer pools used by MsgBuffer, the write queues of
+ * connections and AsyncFileLogger.
+ */
+class TRANTOR_EXPORT BufferPool
+{
+  public:
+    /**
+     * @brief Serve the pools from 2MB huge pages. The address space of the
+     * arena is reserved at once and committed one page at a time, with
+     * mmap(MAP_HUGETLB) when the system has huge pages reserved and with
+     * madvise(MADV_HUGEPAGE) on normal pages otherwise. Buffers larger than
+     * the pooled sizes are advised too. The memory of the arena is reused by
+     * the pools but never returned to the system.
+     *
+     * @param arenaSize The size of the arena, rounded up to 2MB. When it is
+     * used up, the pools fall back to the heap.
+     * @return false if huge pages are not supported on this platform or the
+     * address space cannot be reserved, the pools keep using the heap then.
+     * @note This method should be called before the event loops start and
+     * only once, later calls return the result of the first one.
+     */
+    static bool enableHugePages(size_t arenaSize = 1024 * 1024 * 1024);
+
+    /**
+     * @brief Check if the pools are served from huge pages.
+     */
+    static bool hugePagesEnabled();
+
+    /**
+     * @brief The number of bytes of the huge page arena that are in use by
+     * the pools.
+     */
+    static size_t hugePageArenaUsage();
+};
+
+/**
+ * @brief An allocator using the per-thread buffer pools. Each event loop runs
+ * in its own thread, so the buffers and buffer nodes of its connections are
+ * recycled without taking the locks of the global heap.
+ *
+ * @tparam T
+ */
+template <typename T>
+class PoolAllocator
+{
+  public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &) noexcept
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(detail::poolAllocate(n * sizeof(T)));
+    }
+    void deallocate(T *ptr, size_t n) noexcept
+    {
+        detail::poolDeallocate(ptr, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) noexcept
+{
+    return true;
+}
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) noexcept
+{
+    return false;
+}
+}  // namespace trantor
@@ -0,0 +1,479 @@
+/**
+ *
+ *  @file ByteSearch.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include "ByteSearch.h"
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    (defined(__i386__) && defined(__SSE2__)) ||  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANTOR_BYTE_SEARCH_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+// AVX2 code is compiled with the target attribute and only used when the CPU
+// supports it
+#define TRANTOR_BYTE_SEARCH_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define TRANTOR_BYTE_SEARCH_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+// Larger sets are searched with a lookup table
+constexpr size_t kMaxVectorSetSize{16};
+
+using FindSequenceFunc = const char *(*)(const char *,
+                                         const char *,
+                                         const char *,
+                                         size_t);
+using FindAnyOfFunc = const char *(*)(const char *,
+                                      const char *,
+                                      const char *,
+                                      size_t);
+
+struct ByteSearchImpl
+{
+    FindSequenceFunc findSequence;
+    FindAnyOfFunc findAnyOf;
+    FindAnyOfFunc findControlOrAnyOf;
+    const char *name;
+};
+
+// The caller makes sure that len >= 1 and that [p, end) is at least len bytes
+// long.
+const char *findSequenceScalar(const char *p,
+                               const char *end,
+                               const char *seq,
+                               size_t len)
+{
+    if (static_cast<size_t>(end - p) < len)
+        return nullptr;
+    const char *stop = end - len + 1;
+    const char last = seq[len - 1];
+    while (p < stop)
+    {
+        p = static_cast<const char *>(memchr(p, seq[0], stop - p));
+        if (!p)
+            return nullptr;
+        if (p[len - 1] == last &&
+            (len <= 2 || memcmp(p + 1, seq + 1, len - 2) == 0))
+            return p;
+        ++p;
+    }
+    return nullptr;
+}
+
+const char *findAnyOfScalar(const char *p,
+                            const char *end,
+                            const char *chars,
+                            size_t len)
+{
+    for (; p < end; ++p)
+    {
+        if (memchr(chars, *p, len))
+            return p;
+    }
+    return nullptr;
+}
+
+const char *findAnyOfTable(const char *p,
+                           const char *end,
+                           const char *chars,
+                           size_t len)
+{
+    bool table[256]{};
+    for (size_t i = 0; i < len; ++i)
+        table[static_cast<unsigned char>(chars[i])] = true;
+    for (; p < end; ++p)
+    {
+        if (table[static_cast<unsigned char>(*p)])
+            return p;
+    }
+    return nullptr;
+}
+
+const char *findControlOrAnyOfScalar(const char *p,
+                                     const char *end,
+                                     const char *chars,
+                                     size_t len)
+{
+    // The strings of the logs are short, most of them are only searched here
+    for (; p < end; ++p)
+    {
+        if (static_cast<unsigned char>(*p) < 0x20)
+            return p;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (*p == chars[i])
+                return p;
+        }
+    }
+    return nullptr;
+}
+
+#if defined(TRANTOR_BYTE_SEARCH_SSE2) || defined(TRANTOR_BYTE_SEARCH_AVX2)
+inline unsigned int countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// The vector implementations compare the first and the last byte of the
+// sequence at 16 or 32 positions at once and only compare the bytes in between
+// for the candidates.
+
+#ifdef TRANTOR_BYTE_SEARCH_SSE2
+const char *findSequenceSSE2(const char *p,
+                             const char *end,
+                             const char *seq,
+                             size_t len)
+{
+    const __m128i first = _mm_set1_epi8(seq[0]);
+    const __m128i last = _mm_set1_epi8(seq[len - 1]);
+    while (static_cast<size_t>(end - p) >= len - 1 + 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + len - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        while (mask)
+        {
+            auto i = countTrailingZeros(mask);
+            if (len <= 2 || memcmp(p + i + 1, seq + 1, len - 2) == 0)
+                return p + i;
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return findSequenceScalar(p, end, seq, len);
+}
+
+const char *findAnyOfSSE2(const char *p,
+                          const char *end,
+                          const char *chars,
+                          size_t len)
+{
+    __m128i set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = _mm_set1_epi8(chars[i]);
+    while (end - p >= 16)
+    {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hit = _mm_cmpeq_epi8(data, set[0]);
+        for (size_t i = 1; i < len; ++i)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(data, set[i]));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if (mask)
+            return p + countTrailingZeros(mask);
+        p += 16;
+    }
+    return findAnyOfScalar(p, end, chars, len);
+}
+
+// There is no unsigned comparison in SSE2, the bytes below 0x20 are the ones
+// equal to their minimum with 0x1f
+const char *findControlOrAnyOfSSE2(const char *p,
+                                   const char *end,
+                                   const char *chars,
+                                   size_t len)
+{
+    const __m128i maxControl = _mm_set1_epi8(0x1f);
+    __m128i set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = _mm_set1_epi8(chars[i]);
+    auto search = [&](const char *pos) {
+        __m128i data =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(data, maxControl), data);
+        for (size_t i = 0; i < len; ++i)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(data, set[i]));
+        return static_cast<uint32_t>(_mm_movemask_epi8(hit));
+    };
+    if (end - p < 16)
+        return findControlOrAnyOfScalar(p, end, chars, len);
+    while (end - p >= 16)
+    {
+        uint32_t mask = search(p);
+        if (mask)
+            return p + countTrailingZeros(mask);
+        p += 16;
+    }
+    if (p == end)
+        return nullptr;
+    // The last 16 bytes, without the ones already searched
+    uint32_t mask = search(end - 16) >> (16 - (end - p));
+    if (mask)
+        return p + countTrailingZeros(mask);
+    return nullptr;
+}
+#endif
+
+#ifdef TRANTOR_BYTE_SEARCH_AVX2
+__attribute__((target("avx2"))) const char *findSequenceAVX2(const char *p,
+                                                             const char *end,
+                                                             const char *seq,
+                                                             size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(seq[0]);
+    const __m256i last = _mm256_set1_epi8(seq[len - 1]);
+    while (static_cast<size_t>(end - p) >= len - 1 + 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(p + len - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                                  _mm256_cmpeq_epi8(b, last))));
+        while (mask)
+        {
+            auto i = countTrailingZeros(mask);
+            if (len <= 2 || memcmp(p + i + 1, seq + 1, len - 2) == 0)
+                return p + i;
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return findSequenceSSE2(p, end, seq, len);
+}
+
+__attribute__((target("avx2"))) const char *findAnyOfAVX2(const char *p,
+                                                          const char *end,
+                                                          const char *chars,
+                                                          size_t len)
+{
+    __m256i set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = _mm256_set1_epi8(chars[i]);
+    while (end - p >= 32)
+    {
+        __m256i data =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit = _mm256_cmpeq_epi8(data, set[0]);
+        for (size_t i = 1; i < len; ++i)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, set[i]));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask)
+            return p + countTrailingZeros(mask);
+        p += 32;
+    }
+    return findAnyOfSSE2(p, end, chars, len);
+}
+
+__attribute__((target("avx2"))) const char *findControlOrAnyOfAVX2(
+    const char *p,
+    const char *end,
+    const char *chars,
+    size_t len)
+{
+    const __m256i maxControl = _mm256_set1_epi8(0x1f);
+    __m256i set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = _mm256_set1_epi8(chars[i]);
+    while (end - p >= 32)
+    {
+        __m256i data =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit =
+            _mm256_cmpeq_epi8(_mm256_min_epu8(data, maxControl), data);
+        for (size_t i = 0; i < len; ++i)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, set[i]));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask)
+            return p + countTrailingZeros(mask);
+        p += 32;
+    }
+    return findControlOrAnyOfSSE2(p, end, chars, len);
+}
+#endif
+
+#ifdef TRANTOR_BYTE_SEARCH_NEON
+// NEON has no movemask, narrow the comparison result to 4 bits per byte
+inline uint64_t toMask(uint8x16_t cmp)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+                             vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)),
+                         0);
+}
+
+inline unsigned int firstByteOfMask(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index >> 2;
+#else
+    return __builtin_ctzll(mask) >> 2;
+#endif
+}
+
+const char *findSequenceNEON(const char *p,
+                             const char *end,
+                             const char *seq,
+                             size_t len)
+{
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(seq[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(seq[len - 1]));
+    while (static_cast<size_t>(end - p) >= len - 1 + 16)
+    {
+        uint8x16_t a = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t b =
+            vld1q_u8(reinterpret_cast<const uint8_t *>(p + len - 1));
+        uint64_t mask =
+            toMask(vandq_u8(vceqq_u8(a, first), vceqq_u8(b, last)));
+        while (mask)
+        {
+            auto i = firstByteOfMask(mask);
+            if (len <= 2 || memcmp(p + i + 1, seq + 1, len - 2) == 0)
+                return p + i;
+            mask &= ~(uint64_t{0xf} << (i * 4));
+        }
+        p += 16;
+    }
+    return findSequenceScalar(p, end, seq, len);
+}
+
+const char *findAnyOfNEON(const char *p,
+                          const char *end,
+                          const char *chars,
+                          size_t len)
+{
+    uint8x16_t set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = vdupq_n_u8(static_cast<uint8_t>(chars[i]));
+    while (end - p >= 16)
+    {
+        uint8x16_t data = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t hit = vceqq_u8(data, set[0]);
+        for (size_t i = 1; i < len; ++i)
+            hit = vorrq_u8(hit, vceqq_u8(data, set[i]));
+        uint64_t mask = toMask(hit);
+        if (mask)
+            return p + firstByteOfMask(mask);
+        p += 16;
+    }
+    return findAnyOfScalar(p, end, chars, len);
+}
+
+const char *findControlOrAnyOfNEON(const char *p,
+                                   const char *end,
+                                   const char *chars,
+                                   size_t len)
+{
+    const uint8x16_t control = vdupq_n_u8(0x20);
+    uint8x16_t set[kMaxVectorSetSize];
+    for (size_t i = 0; i < len; ++i)
+        set[i] = vdupq_n_u8(static_cast<uint8_t>(chars[i]));
+    while (end - p >= 16)
+    {
+        uint8x16_t data = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t hit = vcltq_u8(data, control);
+        for (size_t i = 0; i < len; ++i)
+            hit = vorrq_u8(hit, vceqq_u8(data, set[i]));
+        uint64_t mask = toMask(hit);
+        if (mask)
+            return p + firstByteOfMask(mask);
+        p += 16;
+    }
+    return findControlOrAnyOfScalar(p, end, chars, len);
+}
+#endif
+
+ByteSearchImpl selectImpl()
+{
+#ifdef TRANTOR_BYTE_SEARCH_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {findSequenceAVX2,
+                findAnyOfAVX2,
+                findControlOrAnyOfAVX2,
+                "avx2"};
+#endif
+#if defined(TRANTOR_BYTE_SEARCH_SSE2)
+    return {findSequenceSSE2,
+            findAnyOfSSE2,
+            findControlOrAnyOfSSE2,
+            "sse2"};
+#elif defined(TRANTOR_BYTE_SEARCH_NEON)
+    return {findSequenceNEON,
+            findAnyOfNEON,
+            findControlOrAnyOfNEON,
+            "neon"};
+#else
+    return {findSequenceScalar,
+            findAnyOfScalar,
+            findControlOrAnyOfScalar,
+            "scalar"};
+#endif
+}
+
+const ByteSearchImpl &impl()
+{
+    static const ByteSearchImpl instance = selectImpl();
+    return instance;
+}
+}  // namespace
+
+const char *trantor::detail::findSequence(const char *begin,
+                                          const char *end,
+                                          const char *seq,
+                                          size_t len)
+{
+    if (len == 0 || begin >= end || static_cast<size_t>(end - begin) < len)
+        return nullptr;
+    if (len == 1)
+        return static_cast<const char *>(memchr(begin, seq[0], end - begin));
+    return impl().findSequence(begin, end, seq, len);
+}
+
+const char *trantor::detail::findAnyOf(const char *begin,
+                                       const char *end,
+                                       const char *chars,
+                                       size_t len)
+{
+    if (len == 0 || begin >= end)
+        return nullptr;
+    if (len == 1)
+        return static_cast<const char *>(memchr(begin, chars[0], end - begin));
+    if (len > kMaxVectorSetSize)
+        return findAnyOfTable(begin, end, chars, len);
+    return impl().findAnyOf(begin, end, chars, len);
+}
+
+const char *trantor::detail::findControlOrAnyOf(const char *begin,
+                                                const char *end,
+                                                const char *chars,
+                                                size_t len)
+{
+    assert(len <= kMaxVectorSetSize);
+    if (begin >= end)
+        return nullptr;
+    return impl().findControlOrAnyOf(begin, end, chars, len);
+}
+
+const char *trantor::detail::byteSearchBackend()
+{
+    return impl().name;
+}
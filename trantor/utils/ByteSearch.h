@@ -0,0 +1,59 @@
+/**
+ *
+ *  @file ByteSearch.h
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *  Vectorized search primitives used by MsgBuffer and LogStream. The
+ *  implementation (AVX2, SSE2, NEON or scalar) is chosen once at runtime.
+ *
+ */
+
+#pragma once
+#include <stddef.h>
+
+namespace trantor
+{
+namespace detail
+{
+/**
+ * @brief Find the first occurrence of seq in [begin, end).
+ *
+ * @return const char* nullptr if not found or if len is 0.
+ */
+const char *findSequence(const char *begin,
+                         const char *end,
+                         const char *seq,
+                         size_t len);
+
+/**
+ * @brief Find the first byte in [begin, end) that is one of the len bytes in
+ * chars.
+ *
+ * @return const char* nullptr if not found or if len is 0.
+ */
+const char *findAnyOf(const char *begin,
+                      const char *end,
+                      const char *chars,
+                      size_t len);
+
+/**
+ * @brief Find the first byte in [begin, end) that is a control character
+ * (below 0x20) or one of the len bytes in chars, which are at most 16. Used
+ * to find the bytes to escape in JSON and logfmt strings.
+ *
+ * @return const char* nullptr if not found.
+ */
+const char *findControlOrAnyOf(const char *begin,
+                               const char *end,
+                               const char *chars,
+                               size_t len);
+
+/**
+ * @brief The name of the implementation in use, e.g. "avx2".
+ */
+const char *byteSearchBackend();
+}  // namespace detail
+}  // namespace trantor
@@ -0,0 +1,642 @@
+/**
+ *
+ *  @file DeferredLogger.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/utils/DeferredLogger.h>
+#include <trantor/utils/BinaryCodec.h>
+#include <trantor/utils/LogFlightRecorder.h>
+#include <trantor/utils/LogRing.h>
+#include <trantor/utils/Date.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <stdio.h>
+
+using namespace trantor;
+
+namespace
+{
+// How often the thread collects the buffers of the threads
+constexpr std::chrono::milliseconds kPollInterval{50};
+// The size of the binary output passed to the output function at once
+constexpr size_t kMaxOutputSize{4 * 1024 * 1024};
+
+// The binary output starts with the magic number, the version of the format
+// and the byte order of the arguments
+const char kHeader[] = {'T',
+                        'R',
+                        'D',
+                        'L',
+                        1,
+                        codec::detail::kHostBigEndian ? 'B' : 'L'};
+
+// The entries of the binary output
+enum EntryType : char
+{
+    // A call site: id, level, line, file name and function name
+    kSiteEntry = 'S',
+    // A message: site id, time, thread id and arguments
+    kMessageEntry = 'M',
+    // The number of lost messages
+    kLostEntry = 'L'
+};
+
+void outputLost(
+    const std::function<void(const char *msg, const uint64_t len)> &outputFunc,
+    uint64_t lost)
+{
+    LogStream logErr;
+    Logger::formatLostMessages(logErr, lost);
+    outputFunc(logErr.bufferData(), logErr.bufferLength());
+}
+
+void appendVarint(std::string &out, uint64_t v)
+{
+    char buf[10];
+    out.append(buf, codec::putVarint(buf, v) - buf);
+}
+
+void appendString(std::string &out, const char *str, size_t len)
+{
+    appendVarint(out, len);
+    out.append(str, len);
+}
+}  // namespace
+
+class DeferredLogger::ThreadRing : public detail::LogRing
+{
+  public:
+    ThreadRing(size_t capacity, uint64_t id) : LogRing(capacity), threadId(id)
+    {
+    }
+    const uint64_t threadId;
+};
+
+struct DeferredLogger::State
+{
+    State()
+    {
+        // The thread outputs to Logger until this object is destroyed
+        Logger::outputFunc_();
+        Logger::flushFunc_();
+    }
+    ~State()
+    {
+        DeferredLogger::stop();
+    }
+
+    const DeferredLogSite *siteOf(uint32_t id)
+    {
+        if (id >= siteCache.size())
+        {
+            std::lock_guard<std::mutex> lock(sitesMutex);
+            siteCache = sites;
+        }
+        return siteCache[id];
+    }
+    void writeSite(std::string &out, const DeferredLogSite &site)
+    {
+        if (site.id >= sitesWritten.size())
+            sitesWritten.resize(site.id + 1);
+        if (sitesWritten[site.id])
+            return;
+        sitesWritten[site.id] = true;
+        out.push_back(kSiteEntry);
+        appendVarint(out, site.id);
+        out.push_back(static_cast<char>(site.level));
+        appendVarint(out, static_cast<uint64_t>(site.line));
+        appendString(out,
+                     site.file.data_,
+                     static_cast<size_t>(site.file.size_));
+        if (site.func)
+            appendString(out, site.func, strlen(site.func));
+        else
+            appendVarint(out, 0);
+    }
+
+    std::mutex sitesMutex;
+    std::vector<const DeferredLogSite *> sites;
+
+    std::atomic<bool> running{false};
+    // Incremented on each start, the threads then use new buffers
+    std::atomic<uint64_t> generation{0};
+    std::atomic<size_t> bufferSize{0};
+    std::mutex ringsMutex;
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::unique_ptr<std::thread> thread;
+    bool stopping{false};
+
+    // Owned by the thread collecting the buffers
+    std::vector<const DeferredLogSite *> siteCache;
+    bool binary{false};
+    std::function<void(const char *msg, const uint64_t len)> outputFunc;
+    std::function<void()> flushFunc;
+    bool headerWritten{false};
+    std::vector<bool> sitesWritten;
+};
+
+DeferredLogger::State &DeferredLogger::state()
+{
+    static State s;
+    return s;
+}
+
+DeferredLogger::ThreadRing *DeferredLogger::threadRing(State &s)
+{
+    struct CachedRing
+    {
+        uint64_t generation{0};
+        std::shared_ptr<ThreadRing> ring;
+        ~CachedRing()
+        {
+            // Let the logger thread release the ring once collected
+            if (ring)
+                ring->close();
+        }
+    };
+    static thread_local CachedRing cache;
+    auto generation = s.generation.load(std::memory_order_acquire);
+    if (cache.generation == generation)
+        return cache.ring.get();
+    if (cache.ring)
+        cache.ring->close();
+    cache.ring = std::make_shared<ThreadRing>(s.bufferSize.load(),
+                                              Logger::currentThreadId());
+    cache.generation = generation;
+    {
+        std::lock_guard<std::mutex> lock(s.ringsMutex);
+        s.rings.push_back(cache.ring);
+    }
+    return cache.ring.get();
+}
+
+void DeferredLogger::drain(State &s)
+{
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(s.ringsMutex);
+        rings = s.rings;
+    }
+    std::string out;
+    if (s.binary && !s.headerWritten)
+    {
+        out.append(kHeader, sizeof(kHeader));
+        s.headerWritten = true;
+    }
+    bool written = false;
+    for (auto &ring : rings)
+    {
+        auto lost = ring->takeLost();
+        if (lost == 0)
+            continue;
+        if (s.binary)
+        {
+            out.push_back(kLostEntry);
+            appendVarint(out, lost);
+        }
+        else
+        {
+            outputLost(Logger::outputFunc_(), lost);
+            written = true;
+        }
+    }
+
+    detail::mergeLogRings(
+        rings,
+        Date::now().microSecondsSinceEpoch(),
+        [&s, &out, &written](ThreadRing &ring,
+                             const ThreadRing::Record *record) {
+            auto site = s.siteOf(record->tag);
+            auto args = reinterpret_cast<const char *>(record + 1);
+            if (s.binary && site->level < Logger::logLevel())
+            {
+                // Captured for LogFlightRecorder only
+                if (site->level >= Logger::recordLevel_())
+                {
+                    Logger logger(site->file,
+                                  site->line,
+                                  site->level,
+                                  site->func,
+                                  Date(record->time),
+                                  ring.threadId,
+                                  false);
+                    DeferredLogger::formatArgs(logger.stream(),
+                                               args,
+                                               record->length);
+                    logger.finish();
+                    LogFlightRecorder::record(record->time,
+                                              logger.stream().bufferData(),
+                                              logger.stream().bufferLength());
+                }
+                return;
+            }
+            if (!s.binary)
+            {
+                Logger logger(site->file,
+                              site->line,
+                              site->level,
+                              site->func,
+                              Date(record->time),
+                              ring.threadId);
+                DeferredLogger::formatArgs(logger.stream(),
+                                           args,
+                                           record->length);
+                written = true;
+                return;
+            }
+            s.writeSite(out, *site);
+            out.push_back(kMessageEntry);
+            appendVarint(out, site->id);
+            char time[sizeof(int64_t)];
+            memcpy(time, &record->time, sizeof(time));
+            out.append(time, sizeof(time));
+            appendVarint(out, ring.threadId);
+            appendString(out, args, record->length);
+            if (out.length() >= kMaxOutputSize)
+            {
+                s.outputFunc(out.data(), out.length());
+                out.clear();
+                written = true;
+            }
+        });
+
+    if (!out.empty())
+    {
+        s.outputFunc(out.data(), out.length());
+        written = true;
+    }
+    if (written)
+    {
+        if (!s.binary)
+            Logger::flushFunc_()();
+        else if (s.flushFunc)
+            s.flushFunc();
+    }
+
+    // Release the rings of the threads that are gone
+    std::lock_guard<std::mutex> lock(s.ringsMutex);
+    detail::removeClosedLogRings(s.rings);
+}
+
+void DeferredLogger::threadFunc(State &s)
+{
+#ifdef __linux__
+    prctl(PR_SET_NAME, "DeferredLogger");
+#endif
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while (!s.stopping)
+    {
+        s.cond.wait_for(lock, kPollInterval);
+        lock.unlock();
+        drain(s);
+        lock.lock();
+    }
+}
+
+void DeferredLogger::startThread(
+    size_t bufferSize,
+    bool binary,
+    std::function<void(const char *msg, const uint64_t len)> outputFunc,
+    std::function<void()> flushFunc)
+{
+    stop();
+    auto &s = state();
+    size_t capacity = 4096;
+    while (capacity < bufferSize)
+        capacity <<= 1;
+    // Messages left in the buffers of the previous run, if any, are output
+    // by this one
+    s.binary = binary;
+    s.outputFunc = std::move(outputFunc);
+    s.flushFunc = std::move(flushFunc);
+    s.headerWritten = false;
+    s.sitesWritten.clear();
+    s.bufferSize = capacity;
+    ++s.generation;
+    s.running = true;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.thread.reset(new std::thread([&s]() { threadFunc(s); }));
+}
+
+void DeferredLogger::start(size_t bufferSize)
+{
+    startThread(bufferSize, false, nullptr, nullptr);
+}
+
+void DeferredLogger::startBinary(
+    std::function<void(const char *msg, const uint64_t len)> outputFunc,
+    std::function<void()> flushFunc,
+    size_t bufferSize)
+{
+    if (!outputFunc)
+        throw std::invalid_argument("The output function is empty");
+    startThread(bufferSize,
+                true,
+                std::move(outputFunc),
+                std::move(flushFunc));
+}
+
+void DeferredLogger::stop()
+{
+    auto &s = state();
+    std::unique_ptr<std::thread> thread;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.thread)
+            return;
+        s.running = false;
+        s.stopping = true;
+        thread = std::move(s.thread);
+    }
+    s.cond.notify_all();
+    thread->join();
+    drain(s);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.stopping = false;
+}
+
+bool DeferredLogger::isRunning()
+{
+    return state().running.load(std::memory_order_acquire);
+}
+
+void DeferredLogger::flush()
+{
+    state().cond.notify_one();
+}
+
+uint32_t DeferredLogger::registerSite(const DeferredLogSite *site)
+{
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.sitesMutex);
+    s.sites.push_back(site);
+    return static_cast<uint32_t>(s.sites.size() - 1);
+}
+
+void DeferredLogger::commit(const DeferredLogSite &site,
+                            const char *args,
+                            size_t len)
+{
+    auto &s = state();
+    if (s.running.load(std::memory_order_acquire))
+    {
+        auto ring = threadRing(s);
+        if (len <= ring->capacity() / 4)
+        {
+            if (ring->push(Date::now().microSecondsSinceEpoch(),
+                           args,
+                           len,
+                           site.id) &&
+                ring->shouldNotify())
+                s.cond.notify_one();
+            return;
+        }
+    }
+    Logger logger(site.file,
+                  site.line,
+                  site.level,
+                  site.func,
+                  Date::now(),
+                  Logger::currentThreadId());
+    formatArgs(logger.stream(), args, len);
+}
+
+bool DeferredLogger::formatArgs(LogStream &stream,
+                                const char *args,
+                                size_t len)
+{
+    auto p = args;
+    auto end = args + len;
+    while (p < end)
+    {
+        auto type = static_cast<uint8_t>(*p++);
+        size_t size;
+        switch (type)
+        {
+            case kBool:
+            case kChar:
+                size = 1;
+                break;
+            case kInt32:
+            case kUInt32:
+            case kFloat:
+                size = 4;
+                break;
+            case kString:
+                size = sizeof(uint32_t);
+                break;
+            default:
+                size = 8;
+                break;
+        }
+        if (static_cast<size_t>(end - p) < size)
+            return false;
+        switch (type)
+        {
+            case kBool:
+                stream << (*p != 0);
+                break;
+            case kChar:
+                stream << *p;
+                break;
+            case kInt32:
+            {
+                int32_t v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kUInt32:
+            {
+                uint32_t v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kInt64:
+            {
+                int64_t v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kUInt64:
+            {
+                uint64_t v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kDouble:
+            {
+                double v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kFloat:
+            {
+                float v;
+                memcpy(&v, p, size);
+                stream << v;
+                break;
+            }
+            case kPointer:
+            {
+                uint64_t v;
+                memcpy(&v, p, size);
+                stream << reinterpret_cast<const void *>(
+                    static_cast<uintptr_t>(v));
+                break;
+            }
+            case kString:
+            {
+                uint32_t length;
+                memcpy(&length, p, size);
+                if (static_cast<size_t>(end - p - size) < length)
+                    return false;
+                stream.append(p + size, length);
+                size += length;
+                break;
+            }
+            default:
+                return false;
+        }
+        p += size;
+    }
+    return true;
+}
+
+namespace
+{
+// Reads the entries of the binary output, a read returns false if the entry
+// is incomplete
+struct EntryReader
+{
+    const char *p;
+    const char *end;
+
+    bool varint(uint64_t &v)
+    {
+        switch (codec::getVarint(p, end, v))
+        {
+            case codec::DecodeStatus::Ok:
+                return true;
+            case codec::DecodeStatus::NeedMoreData:
+                return false;
+            default:
+                throw std::runtime_error("Malformed deferred log");
+        }
+    }
+    bool bytes(const char *&data, size_t len)
+    {
+        if (static_cast<size_t>(end - p) < len)
+            return false;
+        data = p;
+        p += len;
+        return true;
+    }
+    bool string(const char *&data, uint64_t &len)
+    {
+        return varint(len) && bytes(data, static_cast<size_t>(len));
+    }
+};
+}  // namespace
+
+size_t DeferredLogDecoder::decode(
+    const char *data,
+    size_t len,
+    const std::function<void(const char *msg, const uint64_t len)> &outputFunc)
+{
+    EntryReader reader{data, data + len};
+    if (!headerDecoded_)
+    {
+        const char *header;
+        if (!reader.bytes(header, sizeof(kHeader)))
+            return 0;
+        if (memcmp(header, kHeader, sizeof(kHeader)) != 0)
+            throw std::runtime_error(
+                "Not a deferred log of this version and byte order");
+        headerDecoded_ = true;
+    }
+    size_t decoded = reader.p - data;
+    while (reader.p < reader.end)
+    {
+        auto type = *reader.p++;
+        if (type == kSiteEntry)
+        {
+            uint64_t id, line, fileLen, funcLen;
+            const char *level, *file, *func;
+            if (!reader.varint(id) || !reader.bytes(level, 1) ||
+                !reader.varint(line) || !reader.string(file, fileLen) ||
+                !reader.string(func, funcLen))
+                break;
+            if (static_cast<uint8_t>(*level) >= Logger::kNumberOfLogLevels)
+                throw std::runtime_error("Malformed deferred log");
+            if (id >= sites_.size())
+                sites_.resize(static_cast<size_t>(id + 1));
+            auto &site = sites_[static_cast<size_t>(id)];
+            site.file.assign(file, static_cast<size_t>(fileLen));
+            site.func.assign(func, static_cast<size_t>(funcLen));
+            site.line = static_cast<int>(line);
+            site.level = static_cast<Logger::LogLevel>(*level);
+        }
+        else if (type == kMessageEntry)
+        {
+            uint64_t id, threadId, argsLen;
+            const char *time, *args;
+            if (!reader.varint(id) || !reader.bytes(time, sizeof(int64_t)) ||
+                !reader.varint(threadId) || !reader.string(args, argsLen))
+                break;
+            if (id >= sites_.size() || sites_[id].file.empty())
+                throw std::runtime_error("Unknown call site in deferred log");
+            auto &site = sites_[static_cast<size_t>(id)];
+            int64_t microSeconds;
+            memcpy(&microSeconds, time, sizeof(microSeconds));
+            Logger logger(Logger::SourceFile(site.file.c_str()),
+                          site.line,
+                          site.level,
+                          site.func.empty() ? nullptr : site.func.c_str(),
+                          Date(microSeconds),
+                          threadId,
+                          false);
+            if (!DeferredLogger::formatArgs(logger.stream(),
+                                            args,
+                                            static_cast<size_t>(argsLen)))
+                throw std::runtime_error("Malformed deferred log");
+            logger.finish();
+            outputFunc(logger.stream().bufferData(),
+                       logger.stream().bufferLength());
+        }
+        else if (type == kLostEntry)
+        {
+            uint64_t lost;
+            if (!reader.varint(lost))
+                break;
+            outputLost(outputFunc, lost);
+        }
+        else
+        {
+            throw std::runtime_error("Malformed deferred log");
+        }
+        decoded = reader.p - data;
+    }
+    return decoded;
+}
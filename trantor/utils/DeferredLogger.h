@@ -0,0 +1,407 @@
+/**
+ *
+ *  @file DeferredLogger.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+
+#include <trantor/utils/Logger.h>
+#include <trantor/utils/LogStream.h>
+#include <trantor/utils/NonCopyable.h>
+#include <trantor/exports.h>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace trantor
+{
+struct DeferredLogSite;
+
+/**
+ * @brief This class formats the messages of the LOG_DEFERRED_* macros in a
+ * background thread.
+ *
+ * The deferred macros only copy the arguments of a message in their binary
+ * form, along with a reference to the static descriptor of the call site
+ * (source location and level), to a buffer owned by the calling thread. The
+ * thread of the deferred logger merges the buffers of all the threads and
+ * either formats the messages as Logger does and passes them to the output
+ * function of Logger, or writes them in binary form to be decoded later by
+ * DeferredLogDecoder.
+ *
+ * When the deferred logger is not running, the deferred macros format their
+ * messages right away like the other macros.
+ *
+ * @note Deferred messages are output after they are merged, so they may be
+ * output after messages logged later with the other macros. The messages
+ * still in the buffers are lost if the process crashes.
+ */
+class TRANTOR_EXPORT DeferredLogger : NonCopyable
+{
+  public:
+    /**
+     * @brief Start the thread formatting the deferred messages and passing
+     * them to the output function of Logger.
+     *
+     * @param bufferSize The size of the buffer of each thread, rounded up to
+     * a power of two. Messages that do not fit in the buffer of their thread
+     * are dropped and reported as lost, messages larger than a quarter of the
+     * buffer are formatted right away.
+     */
+    static void start(size_t bufferSize = 1024 * 1024);
+
+    /**
+     * @brief Start the thread writing the deferred messages in binary form
+     * to outputFunc. The output starts with the descriptors of the call sites
+     * and is decoded by DeferredLogDecoder, so it must be kept from the
+     * beginning.
+     */
+    static void startBinary(
+        std::function<void(const char *msg, const uint64_t len)> outputFunc,
+        std::function<void()> flushFunc,
+        size_t bufferSize = 1024 * 1024);
+
+    /**
+     * @brief Output all the buffered messages and stop the thread. The
+     * deferred macros format their messages right away after it.
+     */
+    static void stop();
+
+    static bool isRunning();
+
+    /**
+     * @brief Wake up the thread to output the buffered messages now.
+     */
+    static void flush();
+
+    /**
+     * @brief Register a call site, returns its id in the binary output.
+     */
+    static uint32_t registerSite(const DeferredLogSite *site);
+
+    /**
+     * @brief Buffer the arguments of a message, or format them right away
+     * if the deferred logger is not running.
+     */
+    static void commit(const DeferredLogSite &site,
+                       const char *args,
+                       size_t len);
+
+    // The tags of the arguments in their binary form
+    enum ArgType : uint8_t
+    {
+        kBool = 1,
+        kChar,
+        kInt32,
+        kUInt32,
+        kInt64,
+        kUInt64,
+        kDouble,
+        kPointer,
+        kString,
+        kFloat
+    };
+
+    /**
+     * @brief Format the binary arguments of a message into the stream.
+     *
+     * @return false if the arguments are malformed.
+     */
+    static bool formatArgs(LogStream &stream, const char *args, size_t len);
+
+  private:
+    struct State;
+    class ThreadRing;
+    static State &state();
+    static ThreadRing *threadRing(State &s);
+    static void drain(State &s);
+    static void threadFunc(State &s);
+    static void startThread(
+        size_t bufferSize,
+        bool binary,
+        std::function<void(const char *msg, const uint64_t len)> outputFunc,
+        std::function<void()> flushFunc);
+};
+
+/**
+ * @brief The static descriptor of a call site of the deferred macros.
+ */
+struct TRANTOR_EXPORT DeferredLogSite
+{
+    template <int N>
+    DeferredLogSite(const char (&fileName)[N],
+                    int fileLine,
+                    Logger::LogLevel logLevel,
+                    const char *funcName)
+        : file(fileName),
+          line(fileLine),
+          level(logLevel),
+          func(funcName),
+          id(DeferredLogger::registerSite(this))
+    {
+    }
+
+    Logger::SourceFile file;
+    int line;
+    Logger::LogLevel level;
+    // Only set for the levels showing the function name
+    const char *func;
+    uint32_t id;
+};
+
+/**
+ * @brief The stream of the LOG_DEFERRED_* macros, it stores the arguments in
+ * their binary form. Arguments of the types LogStream does not handle
+ * natively are formatted right away through their operator<<.
+ */
+class TRANTOR_EXPORT DeferredLogStream : NonCopyable
+{
+    using self = DeferredLogStream;
+
+  public:
+    explicit DeferredLogStream(const DeferredLogSite &site) : site_(site)
+    {
+    }
+    ~DeferredLogStream()
+    {
+        DeferredLogger::commit(site_, args(), length());
+    }
+
+    self &operator<<(bool v)
+    {
+        return put(DeferredLogger::kBool, static_cast<uint8_t>(v));
+    }
+    self &operator<<(char v)
+    {
+        return put(DeferredLogger::kChar, v);
+    }
+    self &operator<<(short v)
+    {
+        return put(DeferredLogger::kInt32, static_cast<int32_t>(v));
+    }
+    self &operator<<(unsigned short v)
+    {
+        return put(DeferredLogger::kUInt32, static_cast<uint32_t>(v));
+    }
+    self &operator<<(int v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(unsigned int v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(long v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(unsigned long v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(long long v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(unsigned long long v)
+    {
+        return putInteger(v);
+    }
+    self &operator<<(float v)
+    {
+        return put(DeferredLogger::kFloat, v);
+    }
+    self &operator<<(double v)
+    {
+        return put(DeferredLogger::kDouble, v);
+    }
+    self &operator<<(long double v)
+    {
+        return put(DeferredLogger::kDouble, static_cast<double>(v));
+    }
+    self &operator<<(const void *v)
+    {
+        return put(DeferredLogger::kPointer,
+                   static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+    }
+    template <int N>
+    self &operator<<(const char (&buf)[N])
+    {
+        return putString(buf, N - 1);
+    }
+    self &operator<<(const char *str)
+    {
+        if (str)
+            return putString(str, strlen(str));
+        return putString("(null)", 6);
+    }
+    self &operator<<(char *str)
+    {
+        return operator<<(static_cast<const char *>(str));
+    }
+    self &operator<<(const unsigned char *str)
+    {
+        return operator<<(reinterpret_cast<const char *>(str));
+    }
+    self &operator<<(const std::string &v)
+    {
+        return putString(v.data(), v.length());
+    }
+    self &operator<<(const Fmt &fmt)
+    {
+        return putString(fmt.data(), fmt.length());
+    }
+
+    template <typename T>
+    typename std::enable_if<
+        !std::is_pointer<T>::value,
+        decltype(std::declval<LogStream &>() << std::declval<const T &>(),
+                 std::declval<self &>())>::type
+    operator<<(const T &v)
+    {
+        LogStream stream;
+        stream << v;
+        return putString(stream.bufferData(), stream.bufferLength());
+    }
+
+    const char *args() const
+    {
+        return exBuffer_.empty() ? buffer_ : exBuffer_.data();
+    }
+    size_t length() const
+    {
+        return exBuffer_.empty() ? length_ : exBuffer_.length();
+    }
+
+  private:
+    template <typename T>
+    self &putInteger(T v)
+    {
+        constexpr bool isSigned = std::is_signed<T>::value;
+        if (sizeof(T) <= 4)
+        {
+            if (isSigned)
+                return put(DeferredLogger::kInt32, static_cast<int32_t>(v));
+            return put(DeferredLogger::kUInt32, static_cast<uint32_t>(v));
+        }
+        if (isSigned)
+            return put(DeferredLogger::kInt64, static_cast<int64_t>(v));
+        return put(DeferredLogger::kUInt64, static_cast<uint64_t>(v));
+    }
+    template <typename T>
+    self &put(DeferredLogger::ArgType type, T v)
+    {
+        // Stored in the byte order of the host, the binary output is decoded
+        // on a host with the same byte order
+        char data[1 + sizeof(T)];
+        data[0] = static_cast<char>(type);
+        memcpy(data + 1, &v, sizeof(T));
+        append(data, sizeof(data));
+        return *this;
+    }
+    self &putString(const char *str, size_t len)
+    {
+        char header[1 + sizeof(uint32_t)];
+        header[0] = static_cast<char>(DeferredLogger::kString);
+        auto size = static_cast<uint32_t>(len);
+        memcpy(header + 1, &size, sizeof(size));
+        append(header, sizeof(header));
+        append(str, len);
+        return *this;
+    }
+    void append(const char *data, size_t len)
+    {
+        if (exBuffer_.empty() && length_ + len <= sizeof(buffer_))
+        {
+            memcpy(buffer_ + length_, data, len);
+            length_ += len;
+            return;
+        }
+        if (exBuffer_.empty())
+            exBuffer_.append(buffer_, length_);
+        exBuffer_.append(data, len);
+    }
+
+    const DeferredLogSite &site_;
+    size_t length_{0};
+    char buffer_[512];
+    std::string exBuffer_;
+};
+
+/**
+ * @brief This class decodes the binary output of the deferred logger into
+ * the text Logger would output.
+ */
+class TRANTOR_EXPORT DeferredLogDecoder : NonCopyable
+{
+  public:
+    /**
+     * @brief Decode the complete entries in data and pass each message to
+     * outputFunc.
+     *
+     * @return The number of bytes decoded. The rest of the data is an
+     * incomplete entry, which must be passed again with the data following
+     * it.
+     * @throw std::runtime_error if the data is not a deferred log.
+     */
+    size_t decode(
+        const char *data,
+        size_t len,
+        const std::function<void(const char *msg, const uint64_t len)>
+            &outputFunc);
+
+  private:
+    struct Site
+    {
+        std::string file;
+        std::string func;
+        int line;
+        Logger::LogLevel level;
+    };
+    std::vector<Site> sites_;
+    bool headerDecoded_{false};
+};
+}  // namespace trantor
+
+#define TRANTOR_DEFERRED_LOG_(level, func)                             \
+    trantor::DeferredLogStream(                                        \
+        [](const char *funcName) -> const trantor::DeferredLogSite & { \
+            static const trantor::DeferredLogSite site(__FILE__,       \
+                                                       __LINE__,       \
+                                                       level,          \
+                                                       funcName);      \
+            return site;                                               \
+        }(func))
+
+#ifdef NDEBUG
+#define LOG_DEFERRED_TRACE \
+    TRANTOR_IF_(0)         \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kTrace, __func__)
+#else
+#define LOG_DEFERRED_TRACE             \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_) \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kTrace, __func__)
+#endif
+#define LOG_DEFERRED_DEBUG             \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_) \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kDebug, __func__)
+#define LOG_DEFERRED_INFO             \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kInfo, nullptr)
+#define LOG_DEFERRED_WARN   \
+    TRANTOR_LOG_WARN_GUARD_ \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kWarn, nullptr)
+#define LOG_DEFERRED_ERROR   \
+    TRANTOR_LOG_ERROR_GUARD_ \
+    TRANTOR_DEFERRED_LOG_(trantor::Logger::kError, nullptr)
@@ -0,0 +1,370 @@
+/**
+ *
+ *  @file LogFlightRecorder.cc
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/utils/LogFlightRecorder.h>
+#include <trantor/utils/Utilities.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace trantor;
+
+namespace
+{
+// A record is the time and the length of the message, the message and its
+// length again, so that the records are read backwards from the end of the
+// ring
+constexpr size_t kHeaderSize{sizeof(int64_t) + sizeof(uint32_t)};
+constexpr size_t kRecordOverhead{kHeaderSize + sizeof(uint32_t)};
+
+struct DumpedRecord
+{
+    int64_t time;
+    std::string message;
+};
+}  // namespace
+
+// The ring of a thread, in which the thread is the only writer. A dump copies
+// the ring while it may be written, like the reader of a seqlock, and only
+// keeps the records the thread did not start overwriting during the copy.
+class LogFlightRecorder::Ring : NonCopyable
+{
+  public:
+    explicit Ring(size_t capacity)
+        : capacity_(capacity), data_(new char[capacity])
+    {
+    }
+
+    void write(int64_t time, const char *msg, size_t len)
+    {
+        len = std::min(len, capacity_ / 4 - kRecordOverhead);
+        auto length = static_cast<uint32_t>(len);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto end = tail + kRecordOverhead + len;
+        // The records before end - capacity are not valid any more
+        reserved_.store(end, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copyIn(tail, &time, sizeof(time));
+        copyIn(tail + sizeof(time), &length, sizeof(length));
+        copyIn(tail + kHeaderSize, msg, len);
+        copyIn(end - sizeof(length), &length, sizeof(length));
+        tail_.store(end, std::memory_order_release);
+    }
+
+    // Append the valid records of the ring to records, oldest first
+    void dump(std::vector<DumpedRecord> &records) const
+    {
+        auto tail = tail_.load(std::memory_order_acquire);
+        std::unique_ptr<char[]> copy(new char[capacity_]);
+        memcpy(copy.get(), data_.get(), capacity_);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto reserved = reserved_.load(std::memory_order_relaxed);
+        auto begin = reserved > capacity_ ? reserved - capacity_ : 0;
+
+        auto first = records.size();
+        auto pos = tail;
+        while (pos >= begin + kRecordOverhead)
+        {
+            uint32_t length;
+            copyOut(copy.get(), pos - sizeof(length), &length, sizeof(length));
+            if (pos - begin < kRecordOverhead + length)
+                break;
+            auto start = pos - kRecordOverhead - length;
+            int64_t time;
+            uint32_t headerLength;
+            copyOut(copy.get(), start, &time, sizeof(time));
+            copyOut(copy.get(),
+                    start + sizeof(time),
+                    &headerLength,
+                    sizeof(headerLength));
+            if (headerLength != length)
+                break;
+            DumpedRecord record{time, std::string(length, '\0')};
+            copyOut(copy.get(),
+                    start + kHeaderSize,
+                    &record.message[0],
+                    length);
+            records.push_back(std::move(record));
+            pos = start;
+        }
+        std::reverse(records.begin() + first, records.end());
+    }
+
+    // Owned by a thread, the rings of the threads that are gone are reused
+    bool acquire()
+    {
+        bool inUse = false;
+        return inUse_.compare_exchange_strong(inUse, true);
+    }
+    void release()
+    {
+        inUse_.store(false, std::memory_order_release);
+    }
+
+  private:
+    void copyIn(uint64_t pos, const void *data, size_t len)
+    {
+        auto offset = static_cast<size_t>(pos & (capacity_ - 1));
+        auto n = std::min(len, capacity_ - offset);
+        memcpy(data_.get() + offset, data, n);
+        memcpy(data_.get(), static_cast<const char *>(data) + n, len - n);
+    }
+    void copyOut(const char *copy, uint64_t pos, void *data, size_t len) const
+    {
+        auto offset = static_cast<size_t>(pos & (capacity_ - 1));
+        auto n = std::min(len, capacity_ - offset);
+        memcpy(data, copy + offset, n);
+        memcpy(static_cast<char *>(data) + n, copy, len - n);
+    }
+
+    const size_t capacity_;
+    std::unique_ptr<char[]> data_;
+    // The end of the last complete record
+    std::atomic<uint64_t> tail_{0};
+    // The end of the record being written
+    std::atomic<uint64_t> reserved_{0};
+    std::atomic<bool> inUse_{true};
+};
+
+struct LogFlightRecorder::State
+{
+    std::mutex mutex;
+    // The rings are never freed, a thread keeps a pointer to its ring
+    std::vector<std::unique_ptr<Ring>> rings;
+    size_t bufferSize{0};
+    std::string fatalFileName;
+    std::map<int, std::string> signalFileNames;
+#ifndef _WIN32
+    // The signal handlers write the signals to the pipe, the thread reading
+    // it writes the dumps
+    int signalPipe[2]{-1, -1};
+#endif
+};
+
+LogFlightRecorder::State &LogFlightRecorder::state()
+{
+    // Never destroyed, the threads may log while the process exits
+    static State *s = new State;
+    return *s;
+}
+
+LogFlightRecorder::Ring *LogFlightRecorder::threadRing(State &s)
+{
+    struct CachedRing
+    {
+        Ring *ring{nullptr};
+        ~CachedRing()
+        {
+            if (ring)
+                ring->release();
+        }
+    };
+    static thread_local CachedRing cache;
+    if (cache.ring)
+        return cache.ring;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (auto &ring : s.rings)
+    {
+        if (ring->acquire())
+        {
+            cache.ring = ring.get();
+            return cache.ring;
+        }
+    }
+    s.rings.emplace_back(new Ring(s.bufferSize));
+    cache.ring = s.rings.back().get();
+    return cache.ring;
+}
+
+void LogFlightRecorder::start(Logger::LogLevel level, size_t bufferSize)
+{
+    auto &s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.bufferSize == 0)
+        {
+            size_t capacity = 4096;
+            while (capacity < bufferSize)
+                capacity <<= 1;
+            s.bufferSize = capacity;
+        }
+    }
+    Logger::recordLevel_() = level;
+    Logger::updateEnabledLevel();
+}
+
+void LogFlightRecorder::stop()
+{
+    Logger::recordLevel_() = Logger::kNumberOfLogLevels;
+    Logger::updateEnabledLevel();
+}
+
+bool LogFlightRecorder::isRecording()
+{
+    return Logger::recordLevel_() < Logger::kNumberOfLogLevels;
+}
+
+void LogFlightRecorder::record(int64_t time, const char *msg, size_t len)
+{
+    threadRing(state())->write(time, msg, len);
+}
+
+void LogFlightRecorder::dump(
+    const std::function<void(const char *msg, const uint64_t len)>
+        &outputFunc)
+{
+    auto &s = state();
+    std::vector<DumpedRecord> records;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto &ring : s.rings)
+            ring->dump(records);
+    }
+    // The records of each thread are already in order
+    std::stable_sort(records.begin(),
+                     records.end(),
+                     [](const DumpedRecord &a, const DumpedRecord &b) {
+                         return a.time < b.time;
+                     });
+    for (auto &record : records)
+        outputFunc(record.message.data(), record.message.length());
+}
+
+bool LogFlightRecorder::dumpToFile(const std::string &fileName)
+{
+#ifndef _MSC_VER
+    FILE *file = fopen(fileName.c_str(), "wb");
+#else
+    // Convert UTF-8 file to UCS-2
+    auto wName{utils::toNativePath(fileName)};
+    FILE *file = _wfopen(wName.c_str(), L"wb");
+#endif
+    if (!file)
+    {
+        fprintf(stderr,
+                "Can't open %s: %s\n",
+                fileName.c_str(),
+                strerror_tl(errno));
+        return false;
+    }
+    bool ok = true;
+    dump([file, &ok](const char *msg, const uint64_t len) {
+        if (fwrite(msg, 1, static_cast<size_t>(len), file) != len)
+            ok = false;
+    });
+    if (fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+void LogFlightRecorder::setDumpOnFatal(const std::string &fileName)
+{
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.fatalFileName = fileName;
+}
+
+void LogFlightRecorder::onFatal()
+{
+    auto &s = state();
+    std::string fileName;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        fileName = s.fatalFileName;
+    }
+    if (!fileName.empty())
+        dumpToFile(fileName);
+}
+
+#ifndef _WIN32
+static int signalPipeWriter{-1};
+
+static void dumpSignalHandler(int signal)
+{
+    int savedErrno = errno;
+    char c = static_cast<char>(signal);
+    auto n = write(signalPipeWriter, &c, 1);
+    (void)n;
+    errno = savedErrno;
+}
+#endif
+
+void LogFlightRecorder::dumpOnSignal(int signal, const std::string &fileName)
+{
+#ifndef _WIN32
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.signalFileNames[signal] = fileName;
+    if (s.signalPipe[0] < 0)
+    {
+        if (pipe(s.signalPipe) != 0)
+        {
+            fprintf(stderr,
+                    "Can't create the pipe of the flight recorder: %s\n",
+                    strerror_tl(errno));
+            return;
+        }
+        // A signal handler never blocks
+        fcntl(s.signalPipe[1], F_SETFL, O_NONBLOCK);
+        fcntl(s.signalPipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(s.signalPipe[1], F_SETFD, FD_CLOEXEC);
+        signalPipeWriter = s.signalPipe[1];
+        std::thread([&s]() {
+#ifdef __linux__
+            prctl(PR_SET_NAME, "FlightRecorder");
+#endif
+            char c;
+            for (;;)
+            {
+                auto n = read(s.signalPipe[0], &c, 1);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n != 1)
+                    return;
+                std::string name;
+                {
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    auto iter = s.signalFileNames.find(
+                        static_cast<unsigned char>(c));
+                    if (iter == s.signalFileNames.end())
+                        continue;
+                    name = iter->second;
+                }
+                dumpToFile(name);
+            }
+        }).detach();
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dumpSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signal, &action, nullptr);
+#else
+    (void)signal;
+    (void)fileName;
+#endif
+}
@@ -0,0 +1,113 @@
+/**
+ *
+ *  @file LogFlightRecorder.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+
+#include <trantor/utils/Logger.h>
+#include <trantor/utils/NonCopyable.h>
+#include <trantor/exports.h>
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+namespace trantor
+{
+/**
+ * @brief This class keeps the last messages logged by each thread in memory,
+ * including the messages of the levels below Logger::logLevel(), so that the
+ * details of the moments before an incident can be dumped afterwards.
+ *
+ * While the recorder is started, the log macros of the recorded levels format
+ * their messages, which are copied into a fixed-size ring owned by the
+ * calling thread without taking any lock. Only the messages of the levels
+ * from Logger::logLevel() are output. The oldest messages of a ring are
+ * overwritten by the new ones.
+ *
+ * The rings are dumped on demand with dump(), on a signal with
+ * dumpOnSignal() or on each LOG_FATAL message with setDumpOnFatal(). The
+ * messages of all the threads are dumped in the order of their time.
+ *
+ * @note The LOG_RAW messages are not recorded.
+ */
+class TRANTOR_EXPORT LogFlightRecorder : NonCopyable
+{
+  public:
+    /**
+     * @brief Start recording the messages of the levels from level.
+     *
+     * @param bufferSize The size of the ring of each thread, rounded up to a
+     * power of two. It is only set by the first call. Messages larger than a
+     * quarter of the ring are truncated.
+     */
+    static void start(Logger::LogLevel level = Logger::kTrace,
+                      size_t bufferSize = 256 * 1024);
+
+    /**
+     * @brief Stop recording. The recorded messages are kept and can still be
+     * dumped.
+     */
+    static void stop();
+
+    static bool isRecording();
+
+    /**
+     * @brief Pass the recorded messages to outputFunc, in the order of their
+     * time. The messages are kept.
+     */
+    static void dump(
+        const std::function<void(const char *msg, const uint64_t len)>
+            &outputFunc);
+
+    /**
+     * @brief Write the recorded messages to the file, which is overwritten.
+     *
+     * @return false if the file can not be written.
+     */
+    static bool dumpToFile(const std::string &fileName);
+
+    /**
+     * @brief Dump the recorded messages to the file after each LOG_FATAL
+     * message, which is recorded first. An empty name disables it.
+     */
+    static void setDumpOnFatal(const std::string &fileName);
+
+    /**
+     * @brief Dump the recorded messages to the file when the process receives
+     * the signal, e.g. SIGUSR2. The dump is written by a thread of the
+     * recorder, not by the signal handler, so it is not meant for the signals
+     * of a crash.
+     *
+     * @note This method has no effect on Windows.
+     */
+    static void dumpOnSignal(int signal, const std::string &fileName);
+
+    /**
+     * @brief Copy a formatted message into the ring of the calling thread,
+     * called by Logger.
+     *
+     * @param time The time of the message, in microseconds since the epoch.
+     */
+    static void record(int64_t time, const char *msg, size_t len);
+
+    /**
+     * @brief Called by Logger after a LOG_FATAL message.
+     */
+    static void onFatal();
+
+  private:
+    struct State;
+    class Ring;
+    static State &state();
+    static Ring *threadRing(State &s);
+};
+}  // namespace trantor
@@ -0,0 +1,202 @@
+/**
+ *
+ *  @file LogRing.h
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *  The per-thread message rings of AsyncFileLogger and DeferredLogger.
+ *
+ */
+
+#pragma once
+#include <trantor/utils/NonCopyable.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+namespace trantor
+{
+namespace detail
+{
+/**
+ * A single-producer single-consumer ring of messages, written by one thread
+ * and read by the logger thread. Each record is a header followed by the
+ * message, padded to the header size. A record never wraps, the end of the
+ * ring is skipped with a record of length kSkip instead.
+ */
+class LogRing : NonCopyable
+{
+  public:
+    struct Record
+    {
+        // Time of the message, used to merge the rings of all threads
+        int64_t time;
+        uint32_t length;
+        // Free for the user of the ring
+        uint32_t tag;
+    };
+    static constexpr uint32_t kSkip{0xffffffff};
+
+    // The capacity must be a power of two
+    explicit LogRing(size_t capacity)
+        : capacity_(capacity), data_(new Record[capacity / sizeof(Record)])
+    {
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // Producer side
+    bool push(int64_t time, const char *msg, size_t len, uint32_t tag = 0)
+    {
+        if (tryPush(time, msg, len, tag))
+            return true;
+        lost_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // The same without counting the message as lost when the ring is full
+    bool tryPush(int64_t time, const char *msg, size_t len, uint32_t tag = 0)
+    {
+        size_t size = recordSize(len);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t offset = tail & (capacity_ - 1);
+        size_t padding = offset + size > capacity_ ? capacity_ - offset : 0;
+        if (tail + padding + size - cachedHead_ > capacity_)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail + padding + size - cachedHead_ > capacity_)
+                return false;
+        }
+        if (padding > 0)
+        {
+            recordAt(tail)->length = kSkip;
+            tail += padding;
+        }
+        auto record = recordAt(tail);
+        record->time = time;
+        record->length = static_cast<uint32_t>(len);
+        record->tag = tag;
+        memcpy(record + 1, msg, len);
+        tail_.store(tail + size, std::memory_order_release);
+        return true;
+    }
+    // True when the ring is more than half full, the logger thread is woken
+    // up to collect it then.
+    bool shouldNotify()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ <= capacity_ / 2)
+            return false;
+        cachedHead_ = head_.load(std::memory_order_acquire);
+        return tail - cachedHead_ > capacity_ / 2;
+    }
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    // Consumer side
+    const Record *front()
+    {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        while (readPos_ != tail)
+        {
+            auto record = recordAt(readPos_);
+            if (record->length != kSkip)
+                return record;
+            readPos_ += capacity_ - (readPos_ & (capacity_ - 1));
+        }
+        return nullptr;
+    }
+    void pop()
+    {
+        readPos_ += recordSize(recordAt(readPos_)->length);
+        head_.store(readPos_, std::memory_order_release);
+    }
+    bool closed() const
+    {
+        return closed_.load(std::memory_order_acquire);
+    }
+    uint64_t takeLost()
+    {
+        return lost_.exchange(0, std::memory_order_relaxed);
+    }
+
+  private:
+    static size_t recordSize(size_t len)
+    {
+        return (sizeof(Record) + len + sizeof(Record) - 1) / sizeof(Record) *
+               sizeof(Record);
+    }
+    Record *recordAt(size_t pos) const
+    {
+        return data_.get() + (pos & (capacity_ - 1)) / sizeof(Record);
+    }
+
+    const size_t capacity_;
+    std::unique_ptr<Record[]> data_;
+    // Owned by the logger thread
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t readPos_{0};
+    // Owned by the producer thread
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t cachedHead_{0};
+    alignas(64) std::atomic<uint64_t> lost_{0};
+    std::atomic<bool> closed_{false};
+};
+
+/**
+ * Pass the records of the rings to cb(ring, record) in the order of their
+ * time. Records newer than until are left for the next merge, so that a busy
+ * thread can not keep the merge going.
+ */
+template <typename Ring, typename Callback>
+void mergeLogRings(const std::vector<std::shared_ptr<Ring>> &rings,
+                   int64_t until,
+                   Callback &&cb)
+{
+    using Entry = std::pair<int64_t, size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heads;
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        auto record = rings[i]->front();
+        if (record && record->time <= until)
+            heads.emplace(record->time, i);
+    }
+    while (!heads.empty())
+    {
+        auto index = heads.top().second;
+        auto &ring = *rings[index];
+        heads.pop();
+        cb(ring, ring.front());
+        ring.pop();
+        auto record = ring.front();
+        if (record && record->time <= until)
+            heads.emplace(record->time, index);
+    }
+}
+
+/**
+ * Remove the rings of the threads that are gone once they are empty.
+ */
+template <typename Ring>
+void removeClosedLogRings(std::vector<std::shared_ptr<Ring>> &rings)
+{
+    for (auto iter = rings.begin(); iter != rings.end();)
+    {
+        if ((*iter)->closed() && !(*iter)->front())
+            iter = rings.erase(iter);
+        else
+            ++iter;
+    }
+}
+}  // namespace detail
+}  // namespace trantor
@@ -15,8 +15,12 @@
 // taken from muduo lib
 
 #include <trantor/utils/LogStream.h>
+#include "ByteSearch.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <limits>
+#include <type_traits>
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
@@ -30,33 +34,85 @@ namespace trantor
 {
 namespace detail
 {
-const char digits[] = "9876543210123456789";
-const char *zero = digits + 9;
+// "00" to "99", the integers are converted two digits at a time.
+const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
 
 const char digitsHex[] = "0123456789ABCDEF";
 
-// Efficient Integer to String Conversions, by Matthew Wilson.
+template <typename U>
+int countDigits(U value)
+{
+    int count = 1;
+    for (;;)
+    {
+        if (value < 10)
+            return count;
+        if (value < 100)
+            return count + 1;
+        if (value < 1000)
+            return count + 2;
+        if (value < 10000)
+            return count + 3;
+        value /= 10000u;
+        count += 4;
+    }
+}
+
+template <typename T>
+bool isNegative(T value, std::true_type)
+{
+    return value < 0;
+}
+
+template <typename T>
+bool isNegative(T, std::false_type)
+{
+    return false;
+}
+
 template <typename T>
 size_t convert(char buf[], T value)
 {
-    T i = value;
+    using U = typename std::make_unsigned<T>::type;
+    U i = static_cast<U>(value);
     char *p = buf;
-
-    do
+    if (isNegative(value, std::is_signed<T>()))
     {
-        int lsd = static_cast<int>(i % 10);
-        i /= 10;
-        *p++ = zero[lsd];
-    } while (i != 0);
+        *p++ = '-';
+        i = 0 - i;
+    }
 
-    if (value < 0)
+    p += countDigits(i);
+    char *end = p;
+    while (i >= 100)
     {
-        *p++ = '-';
+        auto index = static_cast<size_t>(i % 100) * 2;
+        i /= 100;
+        *--p = digitPairs[index + 1];
+        *--p = digitPairs[index];
+    }
+    if (i >= 10)
+    {
+        auto index = static_cast<size_t>(i) * 2;
+        *--p = digitPairs[index + 1];
+        *--p = digitPairs[index];
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + i);
     }
-    *p = '\0';
-    std::reverse(buf, p);
 
-    return p - buf;
+    return end - buf;
 }
 
 size_t convertHex(char buf[], uintptr_t value)
@@ -77,6 +133,347 @@ size_t convertHex(char buf[], uintptr_t value)
     return p - buf;
 }
 
+// Grisu2 by Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers". It finds the shortest digits that read back to
+// the same value in the vast majority of cases, and digits that read back to
+// the same value in all cases.
+namespace
+{
+template <typename T>
+struct FloatTraits;
+
+template <>
+struct FloatTraits<double>
+{
+    using Bits = uint64_t;
+    static constexpr int kSignificandSize = 52;
+    static constexpr int kExponentMask = 0x7FF;
+    static constexpr int kExponentBias = 0x3FF + kSignificandSize;
+};
+
+template <>
+struct FloatTraits<float>
+{
+    using Bits = uint32_t;
+    static constexpr int kSignificandSize = 23;
+    static constexpr int kExponentMask = 0xFF;
+    static constexpr int kExponentBias = 0x7F + kSignificandSize;
+};
+
+// f * 2^e
+struct DiyFp
+{
+    uint64_t f;
+    int e;
+};
+
+DiyFp normalize(DiyFp v)
+{
+#if defined(__GNUC__)
+    int shift = __builtin_clzll(v.f);
+    return {v.f << shift, v.e - shift};
+#else
+    while (!(v.f & (uint64_t(1) << 63)))
+    {
+        v.f <<= 1;
+        --v.e;
+    }
+    return v;
+#endif
+}
+
+// The upper 64 bits of the product, rounded
+DiyFp multiply(const DiyFp &x, const DiyFp &y)
+{
+    const uint64_t kMask32 = 0xFFFFFFFF;
+    uint64_t a = x.f >> 32;
+    uint64_t b = x.f & kMask32;
+    uint64_t c = y.f >> 32;
+    uint64_t d = y.f & kMask32;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & kMask32) + (bc & kMask32);
+    tmp += uint64_t(1) << 31;
+    return {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+}
+
+// The normalized value of v and the boundaries halfway to its neighbours,
+// with the exponent of the upper one.
+template <typename T>
+void decompose(T v, DiyFp &w, DiyFp &minus, DiyFp &plus)
+{
+    using Traits = FloatTraits<T>;
+    typename Traits::Bits bits;
+    memcpy(&bits, &v, sizeof(bits));
+    const uint64_t hiddenBit = uint64_t(1) << Traits::kSignificandSize;
+    uint64_t significand = bits & (hiddenBit - 1);
+    int biasedExponent = static_cast<int>(bits >> Traits::kSignificandSize) &
+                         Traits::kExponentMask;
+    DiyFp value;
+    if (biasedExponent != 0)
+        value = {significand + hiddenBit,
+                 biasedExponent - Traits::kExponentBias};
+    else
+        value = {significand, 1 - Traits::kExponentBias};
+
+    plus = normalize({(value.f << 1) + 1, value.e - 1});
+    // The lower neighbour of a power of two is closer
+    if (significand == 0 && biasedExponent > 1)
+        minus = {(value.f << 2) - 1, value.e - 2};
+    else
+        minus = {(value.f << 1) - 1, value.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    w = normalize(value);
+}
+
+// 10^k for k = -348, -340, ..., 340
+const uint64_t cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+const int16_t cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635,
+    -608, -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316,
+    -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56,
+    83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+    481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853,
+    880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// A cached power c = 10^-k such that the exponent of c * 2^e is in
+// [-60, -32], which leaves the integral part of the product in 32 bits.
+DiyFp cachedPower(int e, int &k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = static_cast<int>(dk);
+    if (dk - ik > 0.0)
+        ++ik;
+    auto index = static_cast<size_t>((ik >> 3) + 1);
+    k = -(-348 + static_cast<int>(index << 3));
+    return {cachedPowersF[index], cachedPowersE[index]};
+}
+
+const uint64_t pow10[] = {1ULL,
+                          10ULL,
+                          100ULL,
+                          1000ULL,
+                          10000ULL,
+                          100000ULL,
+                          1000000ULL,
+                          10000000ULL,
+                          100000000ULL,
+                          1000000000ULL,
+                          10000000000ULL,
+                          100000000000ULL,
+                          1000000000000ULL,
+                          10000000000000ULL,
+                          100000000000000ULL,
+                          1000000000000000ULL,
+                          10000000000000000ULL,
+                          100000000000000000ULL,
+                          1000000000000000000ULL,
+                          10000000000000000000ULL};
+
+// Move the last digit towards w while the digits stay in the interval
+void grisuRound(char *buffer,
+                int len,
+                uint64_t delta,
+                uint64_t rest,
+                uint64_t tenKappa,
+                uint64_t distance)
+{
+    while (rest < distance && delta - rest >= tenKappa &&
+           (rest + tenKappa < distance ||
+            distance - rest > rest + tenKappa - distance))
+    {
+        buffer[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+// Generate the digits of the upper boundary until they are within delta of
+// it, the value is buffer * 10^k.
+int digitGen(const DiyFp &w,
+             const DiyFp &upper,
+             uint64_t delta,
+             char *buffer,
+             int &k)
+{
+    const DiyFp one{uint64_t(1) << -upper.e, upper.e};
+    const uint64_t distance = upper.f - w.f;
+    auto p1 = static_cast<uint32_t>(upper.f >> -one.e);
+    uint64_t p2 = upper.f & (one.f - 1);
+    int kappa = countDigits(p1);
+    int len = 0;
+
+    while (kappa > 0)
+    {
+        auto divisor = static_cast<uint32_t>(pow10[kappa - 1]);
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d || len)
+            buffer[len++] = static_cast<char>('0' + d);
+        --kappa;
+        uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+        if (rest <= delta)
+        {
+            k += kappa;
+            grisuRound(buffer,
+                       len,
+                       delta,
+                       rest,
+                       pow10[kappa] << -one.e,
+                       distance);
+            return len;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        auto d = static_cast<char>(p2 >> -one.e);
+        if (d || len)
+            buffer[len++] = static_cast<char>('0' + d);
+        p2 &= one.f - 1;
+        --kappa;
+        if (p2 < delta)
+        {
+            k += kappa;
+            int index = -kappa;
+            grisuRound(buffer,
+                       len,
+                       delta,
+                       p2,
+                       one.f,
+                       index < 20 ? distance * pow10[index] : 0);
+            return len;
+        }
+    }
+}
+
+// Write the digits of v, which is positive and finite, to buffer and return
+// their number. The value is buffer * 10^k.
+template <typename T>
+int grisu2(T v, char *buffer, int &k)
+{
+    DiyFp w, minus, plus;
+    decompose(v, w, minus, plus);
+    const DiyFp c = cachedPower(plus.e, k);
+    DiyFp cw = multiply(w, c);
+    DiyFp cplus = multiply(plus, c);
+    DiyFp cminus = multiply(minus, c);
+    ++cminus.f;
+    --cplus.f;
+    return digitGen(cw, cplus, cplus.f - cminus.f, buffer, k);
+}
+}  // namespace
+
+// The shortest digits reading back to the same value, laid out like printf's
+// %g with the precision of a double.
+template <typename T>
+size_t convertFloat(char buf[], T value)
+{
+    constexpr int kPrecision = 17;
+    char *p = buf;
+    if (std::signbit(value))
+        *p++ = '-';
+    if (std::isnan(value) || std::isinf(value))
+    {
+        memcpy(p, std::isnan(value) ? "nan" : "inf", 3);
+        return p + 3 - buf;
+    }
+    if (value == 0)
+    {
+        *p++ = '0';
+        return p - buf;
+    }
+
+    char digits[32];
+    int k;
+    int len = grisu2(std::fabs(value), digits, k);
+    // The position of the decimal point after the first digit
+    int point = len + k;
+    if (point > -4 && point <= kPrecision)
+    {
+        if (k >= 0)
+        {
+            memcpy(p, digits, len);
+            p += len;
+            memset(p, '0', k);
+            p += k;
+        }
+        else if (point > 0)
+        {
+            memcpy(p, digits, point);
+            p += point;
+            *p++ = '.';
+            memcpy(p, digits + point, len - point);
+            p += len - point;
+        }
+        else
+        {
+            *p++ = '0';
+            *p++ = '.';
+            memset(p, '0', -point);
+            p += -point;
+            memcpy(p, digits, len);
+            p += len;
+        }
+        return p - buf;
+    }
+
+    *p++ = digits[0];
+    if (len > 1)
+    {
+        *p++ = '.';
+        memcpy(p, digits + 1, len - 1);
+        p += len - 1;
+    }
+    int exponent = point - 1;
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    exponent = std::abs(exponent);
+    if (exponent >= 100)
+    {
+        *p++ = static_cast<char>('0' + exponent / 100);
+        exponent %= 100;
+    }
+    memcpy(p, digitPairs + exponent * 2, 2);
+    return p + 2 - buf;
+}
+
 template class FixedBuffer<kSmallBuffer>;
 template class FixedBuffer<kLargeBuffer>;
 
@@ -104,6 +501,8 @@ template <typename T>
 void LogStream::formatInteger(T v)
 {
     constexpr static int kMaxNumericSize = std::numeric_limits<T>::digits10 + 4;
+    if (state_ >= State::kStart)
+        openMessage();
     if (exBuffer_.empty())
     {
         if (buffer_.avail() >= kMaxNumericSize)
@@ -176,6 +575,8 @@ LogStream &LogStream::operator<<(const void *p)
     uintptr_t v = reinterpret_cast<uintptr_t>(p);
     constexpr static int kMaxNumericSize =
         std::numeric_limits<uintptr_t>::digits / 4 + 4;
+    if (state_ >= State::kStart)
+        openMessage();
     if (exBuffer_.empty())
     {
         if (buffer_.avail() >= kMaxNumericSize)
@@ -202,17 +603,19 @@ LogStream &LogStream::operator<<(const void *p)
     return *this;
 }
 
-// TODO: replace this with Grisu3 by Florian Loitsch.
-LogStream &LogStream::operator<<(const double &v)
+template <typename T>
+void LogStream::formatFloat(T v)
 {
     constexpr static int kMaxNumericSize = 32;
+    if (state_ >= State::kStart)
+        openMessage();
     if (exBuffer_.empty())
     {
         if (buffer_.avail() >= kMaxNumericSize)
         {
-            int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
+            size_t len = convertFloat(buffer_.current(), v);
             buffer_.add(len);
-            return *this;
+            return;
         }
         else
         {
@@ -221,14 +624,27 @@ LogStream &LogStream::operator<<(const double &v)
     }
     auto oldLen = exBuffer_.length();
     exBuffer_.resize(oldLen + kMaxNumericSize);
-    int len = snprintf(&(exBuffer_[oldLen]), kMaxNumericSize, "%.12g", v);
+    size_t len = convertFloat(&exBuffer_[oldLen], v);
     exBuffer_.resize(oldLen + len);
+}
+
+LogStream &LogStream::operator<<(const float &v)
+{
+    formatFloat(v);
+    return *this;
+}
+
+LogStream &LogStream::operator<<(const double &v)
+{
+    formatFloat(v);
     return *this;
 }
 
 LogStream &LogStream::operator<<(const long double &v)
 {
     constexpr static int kMaxNumericSize = 48;
+    if (state_ >= State::kStart)
+        openMessage();
     if (exBuffer_.empty())
     {
         if (buffer_.avail() >= kMaxNumericSize)
@@ -249,6 +665,244 @@ LogStream &LogStream::operator<<(const long double &v)
     return *this;
 }
 
+void LogStream::beginRecord(LogFormat format)
+{
+    format_ = format;
+    hasMessage_ = false;
+    if (format == LogFormat::Text)
+    {
+        state_ = State::kText;
+        return;
+    }
+    state_ = State::kStart;
+    if (format == LogFormat::Json)
+        appendRaw("{", 1);
+}
+
+void LogStream::endRecord()
+{
+    if (state_ == State::kMessage)
+        appendRaw("\"", 1);
+    if (format_ == LogFormat::Json)
+        appendRaw("}\n", 2);
+    else
+        appendRaw("\n", 1);
+    state_ = State::kText;
+}
+
+void LogStream::openMessage()
+{
+    if (hasMessage_)
+        appendKey("text", 4);
+    else
+        appendKey("msg", 3);
+    hasMessage_ = true;
+    appendRaw("\"", 1);
+    state_ = State::kMessage;
+}
+
+void LogStream::appendStructured(const char *data, size_t len)
+{
+    if (state_ == State::kText || state_ == State::kValue)
+    {
+        appendRaw(data, len);
+        return;
+    }
+    if (state_ != State::kMessage)
+        openMessage();
+    appendEscaped(data, len);
+}
+
+namespace
+{
+// The bytes to escape in the strings of JSON and in the quoted strings of
+// logfmt, or to quote in logfmt when withSpaces is true. The keys and most of
+// the values are shorter than a vector, they are searched inline.
+const char *findEscape(const char *p, const char *end, bool withSpaces)
+{
+    if (end - p >= 16)
+    {
+        static const char special[] = "\"\\ =";
+        return findControlOrAnyOf(p, end, special, withSpaces ? 4 : 2);
+    }
+    for (; p < end; ++p)
+    {
+        auto c = static_cast<unsigned char>(*p);
+        if (c < 0x20 || c == '"' || c == '\\' ||
+            (withSpaces && (c == ' ' || c == '=')))
+            return p;
+    }
+    return nullptr;
+}
+}  // namespace
+
+// The escapes of JSON, which logfmt uses in its quoted values too. The
+// string is copied in runs between the bytes to escape, which are found 16
+// or 32 bytes at a time.
+void LogStream::appendEscaped(const char *data, size_t len)
+{
+    const char *end = data + len;
+    while (data < end)
+    {
+        const char *p = findEscape(data, end, false);
+        if (!p)
+        {
+            appendRaw(data, end - data);
+            return;
+        }
+        if (p > data)
+            appendRaw(data, p - data);
+        char escaped[6] = {'\\', *p};
+        size_t escapedLen = 2;
+        switch (*p)
+        {
+            case '\n':
+                escaped[1] = 'n';
+                break;
+            case '\r':
+                escaped[1] = 'r';
+                break;
+            case '\t':
+                escaped[1] = 't';
+                break;
+            case '\b':
+                escaped[1] = 'b';
+                break;
+            case '\f':
+                escaped[1] = 'f';
+                break;
+            case '"':
+            case '\\':
+                break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = digitsHex[static_cast<unsigned char>(*p) >> 4];
+                escaped[5] = digitsHex[*p & 0xf];
+                escapedLen = 6;
+                break;
+        }
+        appendRaw(escaped, escapedLen);
+        data = p + 1;
+    }
+}
+
+void LogStream::appendKey(const char *key, size_t len)
+{
+    bool json = format_ == LogFormat::Json && state_ != State::kText;
+    // The key and its punctuation are copied at once, unless the key is long
+    // or has to be escaped
+    char buf[64];
+    if (len + 5 > sizeof(buf) || (json && findEscape(key, key + len, false)))
+    {
+        if (state_ == State::kMessage)
+            appendRaw("\"", 1);
+        if (state_ == State::kFields || state_ == State::kMessage)
+            appendRaw(json ? "," : " ", 1);
+        else if (state_ == State::kText)
+            appendRaw(" ", 1);
+        if (state_ != State::kText)
+            state_ = State::kValue;
+        if (json)
+        {
+            appendRaw("\"", 1);
+            appendEscaped(key, len);
+            appendRaw("\":", 2);
+        }
+        else
+        {
+            appendRaw(key, len);
+            appendRaw("=", 1);
+        }
+        return;
+    }
+    size_t n = 0;
+    if (state_ == State::kMessage)
+        buf[n++] = '"';
+    if (state_ != State::kStart)
+        buf[n++] = json ? ',' : ' ';
+    if (json)
+        buf[n++] = '"';
+    memcpy(buf + n, key, len);
+    n += len;
+    if (json)
+    {
+        buf[n++] = '"';
+        buf[n++] = ':';
+    }
+    else
+    {
+        buf[n++] = '=';
+    }
+    appendRaw(buf, n);
+    if (state_ != State::kText)
+        state_ = State::kValue;
+}
+
+void LogStream::appendString(const char *data, size_t len)
+{
+    // Logfmt values are only quoted when they would not read back
+    if (format_ != LogFormat::Json && len > 0 &&
+        !findEscape(data, data + len, true))
+    {
+        appendRaw(data, len);
+        return;
+    }
+    appendRaw("\"", 1);
+    appendEscaped(data, len);
+    appendRaw("\"", 1);
+}
+
+LogStream &LogStream::operator<<(const LogField &field)
+{
+    appendKey(field.key_, field.keyLength_);
+    switch (field.type_)
+    {
+        case LogField::kNull:
+            appendRaw("null", 4);
+            break;
+        case LogField::kBool:
+            if (field.value_.boolean)
+                appendRaw("true", 4);
+            else
+                appendRaw("false", 5);
+            break;
+        case LogField::kInt:
+            formatInteger(field.value_.integer);
+            break;
+        case LogField::kUint:
+            formatInteger(field.value_.unsignedInteger);
+            break;
+        case LogField::kDouble:
+            // JSON has no numbers for them
+            if (format_ == LogFormat::Json &&
+                !std::isfinite(field.value_.floating))
+            {
+                if (std::isnan(field.value_.floating))
+                    appendString("nan", 3);
+                else if (field.value_.floating < 0)
+                    appendString("-inf", 4);
+                else
+                    appendString("inf", 3);
+            }
+            else
+            {
+                formatFloat(field.value_.floating);
+            }
+            break;
+        case LogField::kChar:
+            appendString(&field.value_.character, 1);
+            break;
+        case LogField::kString:
+            appendString(field.value_.string.data, field.value_.string.length);
+            break;
+    }
+    if (state_ == State::kValue)
+        state_ = State::kFields;
+    return *this;
+}
+
 template <typename T>
 Fmt::Fmt(const char *fmt, T val)
 {
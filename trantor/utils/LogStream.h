@@ -20,7 +20,10 @@
 
 #include <assert.h>
 #include <string.h>  // memcpy
+#include <cstddef>
 #include <string>
+#include <type_traits>
+#include <stdint.h>
 
 namespace trantor
 {
@@ -116,6 +119,133 @@ class TRANTOR_EXPORT FixedBuffer : NonCopyable
 
 }  // namespace detail
 
+/**
+ * @brief The format of the log messages.
+ *
+ * - Text: the usual format, the fields are appended to the message as
+ *   key=value.
+ * - Json: one JSON object per line.
+ * - Logfmt: one line of key=value pairs.
+ */
+enum class LogFormat
+{
+    Text,
+    Json,
+    Logfmt
+};
+
+/**
+ * @brief A typed key-value field of a log message, e.g.
+ * LOG_INFO << "request done" << LogField("status", 200);
+ *
+ * A field only refers to its key and to its string value, which are written
+ * to the buffer of the stream without any intermediate string. Strings are
+ * escaped for JSON, or quoted and escaped for logfmt when they contain a
+ * space, a '=', a '"', a '\\' or a control character. Keys are escaped
+ * for JSON only, they are expected to be plain words.
+ */
+class TRANTOR_EXPORT LogField
+{
+  public:
+    enum Type
+    {
+        kNull,
+        kBool,
+        kInt,
+        kUint,
+        kDouble,
+        kChar,
+        kString
+    };
+
+    LogField(const char *key, std::nullptr_t) : LogField(key, kNull)
+    {
+    }
+    LogField(const char *key, bool value) : LogField(key, kBool)
+    {
+        value_.boolean = value;
+    }
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value &&
+                                          std::is_signed<T>::value &&
+                                          !std::is_same<T, char>::value,
+                                      int>::type = 0>
+    LogField(const char *key, T value) : LogField(key, kInt)
+    {
+        value_.integer = value;
+    }
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value &&
+                                          std::is_unsigned<T>::value &&
+                                          !std::is_same<T, bool>::value &&
+                                          !std::is_same<T, char>::value,
+                                      int>::type = 0>
+    LogField(const char *key, T value) : LogField(key, kUint)
+    {
+        value_.unsignedInteger = value;
+    }
+    LogField(const char *key, double value) : LogField(key, kDouble)
+    {
+        value_.floating = value;
+    }
+    LogField(const char *key, char value) : LogField(key, kChar)
+    {
+        value_.character = value;
+    }
+    // A null value for a null pointer
+    LogField(const char *key, const char *value)
+        : LogField(key, value, value ? strlen(value) : 0)
+    {
+    }
+    LogField(const char *key, const char *value, size_t length)
+        : LogField(key, value ? kString : kNull)
+    {
+        value_.string.data = value;
+        value_.string.length = length;
+    }
+    LogField(const char *key, const std::string &value)
+        : LogField(key, value.data(), value.length())
+    {
+    }
+
+    const char *key() const
+    {
+        return key_;
+    }
+    size_t keyLength() const
+    {
+        return keyLength_;
+    }
+    Type type() const
+    {
+        return type_;
+    }
+
+  private:
+    friend class LogStream;
+    LogField(const char *key, Type type)
+        : key_(key), keyLength_(strlen(key)), type_(type)
+    {
+    }
+
+    const char *key_;
+    size_t keyLength_;
+    Type type_;
+    union
+    {
+        bool boolean;
+        int64_t integer;
+        uint64_t unsignedInteger;
+        double floating;
+        char character;
+        struct
+        {
+            const char *data;
+            size_t length;
+        } string;
+    } value_;
+};
+
 class TRANTOR_EXPORT LogStream : NonCopyable
 {
     using self = LogStream;
@@ -140,11 +270,7 @@ class TRANTOR_EXPORT LogStream : NonCopyable
 
     self &operator<<(const void *);
 
-    self &operator<<(float &v)
-    {
-        *this << static_cast<double>(v);
-        return *this;
-    }
+    self &operator<<(const float &v);
     self &operator<<(const double &);
     self &operator<<(const long double &v);
 
@@ -201,7 +327,46 @@ class TRANTOR_EXPORT LogStream : NonCopyable
         return *this;
     }
 
+    /**
+     * @brief Append the typed field to the message, in the format of the
+     * stream.
+     */
+    self &operator<<(const LogField &field);
+
+    /**
+     * @brief Append text to the message. In the Json and Logfmt formats, the
+     * text is escaped and becomes the value of the "msg" key, or of the
+     * "text" key if the message already has one.
+     */
     void append(const char *data, size_t len)
+    {
+        if (state_ == State::kText)
+            appendRaw(data, len);
+        else
+            appendStructured(data, len);
+    }
+
+    /**
+     * @brief Start a log record in the format, e.g. the '{' of a JSON object.
+     * The fields appended first, like the time and the level, come before the
+     * message.
+     */
+    void beginRecord(LogFormat format);
+
+    /**
+     * @brief End the log record, e.g. with the '}' of a JSON object, and the
+     * line.
+     */
+    void endRecord();
+
+    LogFormat format() const
+    {
+        return format_;
+    }
+
+    // Append data to the buffer as it is, e.g. for the punctuation of the
+    // formats
+    void appendRaw(const char *data, size_t len)
     {
         if (exBuffer_.empty())
         {
@@ -238,14 +403,43 @@ class TRANTOR_EXPORT LogStream : NonCopyable
     {
         buffer_.reset();
         exBuffer_.clear();
+        format_ = LogFormat::Text;
+        state_ = State::kText;
+        hasMessage_ = false;
     }
 
   private:
+    // Where the Json and Logfmt records are, the appended text is written as
+    // it is in the Text format
+    enum class State : char
+    {
+        kText,
+        // Writing the value of a field
+        kValue,
+        // In the quoted message
+        kMessage,
+        // Before the first field
+        kStart,
+        // After a field
+        kFields
+    };
+
     template <typename T>
     void formatInteger(T);
+    template <typename T>
+    void formatFloat(T);
+    void appendStructured(const char *data, size_t len);
+    void appendEscaped(const char *data, size_t len);
+    void appendKey(const char *key, size_t len);
+    void appendString(const char *data, size_t len);
+    // Open the quoted message after the fields
+    void openMessage();
 
     Buffer buffer_;
     std::string exBuffer_;
+    LogFormat format_{LogFormat::Text};
+    State state_{State::kText};
+    bool hasMessage_{false};
 };
 
 class TRANTOR_EXPORT Fmt  // : boost::noncopyable
@@ -13,6 +13,7 @@
  */
 
 #include <trantor/utils/Logger.h>
+#include <trantor/utils/LogFlightRecorder.h>
 #include <stdio.h>
 #include <thread>
 #ifdef __unix__
@@ -99,27 +100,31 @@ static thread_local pid_t threadId_{0};
 #else
 static thread_local uint64_t threadId_{0};
 #endif
+// The level of the message passed to the output function
+static thread_local Logger::LogLevel outputLevel_{Logger::kInfo};
 //   static thread_local LogStream logStream_;
 
-void Logger::formatTime()
+// Update the time string of the second of date cached by the thread and return
+// the microseconds within the second
+static uint64_t updateTimeString(const Date &date)
 {
-    uint64_t now = static_cast<uint64_t>(date_.secondsSinceEpoch());
+    uint64_t now = static_cast<uint64_t>(date.secondsSinceEpoch());
     uint64_t microSec =
-        static_cast<uint64_t>(date_.microSecondsSinceEpoch() -
-                              date_.roundSecond().microSecondsSinceEpoch());
+        static_cast<uint64_t>(date.microSecondsSinceEpoch() -
+                              date.roundSecond().microSecondsSinceEpoch());
     if (now != lastSecond_)
     {
         lastSecond_ = now;
-        if (displayLocalTime_())
+        if (Logger::displayLocalTime())
         {
 #ifndef _MSC_VER
             strncpy(lastTimeString_,
-                    date_.toFormattedStringLocal(false).c_str(),
+                    date.toFormattedStringLocal(false).c_str(),
                     sizeof(lastTimeString_) - 1);
 #else
             strncpy_s<sizeof lastTimeString_>(
                 lastTimeString_,
-                date_.toFormattedStringLocal(false).c_str(),
+                date.toFormattedStringLocal(false).c_str(),
                 sizeof(lastTimeString_) - 1);
 #endif
         }
@@ -127,16 +132,22 @@ void Logger::formatTime()
         {
 #ifndef _MSC_VER
             strncpy(lastTimeString_,
-                    date_.toFormattedString(false).c_str(),
+                    date.toFormattedString(false).c_str(),
                     sizeof(lastTimeString_) - 1);
 #else
             strncpy_s<sizeof lastTimeString_>(
                 lastTimeString_,
-                date_.toFormattedString(false).c_str(),
+                date.toFormattedString(false).c_str(),
                 sizeof(lastTimeString_) - 1);
 #endif
         }
     }
+    return microSec;
+}
+
+void Logger::formatTime(uint64_t threadId)
+{
+    uint64_t microSec = updateTimeString(date_);
     logStream_ << T(lastTimeString_, 17);
     char tmp[32];
     if (displayLocalTime_())
@@ -155,6 +166,16 @@ void Logger::formatTime()
                  static_cast<long long unsigned int>(microSec));
         logStream_ << T(tmp, 12);
     }
+    logStream_ << threadId;
+}
+
+void Logger::formatTime()
+{
+    formatTime(currentThreadId());
+}
+
+uint64_t Logger::currentThreadId()
+{
 #ifdef __linux__
     if (threadId_ == 0)
         threadId_ = static_cast<pid_t>(::syscall(SYS_gettid));
@@ -186,7 +207,7 @@ void Logger::formatTime()
         pthread_threadid_np(NULL, &threadId_);
     }
 #endif
-    logStream_ << threadId_;
+    return static_cast<uint64_t>(threadId_);
 }
 static const char *logLevelStr[Logger::LogLevel::kNumberOfLogLevels] = {
     " TRACE ",
@@ -196,26 +217,27 @@ static const char *logLevelStr[Logger::LogLevel::kNumberOfLogLevels] = {
     " ERROR ",
     " FATAL ",
 };
+// The levels of the Json and Logfmt formats
+static const char *logLevelNames[Logger::LogLevel::kNumberOfLogLevels] = {
+    "trace",
+    "debug",
+    "info",
+    "warn",
+    "error",
+    "fatal",
+};
 
 Logger::Logger(SourceFile file, int line)
     : sourceFile_(file), fileLine_(line), level_(kInfo)
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
-#ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
-#endif
+    formatHeader(currentThreadId(), nullptr);
 }
 Logger::Logger(SourceFile file, int line, LogLevel level)
     : sourceFile_(file),
       fileLine_(line),
       level_(std::clamp(level, kTrace, kFatal))
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
-#ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
-#endif
+    formatHeader(currentThreadId(), nullptr);
 }
 Logger::Logger(SourceFile file, int line, LogLevel level, const char *func)
     : sourceFile_(file),
@@ -226,54 +248,104 @@ Logger::Logger(SourceFile file, int line, LogLevel level, const char *func)
       func_(func)
 #endif
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7) << "[" << func << "] ";
+    formatHeader(currentThreadId(), func);
+}
+Logger::Logger(SourceFile file,
+               int line,
+               LogLevel level,
+               const char *func,
+               const Date &date,
+               uint64_t threadId,
+               bool output)
+    : date_(date),
+      sourceFile_(file),
+      fileLine_(line),
+      level_(std::clamp(level, kTrace, kFatal)),
+      output_(output)
+{
 #ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
+    func_ = func;
 #endif
+    formatHeader(threadId, func);
 }
 Logger::Logger(SourceFile file, int line, bool)
-    : sourceFile_(file), fileLine_(line), level_(kFatal)
+    : sourceFile_(file), fileLine_(line), level_(kFatal), sysErr_(true)
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
-#ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
-#endif
-    if (errno != 0)
-    {
-        logStream_ << strerror_tl(errno) << " (errno=" << errno << ") ";
-    }
+    formatHeader(currentThreadId(), nullptr);
+    formatSysErr();
 }
 
 // LOG_COMPACT
 Logger::Logger() : level_(kInfo)
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
-#ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
-#endif
+    formatHeader(currentThreadId(), nullptr);
 }
 Logger::Logger(LogLevel level) : level_(std::clamp(level, kTrace, kFatal))
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
-#ifdef TRANTOR_SPDLOG_SUPPORT
-    spdLogMessageOffset_ = logStream_.bufferLength();
-#endif
+    formatHeader(currentThreadId(), nullptr);
+}
+Logger::Logger(bool) : level_(kFatal), sysErr_(true)
+{
+    formatHeader(currentThreadId(), nullptr);
+    formatSysErr();
 }
-Logger::Logger(bool) : level_(kFatal)
+
+void Logger::formatHeader(uint64_t threadId, const char *func)
 {
-    formatTime();
-    logStream_ << T(logLevelStr[level_], 7);
+    if (logFormat_() == LogFormat::Text)
+    {
+        formatTime(threadId);
+        logStream_ << T(logLevelStr[level_], 7);
+        if (func)
+            logStream_ << "[" << func << "] ";
+    }
+    else
+    {
+        formatHeaderFields(threadId, func);
+    }
 #ifdef TRANTOR_SPDLOG_SUPPORT
     spdLogMessageOffset_ = logStream_.bufferLength();
 #endif
-    if (errno != 0)
+}
+
+void Logger::formatHeaderFields(uint64_t threadId, const char *func)
+{
+    logStream_.beginRecord(logFormat_());
+    // YYYYMMDD HH:MM:SS to YYYY-MM-DDTHH:MM:SS.ffffff, with a Z for UTC
+    uint64_t microSec = updateTimeString(date_);
+    char time[32];
+    memcpy(time, lastTimeString_, 4);
+    time[4] = '-';
+    memcpy(time + 5, lastTimeString_ + 4, 2);
+    time[7] = '-';
+    memcpy(time + 8, lastTimeString_ + 6, 2);
+    time[10] = 'T';
+    memcpy(time + 11, lastTimeString_ + 9, 8);
+    time[19] = '.';
+    for (int i = 25; i > 19; --i)
     {
-        logStream_ << strerror_tl(errno) << " (errno=" << errno << ") ";
+        time[i] = static_cast<char>('0' + microSec % 10);
+        microSec /= 10;
     }
+    size_t length = 26;
+    if (!displayLocalTime_())
+        time[length++] = 'Z';
+    logStream_ << LogField("time", time, length)
+               << LogField("level", logLevelNames[level_])
+               << LogField("thread", threadId);
+    if (func)
+        logStream_ << LogField("func", func);
+}
+
+void Logger::formatSysErr()
+{
+    if (errno == 0)
+        return;
+    if (logStream_.format() == LogFormat::Text)
+        logStream_ << strerror_tl(errno) << " (errno=" << errno << ") ";
+    else
+        logStream_ << LogField("error", strerror_tl(errno))
+                   << LogField("errno", errno);
 }
 
 bool Logger::hasSpdLogSupport()
@@ -451,8 +523,40 @@ RawLogger::~RawLogger()
     }
 }
 
+void Logger::finish()
+{
+    if (logStream_.format() != LogFormat::Text)
+    {
+        if (sourceFile_.data_)
+            logStream_ << LogField("file", sourceFile_.data_, sourceFile_.size_)
+                       << LogField("line", fileLine_);
+        logStream_.endRecord();
+        return;
+    }
+    if (sourceFile_.data_)
+        logStream_ << T(" - ", 3) << sourceFile_ << ':' << fileLine_ << '\n';
+    else
+        logStream_ << '\n';
+}
+
 Logger::~Logger()
 {
+    if (!output_)
+        return;
+    // The length of the message without its source location
+    auto length = logStream_.bufferLength();
+    if (TRANTOR_UNLIKELY(level_ >= recordLevel_()))
+    {
+        finish();
+        LogFlightRecorder::record(date_.microSecondsSinceEpoch(),
+                                  logStream_.bufferData(),
+                                  logStream_.bufferLength());
+        if (level_ == kFatal && !sysErr_)
+            LogFlightRecorder::onFatal();
+        // Only recorded. Warnings and errors are output at any log level.
+        if (level_ <= kInfo && level_ < logLevel_())
+            return;
+    }
 #ifdef TRANTOR_SPDLOG_SUPPORT
     auto spdLogger = getSpdLogger(index_);
     if (spdLogger)
@@ -460,8 +564,7 @@ Logger::~Logger()
         spdlog::source_loc spdLocation;
         if (sourceFile_.data_)
             spdLocation = {sourceFile_.data_, fileLine_, func_ ? func_ : ""};
-        spdlog::string_view_t message(logStream_.bufferData(),
-                                      logStream_.bufferLength());
+        spdlog::string_view_t message(logStream_.bufferData(), length);
         message.remove_prefix(spdLogMessageOffset_);
 #if defined(SPDLOG_VERSION) && (SPDLOG_VERSION >= 10600)
         spdLogger->log(std::chrono::system_clock::time_point(
@@ -476,30 +579,72 @@ Logger::~Logger()
         return;
     }
 #endif  // TRANTOR_SPDLOG_SUPPORT
-    if (sourceFile_.data_)
-        logStream_ << T(" - ", 3) << sourceFile_ << ':' << fileLine_ << '\n';
-    else
-        logStream_ << '\n';
-    if (index_ < 0)
+    if (logStream_.bufferLength() == length)
+        finish();
+    auto &oFunc =
+        index_ < 0 ? Logger::outputFunc_() : Logger::outputFunc_(index_);
+    if (!oFunc)
+        return;
+    outputLevel_ = level_;
+    oFunc(logStream_.bufferData(), logStream_.bufferLength());
+    if (level_ >= kError)
     {
-        auto &oFunc = Logger::outputFunc_();
-        if (!oFunc)
-            return;
-        oFunc(logStream_.bufferData(), logStream_.bufferLength());
-        if (level_ >= kError)
+        if (index_ < 0)
             Logger::flushFunc_()();
+        else
+            Logger::flushFunc_(index_)();
     }
-    else
+    outputLevel_ = kInfo;
+}
+
+void Logger::formatLostMessages(LogStream &stream, uint64_t lost)
+{
+    auto format = logFormat_();
+    if (format == LogFormat::Text)
     {
-        auto &oFunc = Logger::outputFunc_(index_);
-        if (!oFunc)
-            return;
-        oFunc(logStream_.bufferData(), logStream_.bufferLength());
-        if (level_ >= kError)
-            Logger::flushFunc_(index_)();
+        stream << lost << " log information is lost\n";
+        return;
     }
+    stream.beginRecord(format);
+    stream << LogField("level", "error") << "log information is lost"
+           << LogField("lost", lost);
+    stream.endRecord();
+}
+
+Logger::LogLevel Logger::outputLevel()
+{
+    return outputLevel_;
 }
 LogStream &Logger::stream()
 {
     return logStream_;
 }
+
+void LogRateLimiter::reportSuppressed(uint64_t n)
+{
+    auto now = nowMs();
+    auto next = next_.load(std::memory_order_relaxed);
+    if (now < next)
+        return;
+    auto interval = reportInterval_().load(std::memory_order_relaxed);
+    if (!next_.compare_exchange_strong(next,
+                                       now + interval,
+                                       std::memory_order_relaxed))
+        return;
+    // The first suppressed message only starts the interval
+    if (next == 0)
+        return;
+    auto suppressed = takeSuppressed();
+    if (suppressed == 0)
+        return;
+    // The SYSERR call sites, the only ones of level FATAL, report as system
+    // errors, with the error of the message just suppressed
+    if (level_ == Logger::kFatal)
+        Logger(file_, line_, true).stream()
+            << "[" << suppressed << " suppressed] only the first " << n
+            << " messages are logged";
+    else
+        Logger(file_, line_, level_).stream()
+            << "[" << suppressed << " suppressed] only the first " << n
+            << " messages are logged";
+}
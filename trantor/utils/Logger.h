@@ -18,6 +18,8 @@
 #include <trantor/utils/Date.h>
 #include <trantor/utils/LogStream.h>
 #include <trantor/exports.h>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <functional>
 #include <iostream>
@@ -30,6 +32,60 @@ class logger;
 
 #define TRANTOR_IF_(cond) for (int _r = 0; _r == 0 && (cond); _r = 1)
 
+#if defined(__GNUC__) || defined(__clang__)
+#define TRANTOR_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define TRANTOR_UNLIKELY(x) (x)
+#endif
+
+/**
+ * Log statements of the levels below TRANTOR_MIN_LOG_LEVEL (0 for TRACE up to
+ * 5 for FATAL) are compiled out, whatever the level set at runtime. FATAL
+ * statements are always compiled in.
+ */
+#ifndef TRANTOR_MIN_LOG_LEVEL
+#define TRANTOR_MIN_LOG_LEVEL 0
+#endif
+
+// The conditions of the TRACE, DEBUG and INFO statements, which are enabled
+// from the log level or from the level recorded by LogFlightRecorder. TRACE
+// and DEBUG are usually disabled at runtime, their code is kept out of the
+// hot path.
+#if TRANTOR_MIN_LOG_LEVEL <= 0
+#define TRANTOR_LOG_TRACE_ON_ \
+    TRANTOR_UNLIKELY(trantor::Logger::enabledLevel() <= trantor::Logger::kTrace)
+#else
+#define TRANTOR_LOG_TRACE_ON_ 0
+#endif
+#if TRANTOR_MIN_LOG_LEVEL <= 1
+#define TRANTOR_LOG_DEBUG_ON_ \
+    TRANTOR_UNLIKELY(trantor::Logger::enabledLevel() <= trantor::Logger::kDebug)
+#else
+#define TRANTOR_LOG_DEBUG_ON_ 0
+#endif
+#if TRANTOR_MIN_LOG_LEVEL <= 2
+#define TRANTOR_LOG_INFO_ON_ \
+    (trantor::Logger::enabledLevel() <= trantor::Logger::kInfo)
+#else
+#define TRANTOR_LOG_INFO_ON_ 0
+#endif
+// WARN and ERROR statements are not filtered at runtime, they are prefixed
+// with a guard which is empty unless they are compiled out
+#if TRANTOR_MIN_LOG_LEVEL <= 3
+#define TRANTOR_LOG_WARN_ON_ 1
+#define TRANTOR_LOG_WARN_GUARD_
+#else
+#define TRANTOR_LOG_WARN_ON_ 0
+#define TRANTOR_LOG_WARN_GUARD_ TRANTOR_IF_(0)
+#endif
+#if TRANTOR_MIN_LOG_LEVEL <= 4
+#define TRANTOR_LOG_ERROR_ON_ 1
+#define TRANTOR_LOG_ERROR_GUARD_
+#else
+#define TRANTOR_LOG_ERROR_ON_ 0
+#define TRANTOR_LOG_ERROR_GUARD_ TRANTOR_IF_(0)
+#endif
+
 namespace trantor
 {
 /**
@@ -146,6 +202,7 @@ class TRANTOR_EXPORT Logger : public NonCopyable
     static void setLogLevel(LogLevel level)
     {
         logLevel_() = level;
+        updateEnabledLevel();
     }
 
     /**
@@ -158,6 +215,54 @@ class TRANTOR_EXPORT Logger : public NonCopyable
         return logLevel_();
     }
 
+    /**
+     * @brief Set the format of the log messages, LogFormat::Text by default.
+     * In the Json and Logfmt formats, a message is a line of fields: the time
+     * in ISO 8601, the level, the thread, the function for LOG_TRACE and
+     * LOG_DEBUG (and their _IF and _TO variants), the message and the fields
+     * appended with LogField, then the source file and line, e.g.
+     * {"time":"2024-01-01T12:00:00.000000Z","level":"info","thread":1234,
+     *  "msg":"request done","status":200,"file":"main.cc","line":10}
+     *
+     * @note The Json and Logfmt formats are not meant for spdlog, which
+     * formats the messages with its own pattern.
+     */
+    static void setLogFormat(LogFormat format)
+    {
+        logFormat_() = format;
+    }
+
+    static LogFormat logFormat()
+    {
+        return logFormat_();
+    }
+
+    /**
+     * @brief Append the line reporting lost messages to the stream, in the
+     * log format, e.g. {"level":"error","msg":"log information is lost",
+     * "lost":3} in the Json format.
+     */
+    static void formatLostMessages(LogStream &stream, uint64_t lost);
+
+    /**
+     * @brief Get the lowest level of the messages formatted by the log
+     * macros, which is the log level or the level recorded by
+     * LogFlightRecorder if it is lower. The messages below the log level are
+     * only recorded.
+     */
+    static LogLevel enabledLevel()
+    {
+        return enabledLevel_();
+    }
+
+    /**
+     * @brief Get the level of the message the calling thread is passing to
+     * the output function, for the output functions handling the levels
+     * differently. It is kInfo outside of the output of a message of Logger,
+     * e.g. for the LOG_RAW messages.
+     */
+    static LogLevel outputLevel();
+
     /**
      * @brief Check whether it shows local time or UTC time.
      */
@@ -273,6 +378,27 @@ class TRANTOR_EXPORT Logger : public NonCopyable
         fflush(stdout);
     }
     void formatTime();
+    void formatTime(uint64_t threadId);
+    // The time and the level, and the function if func is not null
+    void formatHeader(uint64_t threadId, const char *func);
+    void formatHeaderFields(uint64_t threadId, const char *func);
+    void formatSysErr();
+    static uint64_t currentThreadId();
+
+    friend class DeferredLogger;
+    friend class DeferredLogDecoder;
+    friend class LogFlightRecorder;
+    // Formats a message captured by a deferred log macro with the time and
+    // the thread of the capture. When output is false, the message is only
+    // formatted in the stream and finish() adds its source location.
+    Logger(SourceFile file,
+           int line,
+           LogLevel level,
+           const char *func,
+           const Date &date,
+           uint64_t threadId,
+           bool output = true);
+    void finish();
     static bool &displayLocalTime_()
     {
         static bool showLocalTime = false;
@@ -288,6 +414,28 @@ class TRANTOR_EXPORT Logger : public NonCopyable
 #endif
         return logLevel;
     }
+    static LogFormat &logFormat_()
+    {
+        static LogFormat logFormat = LogFormat::Text;
+        return logFormat;
+    }
+    static LogLevel &enabledLevel_()
+    {
+        static LogLevel enabledLevel = logLevel_();
+        return enabledLevel;
+    }
+    // The lowest level recorded by LogFlightRecorder, kNumberOfLogLevels
+    // when it is stopped
+    static LogLevel &recordLevel_()
+    {
+        static LogLevel recordLevel = kNumberOfLogLevels;
+        return recordLevel;
+    }
+    static void updateEnabledLevel()
+    {
+        enabledLevel_() = recordLevel_() < logLevel_() ? recordLevel_()
+                                                       : logLevel_();
+    }
     static std::function<void(const char *msg, const uint64_t len)> &
     outputFunc_()
     {
@@ -338,6 +486,9 @@ class TRANTOR_EXPORT Logger : public NonCopyable
     int index_{-1};
     const char *func_{nullptr};
     std::size_t spdLogMessageOffset_{0};
+    bool output_{true};
+    // LOG_SYSERR messages have the FATAL level
+    bool sysErr_{false};
 };
 class TRANTOR_EXPORT RawLogger : public NonCopyable
 {
@@ -357,6 +508,119 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
     LogStream logStream_;
     int index_{-1};
 };
+
+/**
+ * @brief The state of a rate limited log statement, one for each call site of
+ * the LOG_*_EVERY_N, LOG_*_FIRST_N and LOG_*_EVERY_MS macros.
+ *
+ * The messages suppressed at a call site are counted and the count is added
+ * to the next message logged there. The FIRST_N call sites, which log no
+ * more messages, report the count on a line of their own at most once per
+ * report interval, when they suppress a message.
+ */
+class TRANTOR_EXPORT LogRateLimiter : public NonCopyable
+{
+  public:
+    LogRateLimiter(Logger::SourceFile file, int line, Logger::LogLevel level)
+        : file_(file), line_(line), level_(level)
+    {
+    }
+
+    /**
+     * @brief Log the first of every n messages.
+     */
+    bool everyN(uint64_t n)
+    {
+        auto count = count_.fetch_add(1, std::memory_order_relaxed);
+        if (n <= 1 || count % n == 0)
+            return true;
+        return suppress();
+    }
+
+    /**
+     * @brief Log the first n messages.
+     */
+    bool firstN(uint64_t n)
+    {
+        if (count_.load(std::memory_order_relaxed) < n &&
+            count_.fetch_add(1, std::memory_order_relaxed) < n)
+            return true;
+        suppress();
+        reportSuppressed(n);
+        return false;
+    }
+
+    /**
+     * @brief Log at most one message every ms milliseconds.
+     */
+    bool everyMs(int64_t ms)
+    {
+        auto now = nowMs();
+        auto next = next_.load(std::memory_order_relaxed);
+        if (now >= next &&
+            next_.compare_exchange_strong(next,
+                                          now + ms,
+                                          std::memory_order_relaxed))
+            return true;
+        return suppress();
+    }
+
+    /**
+     * @brief Get the number of messages suppressed since the last call and
+     * reset it.
+     */
+    uint64_t takeSuppressed()
+    {
+        return suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Set the interval of the reports of the FIRST_N call sites, in
+     * milliseconds. The default is 10 seconds.
+     */
+    static void setReportInterval(int64_t ms)
+    {
+        reportInterval_().store(ms, std::memory_order_relaxed);
+    }
+
+  private:
+    bool suppress()
+    {
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    void reportSuppressed(uint64_t n);
+    static int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    static std::atomic<int64_t> &reportInterval_()
+    {
+        static std::atomic<int64_t> interval{10000};
+        return interval;
+    }
+
+    Logger::SourceFile file_;
+    int line_;
+    Logger::LogLevel level_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+    // The time of the next message of EVERY_MS, or of the next report of
+    // FIRST_N
+    std::atomic<int64_t> next_{0};
+};
+
+// Prefixes a message of a rate limited statement with the number of
+// messages suppressed before it
+inline LogStream &operator<<(LogStream &stream, LogRateLimiter &limiter)
+{
+    auto suppressed = limiter.takeSuppressed();
+    if (suppressed > 0)
+        stream << "[" << suppressed << " suppressed] ";
+    return stream;
+}
 #ifdef NDEBUG
 #define LOG_TRACE                                                          \
     TRANTOR_IF_(0)                                                         \
@@ -364,11 +628,11 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
         .stream()
 #else
 #define LOG_TRACE                                                          \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kTrace)    \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
         .stream()
 #define LOG_TRACE_TO(index)                                                \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kTrace)    \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
         .setIndex(index)                                                   \
         .stream()
@@ -376,29 +640,33 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
 #endif
 
 #define LOG_DEBUG                                                          \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kDebug)    \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
         .stream()
 #define LOG_DEBUG_TO(index)                                                \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kDebug)    \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
         .setIndex(index)                                                   \
         .stream()
-#define LOG_INFO                                                       \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kInfo) \
+#define LOG_INFO                      \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
     trantor::Logger(__FILE__, __LINE__).stream()
-#define LOG_INFO_TO(index)                                             \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kInfo) \
+#define LOG_INFO_TO(index)            \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
     trantor::Logger(__FILE__, __LINE__).setIndex(index).stream()
-#define LOG_WARN \
+#define LOG_WARN            \
+    TRANTOR_LOG_WARN_GUARD_ \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn).stream()
 #define LOG_WARN_TO(index)                                      \
+    TRANTOR_LOG_WARN_GUARD_                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn) \
         .setIndex(index)                                        \
         .stream()
-#define LOG_ERROR \
+#define LOG_ERROR            \
+    TRANTOR_LOG_ERROR_GUARD_ \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError).stream()
 #define LOG_ERROR_TO(index)                                      \
+    TRANTOR_LOG_ERROR_GUARD_                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError) \
         .setIndex(index)                                         \
         .stream()
@@ -413,23 +681,29 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
     trantor::Logger(__FILE__, __LINE__, true).setIndex(index).stream()
 
 // LOG_COMPACT_... begin block
-#define LOG_COMPACT_DEBUG                                               \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kDebug) \
+#define LOG_COMPACT_DEBUG              \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_) \
     trantor::Logger(trantor::Logger::kDebug).stream()
-#define LOG_COMPACT_DEBUG_TO(index)                                     \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kDebug) \
+#define LOG_COMPACT_DEBUG_TO(index)    \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_) \
     trantor::Logger(trantor::Logger::kDebug).setIndex(index).stream()
-#define LOG_COMPACT_INFO                                               \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kInfo) \
+#define LOG_COMPACT_INFO              \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
     trantor::Logger().stream()
-#define LOG_COMPACT_INFO_TO(index)                                     \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kInfo) \
+#define LOG_COMPACT_INFO_TO(index)    \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
     trantor::Logger().setIndex(index).stream()
-#define LOG_COMPACT_WARN trantor::Logger(trantor::Logger::kWarn).stream()
+#define LOG_COMPACT_WARN    \
+    TRANTOR_LOG_WARN_GUARD_ \
+    trantor::Logger(trantor::Logger::kWarn).stream()
 #define LOG_COMPACT_WARN_TO(index) \
+    TRANTOR_LOG_WARN_GUARD_        \
     trantor::Logger(trantor::Logger::kWarn).setIndex(index).stream()
-#define LOG_COMPACT_ERROR trantor::Logger(trantor::Logger::kError).stream()
+#define LOG_COMPACT_ERROR    \
+    TRANTOR_LOG_ERROR_GUARD_ \
+    trantor::Logger(trantor::Logger::kError).stream()
 #define LOG_COMPACT_ERROR_TO(index) \
+    TRANTOR_LOG_ERROR_GUARD_        \
     trantor::Logger(trantor::Logger::kError).setIndex(index).stream()
 #define LOG_COMPACT_FATAL trantor::Logger(trantor::Logger::kFatal).stream()
 #define LOG_COMPACT_FATAL_TO(index) \
@@ -442,30 +716,98 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
 #define LOG_RAW trantor::RawLogger().stream()
 #define LOG_RAW_TO(index) trantor::RawLogger().setIndex(index).stream()
 
-#define LOG_TRACE_IF(cond)                                                  \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kTrace) && \
-                (cond))                                                     \
-    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__)  \
+#define LOG_TRACE_IF(cond)                                                 \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_ && (cond))                           \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
         .stream()
-#define LOG_DEBUG_IF(cond)                                                  \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kDebug) && \
-                (cond))                                                     \
-    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__)  \
+#define LOG_DEBUG_IF(cond)                                                 \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_ && (cond))                           \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
         .stream()
-#define LOG_INFO_IF(cond)                                                  \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kInfo) && \
-                (cond))                                                    \
+#define LOG_INFO_IF(cond)                       \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__).stream()
-#define LOG_WARN_IF(cond) \
-    TRANTOR_IF_(cond)     \
+#define LOG_WARN_IF(cond)                       \
+    TRANTOR_IF_(TRANTOR_LOG_WARN_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn).stream()
-#define LOG_ERROR_IF(cond) \
-    TRANTOR_IF_(cond)      \
+#define LOG_ERROR_IF(cond)                       \
+    TRANTOR_IF_(TRANTOR_LOG_ERROR_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError).stream()
 #define LOG_FATAL_IF(cond) \
     TRANTOR_IF_(cond)      \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kFatal).stream()
 
+// Rate limited statements, LOG_<LEVEL>_EVERY_N(n) logs the first of every n
+// messages, LOG_<LEVEL>_FIRST_N(n) the first n messages and
+// LOG_<LEVEL>_EVERY_MS(ms) at most one message every ms milliseconds. The
+// suppressed messages are counted by a static LogRateLimiter of the call
+// site, only while the level is enabled.
+#define TRANTOR_LOG_LIMITER_(level)                                        \
+    []() -> trantor::LogRateLimiter & {                                    \
+        static trantor::LogRateLimiter limiter(__FILE__, __LINE__, level); \
+        return limiter;                                                    \
+    }()
+#define TRANTOR_LOG_LIMITED_(on, level, check)              \
+    for (trantor::LogRateLimiter *_limiter =                \
+             (on) ? &TRANTOR_LOG_LIMITER_(level) : nullptr; \
+         _limiter && _limiter->check;                       \
+         _limiter = nullptr)
+
+#ifdef NDEBUG
+#define TRANTOR_LOG_LIMITED_TRACE_ON_ 0
+#else
+#define TRANTOR_LOG_LIMITED_TRACE_ON_ TRANTOR_LOG_TRACE_ON_
+#endif
+#define TRANTOR_LOG_TRACE_LIMITED_(check)                                  \
+    TRANTOR_LOG_LIMITED_(TRANTOR_LOG_LIMITED_TRACE_ON_,                    \
+                         trantor::Logger::kTrace,                          \
+                         check)                                            \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
+            .stream()                                                      \
+        << *_limiter
+#define TRANTOR_LOG_DEBUG_LIMITED_(check)                                  \
+    TRANTOR_LOG_LIMITED_(TRANTOR_LOG_DEBUG_ON_,                            \
+                         trantor::Logger::kDebug,                          \
+                         check)                                            \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
+            .stream()                                                      \
+        << *_limiter
+#define TRANTOR_LOG_INFO_LIMITED_(check)                                      \
+    TRANTOR_LOG_LIMITED_(TRANTOR_LOG_INFO_ON_, trantor::Logger::kInfo, check) \
+    trantor::Logger(__FILE__, __LINE__).stream() << *_limiter
+#define TRANTOR_LOG_WARN_LIMITED_(check)                                      \
+    TRANTOR_LOG_LIMITED_(TRANTOR_LOG_WARN_ON_, trantor::Logger::kWarn, check) \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn).stream()      \
+        << *_limiter
+#define TRANTOR_LOG_ERROR_LIMITED_(check)                                 \
+    TRANTOR_LOG_LIMITED_(TRANTOR_LOG_ERROR_ON_,                           \
+                         trantor::Logger::kError,                         \
+                         check)                                           \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError).stream() \
+        << *_limiter
+#define TRANTOR_LOG_SYSERR_LIMITED_(check)                  \
+    TRANTOR_LOG_LIMITED_(1, trantor::Logger::kFatal, check) \
+    trantor::Logger(__FILE__, __LINE__, true).stream() << *_limiter
+
+#define LOG_TRACE_EVERY_N(n) TRANTOR_LOG_TRACE_LIMITED_(everyN(n))
+#define LOG_TRACE_FIRST_N(n) TRANTOR_LOG_TRACE_LIMITED_(firstN(n))
+#define LOG_TRACE_EVERY_MS(ms) TRANTOR_LOG_TRACE_LIMITED_(everyMs(ms))
+#define LOG_DEBUG_EVERY_N(n) TRANTOR_LOG_DEBUG_LIMITED_(everyN(n))
+#define LOG_DEBUG_FIRST_N(n) TRANTOR_LOG_DEBUG_LIMITED_(firstN(n))
+#define LOG_DEBUG_EVERY_MS(ms) TRANTOR_LOG_DEBUG_LIMITED_(everyMs(ms))
+#define LOG_INFO_EVERY_N(n) TRANTOR_LOG_INFO_LIMITED_(everyN(n))
+#define LOG_INFO_FIRST_N(n) TRANTOR_LOG_INFO_LIMITED_(firstN(n))
+#define LOG_INFO_EVERY_MS(ms) TRANTOR_LOG_INFO_LIMITED_(everyMs(ms))
+#define LOG_WARN_EVERY_N(n) TRANTOR_LOG_WARN_LIMITED_(everyN(n))
+#define LOG_WARN_FIRST_N(n) TRANTOR_LOG_WARN_LIMITED_(firstN(n))
+#define LOG_WARN_EVERY_MS(ms) TRANTOR_LOG_WARN_LIMITED_(everyMs(ms))
+#define LOG_ERROR_EVERY_N(n) TRANTOR_LOG_ERROR_LIMITED_(everyN(n))
+#define LOG_ERROR_FIRST_N(n) TRANTOR_LOG_ERROR_LIMITED_(firstN(n))
+#define LOG_ERROR_EVERY_MS(ms) TRANTOR_LOG_ERROR_LIMITED_(everyMs(ms))
+#define LOG_SYSERR_EVERY_N(n) TRANTOR_LOG_SYSERR_LIMITED_(everyN(n))
+#define LOG_SYSERR_FIRST_N(n) TRANTOR_LOG_SYSERR_LIMITED_(firstN(n))
+#define LOG_SYSERR_EVERY_MS(ms) TRANTOR_LOG_SYSERR_LIMITED_(everyMs(ms))
+
 #ifdef NDEBUG
 #define DLOG_TRACE                                                         \
     TRANTOR_IF_(0)                                                         \
@@ -510,42 +852,41 @@ class TRANTOR_EXPORT RawLogger : public NonCopyable
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kFatal).stream()
 #else
 #define DLOG_TRACE                                                         \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kTrace)    \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
         .stream()
 #define DLOG_DEBUG                                                         \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kDebug)    \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_)                                     \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
         .stream()
-#define DLOG_INFO                                                      \
-    TRANTOR_IF_(trantor::Logger::logLevel() <= trantor::Logger::kInfo) \
+#define DLOG_INFO                     \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_) \
     trantor::Logger(__FILE__, __LINE__).stream()
-#define DLOG_WARN \
+#define DLOG_WARN           \
+    TRANTOR_LOG_WARN_GUARD_ \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn).stream()
-#define DLOG_ERROR \
+#define DLOG_ERROR           \
+    TRANTOR_LOG_ERROR_GUARD_ \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError).stream()
 #define DLOG_FATAL \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kFatal).stream()
 
-#define DLOG_TRACE_IF(cond)                                                 \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kTrace) && \
-                (cond))                                                     \
-    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__)  \
+#define DLOG_TRACE_IF(cond)                                                \
+    TRANTOR_IF_(TRANTOR_LOG_TRACE_ON_ && (cond))                           \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kTrace, __func__) \
         .stream()
-#define DLOG_DEBUG_IF(cond)                                                 \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kDebug) && \
-                (cond))                                                     \
-    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__)  \
+#define DLOG_DEBUG_IF(cond)                                                \
+    TRANTOR_IF_(TRANTOR_LOG_DEBUG_ON_ && (cond))                           \
+    trantor::Logger(__FILE__, __LINE__, trantor::Logger::kDebug, __func__) \
         .stream()
-#define DLOG_INFO_IF(cond)                                                 \
-    TRANTOR_IF_((trantor::Logger::logLevel() <= trantor::Logger::kInfo) && \
-                (cond))                                                    \
+#define DLOG_INFO_IF(cond)                      \
+    TRANTOR_IF_(TRANTOR_LOG_INFO_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__).stream()
-#define DLOG_WARN_IF(cond) \
-    TRANTOR_IF_(cond)      \
+#define DLOG_WARN_IF(cond)                      \
+    TRANTOR_IF_(TRANTOR_LOG_WARN_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kWarn).stream()
-#define DLOG_ERROR_IF(cond) \
-    TRANTOR_IF_(cond)       \
+#define DLOG_ERROR_IF(cond)                      \
+    TRANTOR_IF_(TRANTOR_LOG_ERROR_ON_ && (cond)) \
     trantor::Logger(__FILE__, __LINE__, trantor::Logger::kError).stream()
 #define DLOG_FATAL_IF(cond) \
     TRANTOR_IF_(cond)       \
@@ -14,6 +14,7 @@
 
 #include <trantor/utils/MsgBuffer.h>
 #include <trantor/utils/Funcs.h>
+#include "ByteSearch.h"
 #include <string.h>
 #ifndef _WIN32
 #include <sys/uio.h>
@@ -22,6 +23,11 @@
 #include <WindowsSupport.h>
 #include <winsock2.h>
 #endif
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include <errno.h>
 #include <assert.h>
 
@@ -29,17 +35,163 @@ using namespace trantor;
 namespace trantor
 {
 static constexpr size_t kBufferOffset{8};
+static constexpr size_t kExtBufferSize{8192};
+}
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+static char *mapRing(size_t size)
+{
+    int fd = static_cast<int>(
+        ::syscall(SYS_memfd_create, "trantor-ring", 1U /* MFD_CLOEXEC */));
+    if (fd < 0)
+        return nullptr;
+    char *ring = nullptr;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        // Reserve the address range, then map the file twice into it
+        void *base = ::mmap(
+            nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            auto first = static_cast<char *>(base);
+            if (::mmap(first,
+                       size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED,
+                       fd,
+                       0) != MAP_FAILED &&
+                ::mmap(first + size,
+                       size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED,
+                       fd,
+                       0) != MAP_FAILED)
+                ring = first;
+            else
+                ::munmap(base, size * 2);
+        }
+    }
+    ::close(fd);
+    return ring;
+}
+static void unmapRing(char *ring, size_t size)
+{
+    ::munmap(ring, size * 2);
+}
+static size_t roundToPageSize(size_t size)
+{
+    static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    if (size == 0)
+        size = 1;
+    return (size + pageSize - 1) / pageSize * pageSize;
 }
+#else
+static char *mapRing(size_t)
+{
+    return nullptr;
+}
+static void unmapRing(char *, size_t)
+{
+}
+static size_t roundToPageSize(size_t size)
+{
+    return size;
+}
+#endif
 
 MsgBuffer::MsgBuffer(size_t len)
     : head_(kBufferOffset), initCap_(len), buffer_(len + head_), tail_(head_)
 {
 }
 
+MsgBuffer::MsgBuffer(const MsgBuffer &other)
+    : head_(other.head_),
+      initCap_(other.initCap_),
+      buffer_(other.buffer_),
+      tail_(other.tail_)
+{
+    if (other.ring_)
+    {
+        buffer_.resize(kBufferOffset);
+        head_ = tail_ = kBufferOffset;
+        enableRingBuffer(other.ringSize_);
+        append(other);
+    }
+}
+
+MsgBuffer::MsgBuffer(MsgBuffer &&other) noexcept
+    : head_(other.head_),
+      initCap_(other.initCap_),
+      buffer_(std::move(other.buffer_)),
+      tail_(other.tail_),
+      ring_(other.ring_),
+      ringSize_(other.ringSize_)
+{
+    other.ring_ = nullptr;
+    other.ringSize_ = 0;
+}
+
+MsgBuffer &MsgBuffer::operator=(const MsgBuffer &other)
+{
+    if (this != &other)
+    {
+        MsgBuffer copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+MsgBuffer &MsgBuffer::operator=(MsgBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        MsgBuffer tmp(std::move(other));
+        swap(tmp);
+    }
+    return *this;
+}
+
+MsgBuffer::~MsgBuffer()
+{
+    if (ring_)
+        unmapRing(ring_, ringSize_);
+}
+
+bool MsgBuffer::enableRingBuffer(size_t capacity)
+{
+    if (ring_)
+        return true;
+    size_t size = roundToPageSize((std::max)(capacity, readableBytes()));
+    char *ring = mapRing(size);
+    if (!ring)
+        return false;
+    size_t len = readableBytes();
+    memcpy(ring, peek(), len);
+    std::vector<char, detail::DefaultInitAllocator<char>>().swap(buffer_);
+    ring_ = ring;
+    ringSize_ = size;
+    head_ = 0;
+    tail_ = len;
+    return true;
+}
+
 void MsgBuffer::ensureWritableBytes(size_t len)
 {
     if (writableBytes() >= len)
         return;
+    if (ring_)
+    {
+        // Too much data is pending, get a larger ring
+        size_t newSize = ringSize_ * 2;
+        while (newSize < readableBytes() + len)
+            newSize *= 2;
+        MsgBuffer newbuffer(0);
+        if (!newbuffer.enableRingBuffer(newSize))
+            newbuffer.ensureWritableBytes(newSize);
+        newbuffer.append(*this);
+        swap(newbuffer);
+        return;
+    }
     if (head_ + writableBytes() >=
         (len + kBufferOffset))  // move readable bytes
     {
@@ -58,23 +210,36 @@ void MsgBuffer::ensureWritableBytes(size_t len)
     newbuffer.append(*this);
     swap(newbuffer);
 }
+void MsgBuffer::shrinkToFit(size_t minLen)
+{
+    if (ring_)
+        return;
+    size_t newLen = (std::max)(minLen, readableBytes());
+    if (buffer_.capacity() <= newLen + kBufferOffset)
+        return;
+    MsgBuffer newbuffer(newLen);
+    newbuffer.append(*this);
+    swap(newbuffer);
+}
 void MsgBuffer::swap(MsgBuffer &buf) noexcept
 {
     buffer_.swap(buf.buffer_);
     std::swap(head_, buf.head_);
     std::swap(tail_, buf.tail_);
     std::swap(initCap_, buf.initCap_);
+    std::swap(ring_, buf.ring_);
+    std::swap(ringSize_, buf.ringSize_);
 }
 void MsgBuffer::append(const MsgBuffer &buf)
 {
     ensureWritableBytes(buf.readableBytes());
-    memcpy(&buffer_[tail_], buf.peek(), buf.readableBytes());
+    memcpy(begin() + tail_, buf.peek(), buf.readableBytes());
     tail_ += buf.readableBytes();
 }
 void MsgBuffer::append(const char *buf, size_t len)
 {
     ensureWritableBytes(len);
-    memcpy(&buffer_[tail_], buf, len);
+    memcpy(begin() + tail_, buf, len);
     tail_ += len;
 }
 void MsgBuffer::appendInt16(const uint16_t s)
@@ -136,9 +301,19 @@ void MsgBuffer::retrieve(size_t len)
         return;
     }
     head_ += len;
+    if (ring_ && head_ >= ringSize_)
+    {
+        head_ -= ringSize_;
+        tail_ -= ringSize_;
+    }
 }
 void MsgBuffer::retrieveAll()
 {
+    if (ring_)
+    {
+        tail_ = head_ = 0;
+        return;
+    }
     if (buffer_.size() > (initCap_ * 2))
     {
         buffer_.resize(initCap_ + kBufferOffset);
@@ -147,7 +322,7 @@ void MsgBuffer::retrieveAll()
 }
 ssize_t MsgBuffer::readFd(int fd, int *retErrno)
 {
-    char extBuffer[8192];
+    char extBuffer[kExtBufferSize];
     struct iovec vec[2];
     size_t writable = writableBytes();
     vec[0].iov_base = begin() + tail_;
@@ -166,12 +341,47 @@ ssize_t MsgBuffer::readFd(int fd, int *retErrno)
     }
     else
     {
-        tail_ = buffer_.size();
+        tail_ += writable;
         append(extBuffer, n - writable);
     }
     return n;
 }
 
+ssize_t MsgBuffer::readFd(int fd, int *retErrno, size_t len)
+{
+    // Small reads go through the stack buffer, so that the buffer only grows
+    // when the data does not fit in it
+    // A ring never grows to read more, unless it is full
+    if (ring_ && writableBytes() > 0)
+        len = writableBytes();
+    else if (len <= kExtBufferSize)
+        return readFd(fd, retErrno);
+    ensureWritableBytes(len);
+    struct iovec vec;
+    size_t writable = writableBytes();
+    vec.iov_base = begin() + tail_;
+    vec.iov_len = static_cast<int>(writable);
+    ssize_t n = ::readv(fd, &vec, 1);
+    if (n < 0)
+        *retErrno = errno;
+    else
+        tail_ += n;
+    return n;
+}
+
+const char *MsgBuffer::findCRLF() const
+{
+    return detail::findSequence(peek(), beginWrite(), "\r\n", 2);
+}
+const char *MsgBuffer::find(const char *delim, size_t len) const
+{
+    return detail::findSequence(peek(), beginWrite(), delim, len);
+}
+const char *MsgBuffer::findAnyOf(const char *chars, size_t len) const
+{
+    return detail::findAnyOf(peek(), beginWrite(), chars, len);
+}
+
 std::string MsgBuffer::read(size_t len)
 {
     if (len > readableBytes())
@@ -207,6 +417,24 @@ uint64_t MsgBuffer::readInt64()
 
 void MsgBuffer::addInFront(const char *buf, size_t len)
 {
+    if (ring_ && writableBytes() < len)
+        ensureWritableBytes(len);
+    if (ring_)
+    {
+        // The bytes before head_ wrap around to the end of the ring
+        size_t readable = readableBytes();
+        if (head_ >= len)
+        {
+            head_ -= len;
+        }
+        else
+        {
+            head_ += ringSize_ - len;
+            tail_ = head_ + readable + len;
+        }
+        memcpy(begin() + head_, buf, len);
+        return;
+    }
     if (head_ >= len)
     {
         memcpy(begin() + head_ - len, buf, len);
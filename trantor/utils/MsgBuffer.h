@@ -14,6 +14,7 @@
 
 #pragma once
 #include <trantor/utils/NonCopyable.h>
+#include <trantor/utils/BufferPool.h>
 #include <trantor/exports.h>
 #include <vector>
 #include <string>
@@ -22,6 +23,10 @@
 #include <assert.h>
 #include <string.h>
 #include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #if defined(_WIN32) && !defined(_SSIZE_T_DEFINED)
 using ssize_t = std::intptr_t;
 #endif
@@ -30,6 +35,43 @@ using ssize_t = std::intptr_t;
 
 namespace trantor
 {
+namespace detail
+{
+/**
+ * @brief An allocator that default-initializes the elements constructed
+ * without arguments, so growing a std::vector<char> with it does not zero the
+ * new bytes.
+ */
+template <typename T>
+class DefaultInitAllocator : public PoolAllocator<T>
+{
+  public:
+    template <typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() noexcept = default;
+    template <typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U> &other) noexcept
+        : PoolAllocator<T>(other)
+    {
+    }
+
+    template <typename U>
+    void construct(U *ptr) noexcept(
+        std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new (static_cast<void *>(ptr)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U *ptr, Args &&...args)
+    {
+        ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+}  // namespace detail
 
 /**
  * @brief This class represents a memory buffer used for sending and receiving
@@ -45,6 +87,34 @@ class TRANTOR_EXPORT MsgBuffer
      * @param len The initial size of the buffer.
      */
     explicit MsgBuffer(size_t len = TRANTOR_BUFFER_DEFAULT_LENGTH);
+    MsgBuffer(const MsgBuffer &other);
+    MsgBuffer(MsgBuffer &&other) noexcept;
+    MsgBuffer &operator=(const MsgBuffer &other);
+    MsgBuffer &operator=(MsgBuffer &&other) noexcept;
+    ~MsgBuffer();
+
+    /**
+     * @brief Switch the buffer to ring mode. The storage is mapped twice in a
+     * row in the virtual memory, so the readable data is always contiguous
+     * without ever moving it: retrieving data never compacts the buffer and
+     * reads never wrap. The storage has a fixed size and is only reallocated
+     * if more data than it can hold is written before being retrieved.
+     *
+     * @param capacity The size of the ring, rounded up to the page size.
+     * @return true if the ring is set up, false if it is not supported on this
+     * platform or the memory could not be mapped. The buffer is unchanged
+     * in the latter case.
+     * @note Only available on Linux.
+     */
+    bool enableRingBuffer(size_t capacity);
+
+    /**
+     * @brief Return true if the buffer is in ring mode.
+     */
+    bool isRingBuffer() const
+    {
+        return ring_ != nullptr;
+    }
 
     /**
      * @brief Get the beginning of the buffer.
@@ -162,6 +232,8 @@ class TRANTOR_EXPORT MsgBuffer
      */
     size_t writableBytes() const
     {
+        if (ring_)
+            return ringSize_ - (tail_ - head_);
         return buffer_.size() - tail_;
     }
 
@@ -275,6 +347,20 @@ class TRANTOR_EXPORT MsgBuffer
      */
     ssize_t readFd(int fd, int *retErrno);
 
+    /**
+     * @brief Read data from a file descriptor directly into the buffer,
+     * growing it first so that at least len bytes can be read with one call.
+     * Small sizes are read through a stack buffer like readFd(fd, retErrno)
+     * so the buffer is only grown when needed.
+     *
+     * @param fd The file descriptor. It is usually a socket.
+     * @param retErrno The error code when reading.
+     * @param len The number of bytes expected.
+     * @return ssize_t The number of bytes read from the file descriptor, it
+     * may be larger than len. -1 is returned when an error occurs.
+     */
+    ssize_t readFd(int fd, int *retErrno, size_t len);
+
     /**
      * @brief Remove the data before a certain position from the buffer.
      *
@@ -292,20 +378,75 @@ class TRANTOR_EXPORT MsgBuffer
      *
      * @return const char*
      */
-    const char *findCRLF() const
+    const char *findCRLF() const;
+
+    /**
+     * @brief Find the first occurrence of a byte in the readable data.
+     *
+     * @return const char* NULL if not found.
+     */
+    const char *find(char c) const
     {
-        constexpr char CRLF[]{"\r\n"};
-        const char *crlf = std::search(peek(), beginWrite(), CRLF, CRLF + 2);
-        return crlf == beginWrite() ? NULL : crlf;
+        return static_cast<const char *>(
+            memchr(peek(), c, readableBytes()));
+    }
+
+    /**
+     * @brief Find the first occurrence of a delimiter in the readable data.
+     * SIMD instructions are used when the CPU supports them.
+     *
+     * @param delim
+     * @param len The length of the delimiter.
+     * @return const char* NULL if not found.
+     */
+    const char *find(const char *delim, size_t len) const;
+    const char *find(const std::string &delim) const
+    {
+        return find(delim.data(), delim.length());
+    }
+
+    /**
+     * @brief Find the first byte of the readable data that is any of the
+     * given bytes. SIMD instructions are used when the CPU supports them.
+     *
+     * @param chars The set of bytes to look for.
+     * @param len The number of bytes in the set.
+     * @return const char* NULL if not found.
+     */
+    const char *findAnyOf(const char *chars, size_t len) const;
+    const char *findAnyOf(const std::string &chars) const
+    {
+        return findAnyOf(chars.data(), chars.length());
     }
 
     /**
      * @brief Make sure the buffer has enough spaces to write data.
      *
+     * @note The new space is not initialized, reserving a large buffer before
+     * reading into it with beginWrite() and hasWritten() does not touch the
+     * memory.
+     *
      * @param len
      */
     void ensureWritableBytes(size_t len);
 
+    /**
+     * @brief Get the number of bytes allocated for the buffer.
+     *
+     * @return size_t
+     */
+    size_t capacity() const
+    {
+        return ring_ ? ringSize_ : buffer_.capacity();
+    }
+
+    /**
+     * @brief Release the memory not needed to hold the readable bytes.
+     *
+     * @param minLen The buffer keeps at least this many bytes of storage.
+     */
+    void shrinkToFit(size_t minLen = TRANTOR_BUFFER_DEFAULT_LENGTH);
+
     /**
      * @brief Move the write pointer forward when the new data has been written
      * to the buffer.
@@ -350,15 +491,19 @@ class TRANTOR_EXPORT MsgBuffer
   private:
     size_t head_;
     size_t initCap_;
-    std::vector<char> buffer_;
+    std::vector<char, detail::DefaultInitAllocator<char>> buffer_;
     size_t tail_;
+    // Ring mode: head_ < ringSize_ and tail_ - head_ <= ringSize_, the memory
+    // after ring_ + ringSize_ is the same as the one from ring_
+    char *ring_{nullptr};
+    size_t ringSize_{0};
     const char *begin() const
     {
-        return &buffer_[0];
+        return ring_ ? ring_ : &buffer_[0];
     }
     char *begin()
     {
-        return &buffer_[0];
+        return ring_ ? ring_ : &buffer_[0];
     }
 };
 
@@ -0,0 +1,490 @@
+/**
+ *
+ *  SegmentedBuffer.cc
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#include <trantor/utils/SegmentedBuffer.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#else
+#include <WindowsSupport.h>
+#endif
+#include <errno.h>
+#include <assert.h>
+#include <atomic>
+#include <new>
+#include <vector>
+
+using namespace trantor;
+
+constexpr size_t SegmentedBuffer::kBlockSize;
+
+struct SegmentedBuffer::Block
+{
+    Block *next;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    // Held by the buffer owning the block and by each slice of it
+    std::atomic<size_t> refCount;
+    char *data()
+    {
+        return reinterpret_cast<char *>(this + 1);
+    }
+    size_t readableBytes() const
+    {
+        return tail - head;
+    }
+    size_t writableBytes() const
+    {
+        return capacity - tail;
+    }
+};
+
+namespace
+{
+// Blocks kept per thread for reuse, 1MB with the default block size.
+constexpr size_t kMaxPooledBlocks{64};
+// Number of new blocks offered to each readv() call.
+constexpr size_t kReadBlocks{4};
+
+// Set when the pool of the thread is gone, buffers destroyed after that (e.g.
+// in other thread-local objects) free their blocks directly.
+thread_local bool poolDestroyed{false};
+
+struct BlockPool
+{
+    std::vector<void *> blocks_;
+    ~BlockPool()
+    {
+        poolDestroyed = true;
+        for (auto block : blocks_)
+            ::operator delete(block);
+    }
+};
+
+BlockPool &blockPool()
+{
+    static thread_local BlockPool pool;
+    return pool;
+}
+}  // namespace
+
+SegmentedBuffer::Block *SegmentedBuffer::newBlock(size_t minCapacity)
+{
+    void *mem{nullptr};
+    size_t capacity = kBlockSize;
+    if (minCapacity > capacity)
+    {
+        capacity = minCapacity;
+    }
+    else if (!poolDestroyed)
+    {
+        auto &pool = blockPool().blocks_;
+        if (!pool.empty())
+        {
+            mem = pool.back();
+            pool.pop_back();
+        }
+    }
+    if (!mem)
+        mem = ::operator new(sizeof(Block) + capacity);
+    auto block = new (mem) Block;
+    block->next = nullptr;
+    block->head = 0;
+    block->tail = 0;
+    block->capacity = capacity;
+    block->refCount.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+static void freeBlock(void *block, size_t capacity)
+{
+    if (capacity == SegmentedBuffer::kBlockSize && !poolDestroyed)
+    {
+        auto &pool = blockPool().blocks_;
+        if (pool.size() < kMaxPooledBlocks)
+        {
+            pool.push_back(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+SegmentedBuffer::SegmentedBuffer(SegmentedBuffer &&other) noexcept
+    : head_(other.head_),
+      tail_(other.tail_),
+      readableBytes_(other.readableBytes_)
+{
+    other.head_ = other.tail_ = nullptr;
+    other.readableBytes_ = 0;
+}
+
+SegmentedBuffer &SegmentedBuffer::operator=(SegmentedBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        retrieveAll();
+        head_ = other.head_;
+        tail_ = other.tail_;
+        readableBytes_ = other.readableBytes_;
+        other.head_ = other.tail_ = nullptr;
+        other.readableBytes_ = 0;
+    }
+    return *this;
+}
+
+SegmentedBuffer::~SegmentedBuffer()
+{
+    retrieveAll();
+}
+
+size_t SegmentedBuffer::segmentCount() const
+{
+    size_t count = 0;
+    for (auto block = head_; block; block = block->next)
+        ++count;
+    return count;
+}
+
+const char *SegmentedBuffer::peek(size_t &len) const
+{
+    if (!head_)
+    {
+        len = 0;
+        return nullptr;
+    }
+    len = head_->readableBytes();
+    return head_->data() + head_->head;
+}
+
+void SegmentedBuffer::append(const char *buf, size_t len)
+{
+    readableBytes_ += len;
+    while (len > 0)
+    {
+        if (!tail_ || tail_->writableBytes() == 0)
+        {
+            auto block = newBlock(kBlockSize);
+            if (tail_)
+                tail_->next = block;
+            else
+                head_ = block;
+            tail_ = block;
+        }
+        size_t n = tail_->writableBytes();
+        if (n > len)
+            n = len;
+        memcpy(tail_->data() + tail_->tail, buf, n);
+        tail_->tail += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+void SegmentedBuffer::append(SegmentedBuffer &&other)
+{
+    if (this == &other || other.empty())
+        return;
+    if (empty())
+    {
+        *this = std::move(other);
+        return;
+    }
+    tail_->next = other.head_;
+    tail_ = other.tail_;
+    readableBytes_ += other.readableBytes_;
+    other.head_ = other.tail_ = nullptr;
+    other.readableBytes_ = 0;
+}
+
+void SegmentedBuffer::prepend(const char *buf, size_t len)
+{
+    if (len == 0)
+        return;
+    readableBytes_ += len;
+    // The head room of a block may still be visible through slices
+    if (head_ && head_->head >= len &&
+        head_->refCount.load(std::memory_order_acquire) == 1)
+    {
+        head_->head -= len;
+        memcpy(head_->data() + head_->head, buf, len);
+        return;
+    }
+    // Fill the new block from its end, so that further prepends are likely to
+    // fit in front of the data.
+    auto block = newBlock(len);
+    block->tail = block->capacity;
+    block->head = block->capacity - len;
+    memcpy(block->data() + block->head, buf, len);
+    block->next = head_;
+    head_ = block;
+    if (!tail_)
+        tail_ = block;
+}
+
+void SegmentedBuffer::prepend(SegmentedBuffer &&other)
+{
+    if (this == &other || other.empty())
+        return;
+    if (empty())
+    {
+        *this = std::move(other);
+        return;
+    }
+    other.tail_->next = head_;
+    head_ = other.head_;
+    readableBytes_ += other.readableBytes_;
+    other.head_ = other.tail_ = nullptr;
+    other.readableBytes_ = 0;
+}
+
+void SegmentedBuffer::releaseBlock(Block *block)
+{
+    if (block->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    auto capacity = block->capacity;
+    block->~Block();
+    freeBlock(block, capacity);
+}
+
+void SegmentedBuffer::releaseFront()
+{
+    assert(head_);
+    auto block = head_;
+    head_ = block->next;
+    if (!head_)
+        tail_ = nullptr;
+    releaseBlock(block);
+}
+
+void SegmentedBuffer::retrieve(size_t len)
+{
+    if (len >= readableBytes_)
+    {
+        retrieveAll();
+        return;
+    }
+    readableBytes_ -= len;
+    while (len > 0)
+    {
+        size_t n = head_->readableBytes();
+        if (len < n)
+        {
+            head_->head += len;
+            return;
+        }
+        len -= n;
+        releaseFront();
+    }
+}
+
+void SegmentedBuffer::retrieveAll()
+{
+    while (head_)
+        releaseFront();
+    readableBytes_ = 0;
+}
+
+std::string SegmentedBuffer::read(size_t len)
+{
+    if (len > readableBytes_)
+        len = readableBytes_;
+    std::string ret(len, '\0');
+    if (len > 0)
+        copyTo(&ret[0], len);
+    retrieve(len);
+    return ret;
+}
+
+BufferSlice SegmentedBuffer::readSlice(size_t len)
+{
+    if (len > readableBytes_)
+        len = readableBytes_;
+    if (len == 0)
+        return BufferSlice();
+    const char *data = contiguous(len);
+    BufferSlice slice(head_, data, len);
+    retrieve(len);
+    return slice;
+}
+
+size_t SegmentedBuffer::copyTo(char *dst, size_t len) const
+{
+    size_t copied = 0;
+    for (auto block = head_; block && copied < len; block = block->next)
+    {
+        size_t n = block->readableBytes();
+        if (n > len - copied)
+            n = len - copied;
+        memcpy(dst + copied, block->data() + block->head, n);
+        copied += n;
+    }
+    return copied;
+}
+
+const char *SegmentedBuffer::contiguous(size_t len)
+{
+    assert(len <= readableBytes_);
+    if (!head_)
+        return nullptr;
+    if (head_->readableBytes() >= len)
+        return head_->data() + head_->head;
+    auto block = newBlock(len);
+    block->tail = copyTo(block->data(), len);
+    retrieve(len);
+    block->next = head_;
+    head_ = block;
+    if (!tail_)
+        tail_ = block;
+    readableBytes_ += len;
+    return block->data();
+}
+
+size_t SegmentedBuffer::peekSegments(struct iovec *vec, size_t maxCount) const
+{
+    size_t count = 0;
+    for (auto block = head_; block && count < maxCount; block = block->next)
+    {
+        vec[count].iov_base = block->data() + block->head;
+        vec[count].iov_len = static_cast<int>(block->readableBytes());
+        ++count;
+    }
+    return count;
+}
+
+ssize_t SegmentedBuffer::readFd(int fd, int *retErrno)
+{
+    struct iovec vec[kReadBlocks + 1];
+    Block *blocks[kReadBlocks];
+    int iovcnt = 0;
+    size_t writable = tail_ ? tail_->writableBytes() : 0;
+    if (writable > 0)
+    {
+        vec[0].iov_base = tail_->data() + tail_->tail;
+        vec[0].iov_len = static_cast<int>(writable);
+        ++iovcnt;
+    }
+    for (size_t i = 0; i < kReadBlocks; ++i)
+    {
+        blocks[i] = newBlock(kBlockSize);
+        vec[iovcnt].iov_base = blocks[i]->data();
+        vec[iovcnt].iov_len = static_cast<int>(blocks[i]->capacity);
+        ++iovcnt;
+    }
+    ssize_t n = ::readv(fd, vec, iovcnt);
+    size_t remaining = 0;
+    if (n < 0)
+    {
+        *retErrno = errno;
+    }
+    else
+    {
+        remaining = static_cast<size_t>(n);
+        readableBytes_ += remaining;
+        if (writable > 0)
+        {
+            size_t len = remaining < writable ? remaining : writable;
+            tail_->tail += len;
+            remaining -= len;
+        }
+    }
+    // Link the blocks that received data, give the others back to the pool.
+    size_t used = 0;
+    for (; used < kReadBlocks && remaining > 0; ++used)
+    {
+        auto block = blocks[used];
+        size_t len = remaining < block->capacity ? remaining : block->capacity;
+        block->tail = len;
+        remaining -= len;
+        if (tail_)
+            tail_->next = block;
+        else
+            head_ = block;
+        tail_ = block;
+    }
+    for (size_t i = kReadBlocks; i > used; --i)
+    {
+        auto block = blocks[i - 1];
+        auto capacity = block->capacity;
+        block->~Block();
+        freeBlock(block, capacity);
+    }
+    return n;
+}
+
+BufferSlice::BufferSlice(SegmentedBuffer::Block *block,
+                         const char *data,
+                         size_t size)
+    : block_(block), data_(data), size_(size)
+{
+    block_->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferSlice::BufferSlice(const BufferSlice &other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_)
+{
+    if (block_)
+        block_->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferSlice::BufferSlice(BufferSlice &&other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_)
+{
+    other.block_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+BufferSlice &BufferSlice::operator=(const BufferSlice &other) noexcept
+{
+    if (this != &other)
+    {
+        BufferSlice copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+BufferSlice &BufferSlice::operator=(BufferSlice &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (block_)
+            SegmentedBuffer::releaseBlock(block_);
+        block_ = other.block_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.block_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+BufferSlice::~BufferSlice()
+{
+    if (block_)
+        SegmentedBuffer::releaseBlock(block_);
+}
+
+BufferSlice BufferSlice::subSlice(size_t offset, size_t len) const
+{
+    if (offset >= size_)
+        return BufferSlice();
+    if (len > size_ - offset)
+        len = size_ - offset;
+    if (len == 0)
+        return BufferSlice();
+    return BufferSlice(block_, data_ + offset, len);
+}
@@ -0,0 +1,235 @@
+/**
+ *
+ *  @file SegmentedBuffer.h
+ *
+ *  Public header file in trantor lib.
+ *
+ *  Copyright 2018, An Tao.  All rights reserved.
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the License file.
+ *
+ *
+ */
+
+#pragma once
+#include <trantor/utils/NonCopyable.h>
+#include <trantor/utils/MsgBuffer.h>
+#include <trantor/exports.h>
+#include <string>
+#include <stddef.h>
+
+struct iovec;
+
+namespace trantor
+{
+class BufferSlice;
+
+/**
+ * @brief This class represents a buffer made of a chain of fixed size
+ * blocks. Unlike MsgBuffer, it never reallocates or moves the data it holds
+ * when growing, which makes it suitable for large streamed messages. Blocks
+ * are recycled through a per-thread pool.
+ *
+ */
+class TRANTOR_EXPORT SegmentedBuffer : public NonCopyable
+{
+  public:
+    /**
+     * @brief The size of the pooled blocks.
+     */
+    static constexpr size_t kBlockSize = 16 * 1024;
+
+    SegmentedBuffer() = default;
+    SegmentedBuffer(SegmentedBuffer &&other) noexcept;
+    SegmentedBuffer &operator=(SegmentedBuffer &&other) noexcept;
+    ~SegmentedBuffer();
+
+    /**
+     * @brief Return the size of the data in the buffer.
+     *
+     * @return size_t
+     */
+    size_t readableBytes() const
+    {
+        return readableBytes_;
+    }
+
+    /**
+     * @brief Return true if there is no data in the buffer.
+     */
+    bool empty() const
+    {
+        return readableBytes_ == 0;
+    }
+
+    /**
+     * @brief Return the number of blocks holding data.
+     */
+    size_t segmentCount() const;
+
+    /**
+     * @brief Get the first contiguous segment of the data.
+     *
+     * @param len Set to the size of the segment.
+     * @return const char* nullptr if the buffer is empty.
+     */
+    const char *peek(size_t &len) const;
+
+    /**
+     * @brief Append data to the end of the buffer.
+     */
+    void append(const char *buf, size_t len);
+    void append(const std::string &buf)
+    {
+        append(buf.data(), buf.length());
+    }
+    void append(const MsgBuffer &buf)
+    {
+        append(buf.peek(), buf.readableBytes());
+    }
+
+    /**
+     * @brief Move all blocks of another buffer to the end of this buffer
+     * without copying the data. O(1).
+     */
+    void append(SegmentedBuffer &&other);
+
+    /**
+     * @brief Put data in front of the buffer. At most one block is allocated.
+     */
+    void prepend(const char *buf, size_t len);
+
+    /**
+     * @brief Move all blocks of another buffer to the front of this buffer
+     * without copying the data. O(1).
+     */
+    void prepend(SegmentedBuffer &&other);
+
+    /**
+     * @brief Remove some bytes from the beginning of the buffer.
+     */
+    void retrieve(size_t len);
+
+    /**
+     * @brief Remove all data in the buffer.
+     */
+    void retrieveAll();
+
+    /**
+     * @brief Remove and return some bytes from the beginning of the buffer.
+     */
+    std::string read(size_t len);
+
+    /**
+     * @brief Remove some bytes from the beginning of the buffer and return
+     * them as a slice that shares the storage of the buffer, so it can be
+     * handed to other threads or sent without copying the data. The data
+     * is made contiguous first if it spans several blocks.
+     *
+     * @param len
+     * @return BufferSlice
+     */
+    BufferSlice readSlice(size_t len);
+
+    /**
+     * @brief Copy some bytes from the beginning of the buffer without
+     * removing them.
+     *
+     * @return size_t The number of bytes copied.
+     */
+    size_t copyTo(char *dst, size_t len) const;
+
+    /**
+     * @brief Make the first len bytes of the buffer contiguous, for parsers
+     * that need to see a whole message at once. Only copies data if it spans
+     * several blocks.
+     *
+     * @return const char* The beginning of the data.
+     */
+    const char *contiguous(size_t len);
+
+    /**
+     * @brief Fill an iovec array with the segments of the data, for gather
+     * writes.
+     *
+     * @param vec The array to fill.
+     * @param maxCount The size of the array.
+     * @return size_t The number of entries filled.
+     */
+    size_t peekSegments(struct iovec *vec, size_t maxCount) const;
+
+    /**
+     * @brief Read data from a file descriptor, scattering it into the free
+     * space of the last block and into new blocks.
+     *
+     * @param fd The file descriptor.
+     * @param retErrno The error code when reading fails.
+     * @return ssize_t The number of bytes read.
+     */
+    ssize_t readFd(int fd, int *retErrno);
+
+  private:
+    friend class BufferSlice;
+    struct Block;
+    Block *newBlock(size_t minCapacity);
+    static void releaseBlock(Block *block);
+    void releaseFront();
+
+    Block *head_{nullptr};
+    Block *tail_{nullptr};
+    size_t readableBytes_{0};
+};
+
+/**
+ * @brief An immutable view of some bytes taken from a SegmentedBuffer. The
+ * storage holding the bytes is reference counted and stays valid until the
+ * buffer and all slices referring to it are destroyed. Slices can be copied
+ * and destroyed in any thread.
+ *
+ */
+class TRANTOR_EXPORT BufferSlice
+{
+  public:
+    BufferSlice() = default;
+    BufferSlice(const BufferSlice &other) noexcept;
+    BufferSlice(BufferSlice &&other) noexcept;
+    BufferSlice &operator=(const BufferSlice &other) noexcept;
+    BufferSlice &operator=(BufferSlice &&other) noexcept;
+    ~BufferSlice();
+
+    const char *data() const
+    {
+        return data_;
+    }
+    size_t size() const
+    {
+        return size_;
+    }
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+    std::string toString() const
+    {
+        return std::string(data_, size_);
+    }
+
+    /**
+     * @brief Get a part of the slice sharing the same storage.
+     *
+     * @param offset
+     * @param len The length is truncated to the end of the slice.
+     * @return BufferSlice
+     */
+    BufferSlice subSlice(size_t offset, size_t len = size_t(-1)) const;
+
+  private:
+    friend class SegmentedBuffer;
+    BufferSlice(SegmentedBuffer::Block *block, const char *data, size_t size);
+
+    SegmentedBuffer::Block *block_{nullptr};
+    const char *data_{nullptr};
+    size_t size_{0};
+};
+
+}  // namespace trantor